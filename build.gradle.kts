@@ -27,6 +27,46 @@ android {
                 )
                 abiFilters.clear()
                 abiFilters += listOf("arm64-v8a", "x86_64")
+
+                // BoringSSL without OPENSSL_SMALL for these ABIs, e.g. -Psrtc.boringssl.fastAbis="arm64-v8a"
+                val fastAbis = project.findProperty("srtc.boringssl.fastAbis")?.toString() ?: ""
+                arguments += "-DSRTC_BORINGSSL_FAST_ABIS=$fastAbis"
+
+                // Executables built next to the library, which then has to be listed as a target too
+                val benchTargets = mutableListOf<String>()
+
+                // The OpenH264 software video encoder, -Psrtc.softwareH264=true, and its benchmark with
+                // -Psrtc.encoderBench=true
+                if (project.findProperty("srtc.softwareH264")?.toString() == "true") {
+                    arguments += "-DSRTC_SOFTWARE_H264=ON"
+                    if (project.findProperty("srtc.encoderBench")?.toString() == "true") {
+                        arguments += "-DSRTC_ENCODER_BENCH=ON"
+                        benchTargets += "srtc_encoder_bench"
+                    }
+                }
+
+                // Build the srtc_crypto_bench executable, -Psrtc.cryptoBench=true
+                if (project.findProperty("srtc.cryptoBench")?.toString() == "true") {
+                    arguments += "-DSRTC_CRYPTO_BENCH=ON"
+                    benchTargets += "srtc_crypto_bench"
+                }
+
+                // Build the srtc_thread_bench executable, -Psrtc.threadBench=true
+                if (project.findProperty("srtc.threadBench")?.toString() == "true") {
+                    arguments += "-DSRTC_THREAD_BENCH=ON"
+                    benchTargets += "srtc_thread_bench"
+                }
+
+                // Build the srtc_alloc_test executable, -Psrtc.allocTest=true
+                if (project.findProperty("srtc.allocTest")?.toString() == "true") {
+                    arguments += "-DSRTC_ALLOC_TEST=ON"
+                    benchTargets += "srtc_alloc_test"
+                }
+
+                if (benchTargets.isNotEmpty()) {
+                    targets += "srtctest"
+                    targets += benchTargets
+                }
             }
         }
     }
@@ -0,0 +1,119 @@
+package org.kman.srtctest
+
+import android.os.Bundle
+import androidx.test.ext.junit.runners.AndroidJUnit4
+import androidx.test.platform.app.InstrumentationRegistry
+import org.junit.Assert.assertEquals
+import org.junit.Assert.assertTrue
+import org.junit.Assume.assumeTrue
+import org.junit.Test
+import org.junit.runner.RunWith
+import org.kman.srtctest.util.MyLog
+import java.util.concurrent.CountDownLatch
+import java.util.concurrent.TimeUnit
+
+/*
+ * Runs the LoadGenerator without any UI, so it can be scripted. The arguments are the same as LoadTestActivity's
+ * extras, all passed as strings:
+ *
+ * adb shell am instrument -w -r -e class org.kman.srtctest.LoadGeneratorTest \
+ *     -e server http://127.0.0.1:8080/whip -e token test \
+ *     -e steps 1,2,4,8,16,32 -e seconds 30 -e video_kbps 1000 -e video_fps 30 -e audio true \
+ *     org.kman.srtctest.test/androidx.test.runner.AndroidJUnitRunner
+ *
+ * The CSV file is in the app's external files directory, its path is reported as the "output" status. Without a
+ * server the test is skipped, so it doesn't get in the way of the other instrumented tests.
+ */
+@RunWith(AndroidJUnit4::class)
+class LoadGeneratorTest {
+
+    @Test
+    fun runLoad() {
+        val instrumentation = InstrumentationRegistry.getInstrumentation()
+        val arguments = InstrumentationRegistry.getArguments()
+
+        val server = arguments.getString(ARG_SERVER)
+        assumeTrue("No server given", !server.isNullOrEmpty())
+
+        val stepList = (arguments.getString(ARG_STEPS) ?: DEFAULT_STEPS)
+            .split(',')
+            .mapNotNull { it.trim().toIntOrNull() }
+            .filter { it > 0 }
+            .sorted()
+
+        val params = LoadGenerator.Params(
+            server = server!!,
+            token = arguments.getString(ARG_TOKEN) ?: "",
+            stepList = stepList,
+            stepSeconds = arguments.getIntArgument(ARG_SECONDS, DEFAULT_SECONDS).coerceAtLeast(1),
+            videoKilobitPerSecond = arguments.getIntArgument(ARG_VIDEO_KBPS, DEFAULT_VIDEO_KBPS).coerceAtLeast(1),
+            videoFramesPerSecond = arguments.getIntArgument(ARG_VIDEO_FPS, DEFAULT_VIDEO_FPS).coerceIn(1, 60),
+            isAudioEnabled = arguments.getString(ARG_AUDIO)?.toBooleanStrictOrNull() ?: true
+        )
+
+        val outputFile = LoadGenerator.makeOutputFile(instrumentation.targetContext)
+        MyLog.i(TAG, "Steps %s, %d s each, output %s", stepList, params.stepSeconds, outputFile)
+
+        val completed = CountDownLatch(1)
+        val listener = object : LoadGenerator.Listener {
+            override fun onLoadProgress(message: String) {
+                MyLog.i(TAG, message)
+            }
+
+            override fun onLoadCompleted() {
+                completed.countDown()
+            }
+        }
+
+        // The generator runs off the main looper, same as in the activity
+        val generator = LoadGenerator(params, outputFile, listener)
+        instrumentation.runOnMainSync { generator.start() }
+
+        // Each step can take as long as connecting and measuring
+        val timeoutMs = stepList.size * (CONNECT_TIMEOUT_MS + params.stepSeconds * 1000L) + EXTRA_TIMEOUT_MS
+        val isCompleted = completed.await(timeoutMs, TimeUnit.MILLISECONDS)
+        if (!isCompleted) {
+            instrumentation.runOnMainSync { generator.stop() }
+        }
+
+        instrumentation.sendStatus(0, Bundle().apply { putString(STATUS_OUTPUT, outputFile.path) })
+
+        assertTrue("Timed out after $timeoutMs ms", isCompleted)
+
+        // The header and a row for each step, each with something connected
+        val lineList = outputFile.readLines().filter { it.isNotEmpty() }
+        assertEquals(stepList.size + 1, lineList.size)
+        for (line in lineList.drop(1)) {
+            val connectedCount = line.split(',')[1].toInt()
+            assertTrue("Nothing connected: $line", connectedCount > 0)
+        }
+    }
+
+    // Strings from "am instrument -e"
+    private fun Bundle.getIntArgument(key: String, defaultValue: Int): Int {
+        return getString(key)?.toIntOrNull() ?: defaultValue
+    }
+
+    companion object {
+        private const val TAG = "LoadGeneratorTest"
+
+        private const val ARG_SERVER = "server"
+        private const val ARG_TOKEN = "token"
+        private const val ARG_STEPS = "steps"
+        private const val ARG_SECONDS = "seconds"
+        private const val ARG_VIDEO_KBPS = "video_kbps"
+        private const val ARG_VIDEO_FPS = "video_fps"
+        private const val ARG_AUDIO = "audio"
+
+        private const val STATUS_OUTPUT = "output"
+
+        private const val DEFAULT_STEPS = "1,2,4,8,16"
+        private const val DEFAULT_SECONDS = 20
+        private const val DEFAULT_VIDEO_KBPS = 1000
+        private const val DEFAULT_VIDEO_FPS = 30
+
+        // Matches LoadGenerator's, plus some slack for shutting down
+        private const val CONNECT_TIMEOUT_MS = 15 * 1000L
+        private const val EXTRA_TIMEOUT_MS = 60 * 1000L
+    }
+}
@@ -0,0 +1,250 @@
+// Checks the allocation budget from alloc_tracker.h without a device or JNI. Every form of operator new is made once
+// to see that the tracker counts it. Then a real pacer is fed through the same VideoPublishPath and AudioPublishPath
+// (see publish_path.h) that JavaPeerConnection uses: borrowed H.264 frames for three simulcast layers, from a small
+// set of buffers that are only reused once released, and audio samples through Opus and RED. Each publish call runs
+// in an AllocScope, as does the pacer's copy of each video frame, and after the warm-up none of them may go over its
+// budget: zero for publishing video, and one per frame for the pacer's copy.
+//
+// Built with -DSRTC_ALLOC_TEST=ON and run with ctest, or pushed to a device like the benchmarks:
+//
+//   adb push srtc_alloc_test /data/local/tmp && adb shell /data/local/tmp/srtc_alloc_test [frames]
+//
+// The exit code is 1 if a check fails.
+
+#include "srtc/util.h"
+
+#include "alloc_tracker.h"
+#include "publish_pacer.h"
+#include "publish_path.h"
+#include "simulcast_policy.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+using srtc::android::AllocScope;
+using srtc::android::AllocScopeKind;
+
+constexpr size_t kLayerCount = 3;
+constexpr size_t kBufferCount = 4; // Per layer, about what MediaCodec has
+constexpr size_t kFrameSize = 4000;
+constexpr uint32_t kKeyFrameInterval = 60;
+
+constexpr int kAudioSampleRate = 48000;
+constexpr size_t kAudioSampleCount = 960; // 20 ms at 48 kHz
+
+uint32_t gFailCount = 0;
+
+void check(bool ok, const char* what)
+{
+    if (!ok) {
+        std::fprintf(stderr, "FAIL: %s\n", what);
+        gFailCount += 1;
+    }
+}
+
+// One allocation each, calling the operators directly so the compiler can't leave them out
+void checkOperatorNew()
+{
+    const auto countBefore = srtc::android::getThreadAllocCount();
+
+    ::operator delete(::operator new(16));
+    ::operator delete[](::operator new[](16));
+    ::operator delete(::operator new(16, std::nothrow), std::nothrow);
+    ::operator delete[](::operator new[](16, std::nothrow), std::nothrow);
+    ::operator delete(::operator new(64, std::align_val_t(64)), std::align_val_t(64));
+    ::operator delete[](::operator new[](64, std::align_val_t(64)), std::align_val_t(64));
+    ::operator delete(::operator new(64, std::align_val_t(64), std::nothrow), std::align_val_t(64), std::nothrow);
+    ::operator delete[](::operator new[](64, std::align_val_t(64), std::nothrow), std::align_val_t(64), std::nothrow);
+
+    check(srtc::android::getThreadAllocCount() - countBefore == 8, "every operator new is counted");
+}
+
+// Start code and a slice, nal_ref_idc is zero for the non-reference frames
+void fillFrame(uint8_t* buffer, uint32_t frameIndex)
+{
+    const auto isKeyFrame = frameIndex % kKeyFrameInterval == 0;
+    const auto isReference = isKeyFrame || frameIndex % 2 == 0;
+
+    buffer[0] = 0;
+    buffer[1] = 0;
+    buffer[2] = 0;
+    buffer[3] = 1;
+    buffer[4] = static_cast<uint8_t>((isReference ? 0x60 : 0x00) | (isKeyFrame ? 5 : 1));
+    for (size_t i = 5; i < kFrameSize; i += 1) {
+        buffer[i] = static_cast<uint8_t>(0x80 | (i + frameIndex));
+    }
+}
+
+// Stands in for the encoders' output buffers, which come back through the pacer's release function
+class BufferPool
+{
+public:
+    BufferPool()
+    {
+        for (auto& busy : mBusyList) {
+            busy = false;
+        }
+    }
+
+    [[nodiscard]] uint8_t* acquire(size_t layerIndex, uint64_t& token)
+    {
+        for (size_t i = 0; i < kBufferCount; i += 1) {
+            const auto index = layerIndex * kBufferCount + i;
+            if (!mBusyList[index]) {
+                mBusyList[index] = true;
+                token = index;
+                return mBufferList[index].data();
+            }
+        }
+        return nullptr;
+    }
+
+    void release(uint64_t token)
+    {
+        mBusyList[token] = false;
+    }
+
+private:
+    std::array<std::array<uint8_t, kFrameSize>, kLayerCount * kBufferCount> mBufferList;
+    std::array<std::atomic<bool>, kLayerCount * kBufferCount> mBusyList;
+};
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    const auto frameCount = argc > 1 ? static_cast<uint32_t>(std::atoi(argv[1])) : 600u;
+
+    if (!srtc::android::isAllocTrackingEnabled()) {
+        std::fprintf(stderr, "Needs SRTC_ALLOC_TRACKING\n");
+        return 1;
+    }
+
+    checkOperatorNew();
+
+    BufferPool pool;
+    std::atomic<uint32_t> sentVideoCount = 0;
+    std::atomic<uint32_t> sentAudioCount = 0;
+
+    srtc::android::PublishPacer pacer(
+        [&sentVideoCount](const std::shared_ptr<srtc::Track>&, int64_t, srtc::ByteBuffer&&) {
+            sentVideoCount += 1;
+            return srtc::Error::OK;
+        },
+        [&sentAudioCount](const std::shared_ptr<srtc::Track>&, int64_t, srtc::ByteBuffer&&) {
+            sentAudioCount += 1;
+            return srtc::Error::OK;
+        },
+        [&pool](uint64_t token) { pool.release(token); },
+        [](size_t) {});
+
+    // Plenty of bandwidth, so nothing is shed and the queues stay at their working size
+    const std::vector<uint32_t> layerBitrateList = { 300, 1000, 2500 };
+    srtc::android::SimulcastPolicy policy;
+    policy.setLayerList(layerBitrateList);
+    for (size_t i = 0; i < kLayerCount; i += 1) {
+        pacer.setLayerBitrate(i, layerBitrateList[i]);
+    }
+    pacer.setTargetBitrate(100000);
+    (void)policy.update(100000, srtc::getStableTimeMicros());
+
+    // The tracks are only passed through, so the video frames skip looking one up by layer name
+    const std::shared_ptr<srtc::Track> track;
+    const auto codec = srtc::Codec::H264;
+
+    srtc::android::VideoPublishPath videoPath(pacer, policy);
+    srtc::android::AudioPublishPath audioPath(pacer);
+    audioPath.setRedPayloadId(111);
+
+    std::array<int16_t, kAudioSampleCount> samples = {};
+
+    for (uint32_t frameIndex = 0; frameIndex < frameCount; frameIndex += 1) {
+        for (size_t layerIndex = 0; layerIndex < kLayerCount; layerIndex += 1) {
+            uint64_t token = 0;
+            uint8_t* buffer;
+            while ((buffer = pool.acquire(layerIndex, token)) == nullptr) {
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+            }
+            fillFrame(buffer, frameIndex);
+
+            // As in JavaPeerConnection::publishVideoFrameBorrowed
+            const AllocScope allocScope(AllocScopeKind::VideoSimulcast);
+            bool isKept = false;
+            videoPath.publishBorrowed(track, codec, layerIndex, buffer, kFrameSize, token, isKept);
+            if (!isKept) {
+                pool.release(token);
+            }
+        }
+
+        // A tone that comes and goes, quiet enough in the pauses for Opus to go into DTX
+        const auto isSpeech = (frameIndex / 50) % 2 == 0;
+        for (size_t i = 0; i < samples.size(); i += 1) {
+            const auto amplitude = isSpeech ? 8000.0 : 20.0;
+            samples[i] = static_cast<int16_t>(amplitude * std::sin(static_cast<double>(frameIndex * 960 + i) * 0.05));
+        }
+
+        // As in JavaPeerConnection::publishAudioFrame
+        {
+            const AllocScope allocScope(AllocScopeKind::Audio);
+            (void)audioPath.publish(track, samples.data(), sizeof(samples), kAudioSampleRate, 1, false);
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+
+    // Let the pacer finish, it releases the buffers as it goes
+    const auto droppedNonReferenceCount = videoPath.getDroppedNonReferenceFrames();
+    for (int i = 0; i < 500 && sentVideoCount + droppedNonReferenceCount < frameCount * kLayerCount; i += 1) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    const auto videoStats = srtc::android::getAllocStats(AllocScopeKind::VideoSimulcast);
+    const auto audioStats = srtc::android::getAllocStats(AllocScopeKind::Audio);
+    const auto sendStats = srtc::android::getAllocStats(AllocScopeKind::VideoSend);
+
+    std::printf("video: %llu calls, %llu allocations, steady max %u, sent %u, dropped non-reference %u\n",
+                static_cast<unsigned long long>(videoStats.call_count),
+                static_cast<unsigned long long>(videoStats.alloc_count),
+                videoStats.steady_max,
+                sentVideoCount.load(),
+                droppedNonReferenceCount);
+    std::printf("audio: %llu calls, %llu allocations, steady max %u, sent %u\n",
+                static_cast<unsigned long long>(audioStats.call_count),
+                static_cast<unsigned long long>(audioStats.alloc_count),
+                audioStats.steady_max,
+                sentAudioCount.load());
+    std::printf("video send: %llu calls, %llu allocations, steady max %u\n",
+                static_cast<unsigned long long>(sendStats.call_count),
+                static_cast<unsigned long long>(sendStats.alloc_count),
+                sendStats.steady_max);
+
+    check(videoStats.call_count == frameCount * kLayerCount, "every video frame went through the scope");
+    check(sentVideoCount + droppedNonReferenceCount == frameCount * kLayerCount, "every video frame was sent");
+    check(sentAudioCount > 0, "audio was sent");
+    check(videoStats.steady_max == 0, "video publishing doesn't allocate");
+    check(sendStats.call_count == sentVideoCount, "every video frame sent went through the scope");
+    check(sendStats.steady_max <= 1, "the pacer makes one allocation per video frame");
+
+    if (const auto error = srtc::android::checkAllocBudget(); error.isError()) {
+        std::fprintf(stderr, "%s\n", error.message.c_str());
+        gFailCount += 1;
+    }
+
+    if (gFailCount != 0) {
+        std::printf("%u checks failed\n", gFailCount);
+        return 1;
+    }
+
+    std::printf("All checks passed\n");
+    return 0;
+}
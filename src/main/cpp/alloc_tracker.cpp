@@ -0,0 +1,287 @@
+#include "srtc/logging.h"
+
+#include "alloc_tracker.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+#define LOG(level, ...) srtc::log(level, "AllocTracker", __VA_ARGS__)
+
+#ifdef SRTC_ALLOC_TRACKING
+
+namespace
+{
+
+thread_local uint64_t gThreadAllocCount = 0;
+
+struct KindStats {
+    std::atomic<uint64_t> call_count;
+    std::atomic<uint64_t> alloc_count;
+    std::atomic<uint32_t> steady_max;
+    std::atomic<uint64_t> over_budget_count;
+};
+
+KindStats gKindStatsList[srtc::android::kAllocScopeKindCount];
+
+void* countedAlloc(size_t size)
+{
+    gThreadAllocCount += 1;
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+void* countedAlignedAlloc(size_t size, std::align_val_t alignment)
+{
+    gThreadAllocCount += 1;
+
+    auto align = static_cast<size_t>(alignment);
+    if (align < sizeof(void*)) {
+        align = sizeof(void*);
+    }
+
+    void* ptr = nullptr;
+    if (posix_memalign(&ptr, align, size == 0 ? 1 : size) != 0) {
+        return nullptr;
+    }
+    return ptr;
+}
+
+} // namespace
+
+// All the replaceable forms, a library that uses one we miss would go uncounted
+
+void* operator new(size_t size)
+{
+    const auto ptr = countedAlloc(size);
+    if (ptr == nullptr) {
+        std::abort();
+    }
+    return ptr;
+}
+
+void* operator new[](size_t size)
+{
+    const auto ptr = countedAlloc(size);
+    if (ptr == nullptr) {
+        std::abort();
+    }
+    return ptr;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    return countedAlloc(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    return countedAlloc(size);
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+    const auto ptr = countedAlignedAlloc(size, alignment);
+    if (ptr == nullptr) {
+        std::abort();
+    }
+    return ptr;
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+    const auto ptr = countedAlignedAlloc(size, alignment);
+    if (ptr == nullptr) {
+        std::abort();
+    }
+    return ptr;
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return countedAlignedAlloc(size, alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return countedAlignedAlloc(size, alignment);
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    std::free(ptr);
+}
+
+namespace srtc::android
+{
+
+AllocScope::AllocScope(AllocScopeKind kind)
+    : mKind(kind)
+    , mStartCount(gThreadAllocCount)
+{
+}
+
+AllocScope::~AllocScope()
+{
+    const auto count = static_cast<uint32_t>(gThreadAllocCount - mStartCount);
+    auto& stats = gKindStatsList[static_cast<size_t>(mKind)];
+
+    const auto callIndex = stats.call_count.fetch_add(1);
+    stats.alloc_count += count;
+
+    if (callIndex >= kAllocWarmupCallCount) {
+        auto steadyMax = stats.steady_max.load();
+        while (count > steadyMax && !stats.steady_max.compare_exchange_weak(steadyMax, count)) {
+        }
+
+        if (count > kAllocBudgetList[static_cast<size_t>(mKind)]) {
+            stats.over_budget_count += 1;
+        }
+    }
+}
+
+bool isAllocTrackingEnabled()
+{
+    return true;
+}
+
+uint64_t getThreadAllocCount()
+{
+    return gThreadAllocCount;
+}
+
+AllocStats getAllocStats(AllocScopeKind kind)
+{
+    const auto& stats = gKindStatsList[static_cast<size_t>(kind)];
+    return { stats.call_count.load(),
+             stats.alloc_count.load(),
+             stats.steady_max.load(),
+             stats.over_budget_count.load() };
+}
+
+} // namespace srtc::android
+
+#else
+
+namespace srtc::android
+{
+
+bool isAllocTrackingEnabled()
+{
+    return false;
+}
+
+uint64_t getThreadAllocCount()
+{
+    return 0;
+}
+
+AllocStats getAllocStats(AllocScopeKind kind)
+{
+    return {};
+}
+
+} // namespace srtc::android
+
+#endif
+
+namespace srtc::android
+{
+
+Error checkAllocBudget()
+{
+    static const char* const kKindNameList[kAllocScopeKindCount] = {
+        "video single", "video simulcast", "audio", "video send"
+    };
+
+    std::string message;
+
+    for (size_t i = 0; i < kAllocScopeKindCount; i += 1) {
+        const auto stats = getAllocStats(static_cast<AllocScopeKind>(i));
+
+        LOG(SRTC_LOG_V,
+            "%s: %llu calls, %llu allocations, steady max %u, budget %u",
+            kKindNameList[i],
+            static_cast<unsigned long long>(stats.call_count),
+            static_cast<unsigned long long>(stats.alloc_count),
+            stats.steady_max,
+            kAllocBudgetList[i]);
+
+        if (stats.over_budget_count > 0) {
+            char buf[160];
+            std::snprintf(buf,
+                          sizeof(buf),
+                          "%s%s: %llu calls over the budget of %u, steady max %u",
+                          message.empty() ? "" : "; ",
+                          kKindNameList[i],
+                          static_cast<unsigned long long>(stats.over_budget_count),
+                          kAllocBudgetList[i],
+                          stats.steady_max);
+            message += buf;
+        }
+    }
+
+    if (!message.empty()) {
+        return { Error::Code::InvalidData, message };
+    }
+
+    return Error::OK;
+}
+
+} // namespace srtc::android
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "srtc/error.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace srtc::android
+{
+
+// The steady state allocation contract for the publish path. With SRTC_ALLOC_TRACKING (see CMakeLists.txt), the
+// global operator new is interposed, and every publish call and every video frame the pacer sends count the
+// allocations made on their thread. After a warm-up, a call that goes over its kind's budget is a violation. Without
+// it, AllocScope compiles to nothing.
+// srtc_alloc_test (see alloc_test.cpp) checks the budget without a device.
+
+enum class AllocScopeKind : int {
+    VideoSingle = 0,
+    VideoSimulcast = 1,
+    Audio = 2,
+    VideoSend = 3
+};
+
+constexpr size_t kAllocScopeKindCount = 4;
+
+// Per call. Video frames are borrowed, so publishing them allocates nothing, but that only moves the work: the pacer
+// copies each frame into the buffer srtc keeps, one allocation per frame on its thread. Packetizing in srtc isn't
+// counted. Audio hands the pacer the Opus packet, which is one allocation.
+constexpr uint32_t kAllocBudgetList[kAllocScopeKindCount] = {
+    0, // VideoSingle
+    0, // VideoSimulcast
+    1, // Audio
+    1, // VideoSend
+};
+
+// Encoder start, queue growth and the like
+constexpr uint32_t kAllocWarmupCallCount = 100;
+
+struct AllocStats {
+    uint64_t call_count;
+    uint64_t alloc_count;
+    uint32_t steady_max;
+    uint64_t over_budget_count;
+};
+
+#ifdef SRTC_ALLOC_TRACKING
+
+class AllocScope
+{
+public:
+    explicit AllocScope(AllocScopeKind kind);
+    ~AllocScope();
+
+    AllocScope(const AllocScope&) = delete;
+    AllocScope& operator=(const AllocScope&) = delete;
+
+private:
+    const AllocScopeKind mKind;
+    const uint64_t mStartCount;
+};
+
+#else
+
+class AllocScope
+{
+public:
+    explicit AllocScope(AllocScopeKind) {}
+};
+
+#endif
+
+[[nodiscard]] bool isAllocTrackingEnabled();
+
+// Every operator new made on the calling thread so far
+[[nodiscard]] uint64_t getThreadAllocCount();
+
+[[nodiscard]] AllocStats getAllocStats(AllocScopeKind kind);
+
+// An error describing the kinds that went over their budget
+[[nodiscard]] Error checkAllocBudget();
+
+} // namespace srtc::android
@@ -0,0 +1,412 @@
+#include "audio_red.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <strings.h>
+#include <vector>
+
+namespace
+{
+
+constexpr int64_t kOpusClockRate = 48000;
+
+// RED block headers have a 14 bit timestamp offset and a 10 bit length
+constexpr uint32_t kMaxBlockOffset = (1 << 14) - 1;
+constexpr size_t kMaxBlockSize = (1 << 10) - 1;
+
+// Loss thresholds for one and two redundant packets, going up and coming back down
+constexpr float kDepthUpPercent[srtc::android::RedEncoder::kMaxDepth] = { 2.0f, 10.0f };
+constexpr float kDepthDownPercent[srtc::android::RedEncoder::kMaxDepth] = { 1.0f, 5.0f };
+
+struct Lines {
+    std::vector<std::string> list;
+    std::string separator;
+};
+
+Lines splitLines(const std::string& sdp)
+{
+    Lines lines;
+    lines.separator = sdp.find("\r\n") != std::string::npos ? "\r\n" : "\n";
+
+    size_t pos = 0;
+    while (pos < sdp.size()) {
+        auto end = sdp.find('\n', pos);
+        if (end == std::string::npos) {
+            end = sdp.size();
+        }
+
+        auto line = sdp.substr(pos, end - pos);
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        lines.list.push_back(std::move(line));
+
+        pos = end + 1;
+    }
+
+    return lines;
+}
+
+std::string joinLines(const Lines& lines)
+{
+    std::string sdp;
+    for (const auto& line : lines.list) {
+        sdp += line;
+        sdp += lines.separator;
+    }
+    return sdp;
+}
+
+// Finds the first audio section, from its m= line up to the next m= line
+bool findAudioSection(const std::vector<std::string>& list, size_t& begin, size_t& end)
+{
+    for (begin = 0; begin < list.size(); begin += 1) {
+        if (list[begin].rfind("m=audio ", 0) == 0) {
+            for (end = begin + 1; end < list.size(); end += 1) {
+                if (list[end].rfind("m=", 0) == 0) {
+                    break;
+                }
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+// For "a=rtpmap:", "a=fmtp:" and "a=rtcp-fb:" lines
+bool parsePayloadAttr(const std::string& line, const char* prefix, int& payloadId, std::string& value)
+{
+    const auto prefixSize = std::strlen(prefix);
+    if (line.compare(0, prefixSize, prefix) != 0) {
+        return false;
+    }
+
+    const auto start = line.c_str() + prefixSize;
+    char* numberEnd = nullptr;
+    const auto number = std::strtol(start, &numberEnd, 10);
+    if (numberEnd == start || *numberEnd != ' ') {
+        return false;
+    }
+
+    payloadId = static_cast<int>(number);
+    value = numberEnd + 1;
+    return true;
+}
+
+std::string makePayloadAttr(const char* prefix, int payloadId, const std::string& value)
+{
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%s%d ", prefix, payloadId);
+    return buf + value;
+}
+
+// The m= line as its fixed part ("m=audio 9 UDP/TLS/RTP/SAVPF") and the payload types
+void splitMediaLine(const std::string& line, std::string& head, std::vector<int>& payloadIdList)
+{
+    std::vector<std::string> tokenList;
+    size_t pos = 0;
+    while (pos < line.size()) {
+        auto end = line.find(' ', pos);
+        if (end == std::string::npos) {
+            end = line.size();
+        }
+        if (end > pos) {
+            tokenList.push_back(line.substr(pos, end - pos));
+        }
+        pos = end + 1;
+    }
+
+    head.clear();
+    payloadIdList.clear();
+    for (size_t i = 0; i < tokenList.size(); i += 1) {
+        if (i < 3) {
+            head += (i == 0 ? "" : " ") + tokenList[i];
+        } else {
+            payloadIdList.push_back(std::atoi(tokenList[i].c_str()));
+        }
+    }
+}
+
+std::string joinMediaLine(const std::string& head, const std::vector<int>& payloadIdList)
+{
+    auto line = head;
+    for (const auto payloadId : payloadIdList) {
+        line += " " + std::to_string(payloadId);
+    }
+    return line;
+}
+
+bool isCodec(const std::string& rtpmapValue, const char* name)
+{
+    const auto nameSize = std::strlen(name);
+    return rtpmapValue.size() > nameSize && rtpmapValue[nameSize] == '/' &&
+           strncasecmp(rtpmapValue.c_str(), name, nameSize) == 0;
+}
+
+} // namespace
+
+namespace srtc::android
+{
+
+bool addRedToOffer(std::string& offer, RedPayloadIds& ids)
+{
+    auto lines = splitLines(offer);
+    auto& list = lines.list;
+
+    size_t begin, end;
+    if (!findAudioSection(list, begin, end)) {
+        return false;
+    }
+
+    // Find Opus, and all the payload types in use anywhere since they're bundled
+    int opusPayloadId = -1;
+    std::string opusRtpmap;
+    std::vector<int> usedList;
+
+    for (size_t i = 0; i < list.size(); i += 1) {
+        int payloadId;
+        std::string value;
+        if (parsePayloadAttr(list[i], "a=rtpmap:", payloadId, value)) {
+            usedList.push_back(payloadId);
+            if (i > begin && i < end && opusPayloadId < 0 && isCodec(value, "opus")) {
+                opusPayloadId = payloadId;
+                opusRtpmap = value;
+            }
+        } else if (list[i].rfind("m=", 0) == 0) {
+            std::string head;
+            std::vector<int> payloadIdList;
+            splitMediaLine(list[i], head, payloadIdList);
+            usedList.insert(usedList.end(), payloadIdList.begin(), payloadIdList.end());
+        }
+    }
+    if (opusPayloadId < 0) {
+        return false;
+    }
+
+    // Dynamic payload types which don't clash with RTCP when muxed
+    int newPayloadId = -1;
+    for (const auto& [from, to] : { std::pair{ 96, 127 }, std::pair{ 35, 63 } }) {
+        for (int payloadId = from; payloadId <= to && newPayloadId < 0; payloadId += 1) {
+            if (std::find(usedList.begin(), usedList.end(), payloadId) == usedList.end()) {
+                newPayloadId = payloadId;
+            }
+        }
+    }
+    if (newPayloadId < 0) {
+        return false;
+    }
+
+    std::vector<std::string> section;
+    for (size_t i = begin; i < end; i += 1) {
+        const auto& line = list[i];
+
+        int payloadId;
+        std::string value;
+        if (i == begin) {
+            // RED goes first, so it's preferred
+            std::string head;
+            std::vector<int> payloadIdList;
+            splitMediaLine(line, head, payloadIdList);
+            const auto iter = std::find(payloadIdList.begin(), payloadIdList.end(), opusPayloadId);
+            if (iter != payloadIdList.end()) {
+                payloadIdList.insert(iter + 1, newPayloadId);
+            }
+            section.push_back(joinMediaLine(head, payloadIdList));
+        } else if (parsePayloadAttr(line, "a=rtpmap:", payloadId, value) && payloadId == opusPayloadId) {
+            char fmtp[32];
+            std::snprintf(fmtp, sizeof(fmtp), "%d/%d", newPayloadId, newPayloadId);
+
+            section.push_back(makePayloadAttr("a=rtpmap:", opusPayloadId, "red/48000/2"));
+            section.push_back(makePayloadAttr("a=fmtp:", opusPayloadId, fmtp));
+            section.push_back(makePayloadAttr("a=rtpmap:", newPayloadId, opusRtpmap));
+        } else if (parsePayloadAttr(line, "a=fmtp:", payloadId, value) && payloadId == opusPayloadId) {
+            section.push_back(makePayloadAttr("a=fmtp:", newPayloadId, value));
+        } else {
+            section.push_back(line);
+        }
+    }
+
+    list.erase(list.begin() + static_cast<ptrdiff_t>(begin), list.begin() + static_cast<ptrdiff_t>(end));
+    list.insert(list.begin() + static_cast<ptrdiff_t>(begin), section.begin(), section.end());
+
+    offer = joinLines(lines);
+    ids.red = static_cast<uint8_t>(opusPayloadId);
+    ids.opus = static_cast<uint8_t>(newPayloadId);
+    return true;
+}
+
+bool rewriteAnswerForRed(std::string& answer, const RedPayloadIds& ids)
+{
+    auto lines = splitLines(answer);
+    auto& list = lines.list;
+
+    size_t begin, end;
+    if (!findAudioSection(list, begin, end)) {
+        return false;
+    }
+
+    bool hasRed = false, hasOpus = false;
+    for (size_t i = begin + 1; i < end; i += 1) {
+        int payloadId;
+        std::string value;
+        if (parsePayloadAttr(list[i], "a=rtpmap:", payloadId, value)) {
+            hasRed = hasRed || (payloadId == ids.red && isCodec(value, "red"));
+            hasOpus = hasOpus || (payloadId == ids.opus && isCodec(value, "opus"));
+        }
+    }
+    if (!hasOpus) {
+        // Nothing srtc would recognize either way
+        return false;
+    }
+
+    // Opus goes back to srtc's payload type, and RED, if accepted, is dropped
+    std::vector<std::string> section;
+    for (size_t i = begin; i < end; i += 1) {
+        const auto& line = list[i];
+
+        int payloadId;
+        std::string value;
+        if (i == begin) {
+            std::string head;
+            std::vector<int> payloadIdList;
+            splitMediaLine(line, head, payloadIdList);
+            std::vector<int> newPayloadIdList;
+            for (auto item : payloadIdList) {
+                if (item == ids.opus || item == ids.red) {
+                    item = ids.red;
+                }
+                if (std::find(newPayloadIdList.begin(), newPayloadIdList.end(), item) == newPayloadIdList.end()) {
+                    newPayloadIdList.push_back(item);
+                }
+            }
+            section.push_back(joinMediaLine(head, newPayloadIdList));
+        } else if (parsePayloadAttr(line, "a=rtpmap:", payloadId, value) ||
+                   parsePayloadAttr(line, "a=fmtp:", payloadId, value)) {
+            if (payloadId == ids.opus) {
+                const auto prefix = line.rfind("a=rtpmap:", 0) == 0 ? "a=rtpmap:" : "a=fmtp:";
+                section.push_back(makePayloadAttr(prefix, ids.red, value));
+            } else if (payloadId != ids.red) {
+                section.push_back(line);
+            }
+        } else if (parsePayloadAttr(line, "a=rtcp-fb:", payloadId, value)) {
+            // Feedback for what's actually sent, which is RED if it was accepted
+            if (payloadId == ids.opus) {
+                if (!hasRed) {
+                    section.push_back(makePayloadAttr("a=rtcp-fb:", ids.red, value));
+                }
+            } else if (payloadId != ids.red || hasRed) {
+                section.push_back(line);
+            }
+        } else {
+            section.push_back(line);
+        }
+    }
+
+    list.erase(list.begin() + static_cast<ptrdiff_t>(begin), list.begin() + static_cast<ptrdiff_t>(end));
+    list.insert(list.begin() + static_cast<ptrdiff_t>(begin), section.begin(), section.end());
+
+    answer = joinLines(lines);
+    return hasRed;
+}
+
+RedEncoder::RedEncoder()
+    : mHistory()
+    , mHistoryCount(0)
+    , mHistoryNext(0)
+{
+}
+
+void RedEncoder::reset()
+{
+    mHistoryCount = 0;
+    mHistoryNext = 0;
+}
+
+size_t RedEncoder::encode(uint8_t opusPayloadId,
+                          const uint8_t* packet,
+                          size_t size,
+                          int64_t pts_usec,
+                          size_t depth,
+                          uint8_t* output,
+                          size_t outputSize)
+{
+    // Previous packets which still fit in a block, oldest first
+    const Entry* blockList[kMaxDepth];
+    size_t blockCount = 0;
+
+    depth = std::min(depth, mHistoryCount);
+    for (size_t i = depth; i > 0; i -= 1) {
+        const auto& entry = mHistory[(mHistoryNext + kMaxDepth - i) % kMaxDepth];
+        const auto offset = (pts_usec - entry.pts_usec) * kOpusClockRate / 1000000;
+        if (offset > 0 && offset <= kMaxBlockOffset && entry.size <= kMaxBlockSize) {
+            blockList[blockCount++] = &entry;
+        }
+    }
+
+    // Drop the oldest blocks until it fits
+    size_t blockStart = 0;
+    const auto totalSize = [&] {
+        auto total = 1 + size;
+        for (size_t i = blockStart; i < blockCount; i += 1) {
+            total += 4 + blockList[i]->size;
+        }
+        return total;
+    };
+    while (blockStart < blockCount && totalSize() > outputSize) {
+        blockStart += 1;
+    }
+    if (totalSize() > outputSize) {
+        return 0;
+    }
+
+    // Headers
+    auto ptr = output;
+    for (size_t i = blockStart; i < blockCount; i += 1) {
+        const auto& entry = *blockList[i];
+        const auto offset = static_cast<uint32_t>((pts_usec - entry.pts_usec) * kOpusClockRate / 1000000);
+        const auto value = (offset << 10) | static_cast<uint32_t>(entry.size);
+
+        *ptr++ = 0x80 | opusPayloadId;
+        *ptr++ = static_cast<uint8_t>(value >> 16);
+        *ptr++ = static_cast<uint8_t>(value >> 8);
+        *ptr++ = static_cast<uint8_t>(value);
+    }
+    *ptr++ = opusPayloadId & 0x7F;
+
+    // Data
+    for (size_t i = blockStart; i < blockCount; i += 1) {
+        std::memcpy(ptr, blockList[i]->data.data(), blockList[i]->size);
+        ptr += blockList[i]->size;
+    }
+    std::memcpy(ptr, packet, size);
+    ptr += size;
+
+    // Remember this one
+    if (size <= kMaxPacketSize) {
+        auto& entry = mHistory[mHistoryNext];
+        std::memcpy(entry.data.data(), packet, size);
+        entry.size = size;
+        entry.pts_usec = pts_usec;
+
+        mHistoryNext = (mHistoryNext + 1) % kMaxDepth;
+        mHistoryCount = std::min(mHistoryCount + 1, kMaxDepth);
+    }
+
+    return static_cast<size_t>(ptr - output);
+}
+
+size_t RedEncoder::selectDepth(float packetsLostPercent, size_t currentDepth)
+{
+    auto depth = std::min(currentDepth, kMaxDepth);
+    while (depth < kMaxDepth && packetsLostPercent >= kDepthUpPercent[depth]) {
+        depth += 1;
+    }
+    while (depth > 0 && packetsLostPercent < kDepthDownPercent[depth - 1]) {
+        depth -= 1;
+    }
+    return depth;
+}
+
+} // namespace srtc::android
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace srtc::android
+{
+
+// RFC 2198 redundant audio for Opus.
+//
+// srtc doesn't know about RED, so it's negotiated by editing the SDP. In the offer, the payload type srtc picked for
+// Opus becomes RED, and Opus moves to a new payload type. The answer is edited back, so srtc keeps sending on its
+// original payload type believing it's Opus, and the payloads we hand it are RED. If the answer doesn't accept RED,
+// it still gets edited back to plain Opus.
+
+struct RedPayloadIds {
+    uint8_t red;  // srtc's Opus payload type, which carries RED on the wire
+    uint8_t opus; // The Opus payload type inside RED blocks
+};
+
+// Returns false if the offer has no Opus or no free payload type, and leaves it unchanged
+[[nodiscard]] bool addRedToOffer(std::string& offer, RedPayloadIds& ids);
+
+// Returns whether the answer accepted RED
+[[nodiscard]] bool rewriteAnswerForRed(std::string& answer, const RedPayloadIds& ids);
+
+// Builds RED payloads from the current Opus packet and the previous ones, which are kept as they were encoded
+
+class RedEncoder
+{
+public:
+    static constexpr size_t kMaxDepth = 2;
+
+    RedEncoder();
+
+    void reset();
+
+    // Returns the payload size, or zero if it doesn't fit. Blocks that are too large or too old for the RED header
+    // are left out.
+    [[nodiscard]] size_t encode(uint8_t opusPayloadId,
+                                const uint8_t* packet,
+                                size_t size,
+                                int64_t pts_usec,
+                                size_t depth,
+                                uint8_t* output,
+                                size_t outputSize);
+
+    // Picks the number of previous packets to carry, with some hysteresis
+    [[nodiscard]] static size_t selectDepth(float packetsLostPercent, size_t currentDepth);
+
+private:
+    // The largest Opus packet
+    static constexpr size_t kMaxPacketSize = 1275;
+
+    struct Entry {
+        std::array<uint8_t, kMaxPacketSize> data;
+        size_t size;
+        int64_t pts_usec;
+    };
+
+    // A ring, mHistoryNext is where the next packet goes
+    std::array<Entry, kMaxDepth> mHistory;
+    size_t mHistoryCount;
+    size_t mHistoryNext;
+};
+
+} // namespace srtc::android
@@ -0,0 +1,449 @@
+// Measures the crypto that the published media goes through, with the same BoringSSL build that the bridge links:
+// SRTP protect throughput for each SRTP profile, and DTLS handshake time for each cipher suite.
+//
+// Built with -DSRTC_CRYPTO_BENCH=ON, add the ABI to SRTC_BORINGSSL_FAST_ABIS to compare. Push to a device and run:
+//
+//   adb push srtc_crypto_bench /data/local/tmp && adb shell /data/local/tmp/srtc_crypto_bench [seconds]
+
+#include <openssl/bio.h>
+#include <openssl/ec.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/obj_mac.h>
+#include <openssl/rand.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+
+// OpenSSL 3 deprecates HMAC_CTX and EC_KEY for EVP_MAC and EVP_PKEY, BoringSSL only has the old ones
+#if defined(OPENSSL_VERSION_MAJOR) && OPENSSL_VERSION_MAJOR >= 3 && !defined(OPENSSL_IS_BORINGSSL)
+#define SRTC_BENCH_OPENSSL_3
+#include <openssl/core_names.h>
+#include <openssl/params.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace
+{
+
+// A typical video packet
+constexpr size_t kRtpHeaderSize = 12;
+constexpr size_t kRtpPayloadSize = 1200;
+
+constexpr int kHandshakeCount = 20;
+
+using Clock = std::chrono::steady_clock;
+
+double secondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+void fail(const char* what)
+{
+    std::fprintf(stderr, "Error: %s\n", what);
+    ERR_print_errors_fp(stderr);
+    std::exit(1);
+}
+
+// SRTP
+
+struct SrtpProfile {
+    const char* name;
+    const EVP_CIPHER* (*cipher)();
+    size_t tagSize; // HMAC-SHA1 tag for counter mode, zero for GCM
+    bool isGcm;
+};
+
+// HMAC-SHA1 keyed once, like a session would
+class HmacSha1
+{
+public:
+    HmacSha1(const uint8_t* key, size_t keySize)
+    {
+#ifdef SRTC_BENCH_OPENSSL_3
+        char digestName[] = "SHA1";
+        const OSSL_PARAM paramList[] = {
+            OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, digestName, 0),
+            OSSL_PARAM_construct_end(),
+        };
+        mMac = EVP_MAC_fetch(nullptr, "HMAC", nullptr);
+        mCtx = mMac == nullptr ? nullptr : EVP_MAC_CTX_new(mMac);
+        if (mCtx == nullptr || EVP_MAC_init(mCtx, key, keySize, paramList) != 1) {
+            fail("HMAC init");
+        }
+#else
+        mCtx = HMAC_CTX_new();
+        if (HMAC_Init_ex(mCtx, key, keySize, EVP_sha1(), nullptr) != 1) {
+            fail("HMAC init");
+        }
+#endif
+    }
+
+    ~HmacSha1()
+    {
+#ifdef SRTC_BENCH_OPENSSL_3
+        EVP_MAC_CTX_free(mCtx);
+        EVP_MAC_free(mMac);
+#else
+        HMAC_CTX_free(mCtx);
+#endif
+    }
+
+    HmacSha1(const HmacSha1&) = delete;
+    HmacSha1& operator=(const HmacSha1&) = delete;
+
+    // Over the packet and then the rollover counter, the tag is the full 20 bytes
+    void sign(const uint8_t* data, size_t size, const uint8_t* roc, size_t rocSize, uint8_t* tag)
+    {
+#ifdef SRTC_BENCH_OPENSSL_3
+        // Starting over without a key keeps the one from the constructor
+        size_t tagSize = 0;
+        if (EVP_MAC_init(mCtx, nullptr, 0, nullptr) != 1 || EVP_MAC_update(mCtx, data, size) != 1 ||
+            EVP_MAC_update(mCtx, roc, rocSize) != 1 || EVP_MAC_final(mCtx, tag, &tagSize, EVP_MAX_MD_SIZE) != 1) {
+            fail("HMAC");
+        }
+#else
+        unsigned int tagSize = 0;
+        if (HMAC_Init_ex(mCtx, nullptr, 0, nullptr, nullptr) != 1 || HMAC_Update(mCtx, data, size) != 1 ||
+            HMAC_Update(mCtx, roc, rocSize) != 1 || HMAC_Final(mCtx, tag, &tagSize) != 1) {
+            fail("HMAC");
+        }
+#endif
+    }
+
+private:
+#ifdef SRTC_BENCH_OPENSSL_3
+    EVP_MAC* mMac;
+    EVP_MAC_CTX* mCtx;
+#else
+    HMAC_CTX* mCtx;
+#endif
+};
+
+void fillPacket(std::vector<uint8_t>& packet, uint32_t seq)
+{
+    packet[0] = 0x80;
+    packet[1] = 96;
+    packet[2] = static_cast<uint8_t>(seq >> 8);
+    packet[3] = static_cast<uint8_t>(seq);
+}
+
+// Counter mode encryption of the payload, then HMAC-SHA1 over the header, payload and rollover counter (RFC 3711)
+void protectCounterMode(EVP_CIPHER_CTX* cipherCtx,
+                        HmacSha1& hmac,
+                        const SrtpProfile& profile,
+                        std::vector<uint8_t>& packet,
+                        uint32_t seq)
+{
+    uint8_t iv[16] = {};
+    iv[12] = static_cast<uint8_t>(seq >> 24);
+    iv[13] = static_cast<uint8_t>(seq >> 16);
+    iv[14] = static_cast<uint8_t>(seq >> 8);
+    iv[15] = static_cast<uint8_t>(seq);
+
+    int outSize = 0;
+    if (EVP_EncryptInit_ex(cipherCtx, nullptr, nullptr, nullptr, iv) != 1 ||
+        EVP_EncryptUpdate(cipherCtx,
+                          packet.data() + kRtpHeaderSize,
+                          &outSize,
+                          packet.data() + kRtpHeaderSize,
+                          static_cast<int>(kRtpPayloadSize)) != 1) {
+        fail("Counter mode encrypt");
+    }
+
+    const uint8_t roc[4] = {};
+    uint8_t tag[EVP_MAX_MD_SIZE];
+    hmac.sign(packet.data(), kRtpHeaderSize + kRtpPayloadSize, roc, sizeof(roc), tag);
+    std::memcpy(packet.data() + kRtpHeaderSize + kRtpPayloadSize, tag, profile.tagSize);
+}
+
+// The header is authenticated, the payload is encrypted, and the tag is appended (RFC 7714)
+void protectGcm(EVP_CIPHER_CTX* cipherCtx, std::vector<uint8_t>& packet, uint32_t seq)
+{
+    uint8_t iv[12] = {};
+    iv[8] = static_cast<uint8_t>(seq >> 24);
+    iv[9] = static_cast<uint8_t>(seq >> 16);
+    iv[10] = static_cast<uint8_t>(seq >> 8);
+    iv[11] = static_cast<uint8_t>(seq);
+
+    int outSize = 0;
+    if (EVP_EncryptInit_ex(cipherCtx, nullptr, nullptr, nullptr, iv) != 1 ||
+        EVP_EncryptUpdate(cipherCtx, nullptr, &outSize, packet.data(), static_cast<int>(kRtpHeaderSize)) != 1 ||
+        EVP_EncryptUpdate(cipherCtx,
+                          packet.data() + kRtpHeaderSize,
+                          &outSize,
+                          packet.data() + kRtpHeaderSize,
+                          static_cast<int>(kRtpPayloadSize)) != 1 ||
+        EVP_EncryptFinal_ex(cipherCtx, packet.data() + kRtpHeaderSize + kRtpPayloadSize, &outSize) != 1 ||
+        EVP_CIPHER_CTX_ctrl(
+            cipherCtx, EVP_CTRL_GCM_GET_TAG, 16, packet.data() + kRtpHeaderSize + kRtpPayloadSize) != 1) {
+        fail("GCM encrypt");
+    }
+}
+
+void benchSrtp(const SrtpProfile& profile, double seconds)
+{
+    uint8_t key[32];
+    uint8_t authKey[20];
+    RAND_bytes(key, sizeof(key));
+    RAND_bytes(authKey, sizeof(authKey));
+
+    // Contexts are set up once, like a session would
+    const auto cipherCtx = EVP_CIPHER_CTX_new();
+    if (EVP_EncryptInit_ex(cipherCtx, profile.cipher(), nullptr, key, nullptr) != 1) {
+        fail("Cipher init");
+    }
+    if (profile.isGcm && EVP_CIPHER_CTX_ctrl(cipherCtx, EVP_CTRL_GCM_SET_IVLEN, 12, nullptr) != 1) {
+        fail("GCM IV length");
+    }
+
+    std::unique_ptr<HmacSha1> hmac;
+    if (!profile.isGcm) {
+        hmac = std::make_unique<HmacSha1>(authKey, sizeof(authKey));
+    }
+
+    std::vector<uint8_t> packet(kRtpHeaderSize + kRtpPayloadSize + 16);
+
+    uint32_t seq = 0;
+    const auto start = Clock::now();
+    double elapsed = 0.0;
+
+    do {
+        // Check the clock every so often
+        for (int i = 0; i < 256; i += 1) {
+            fillPacket(packet, seq);
+            if (profile.isGcm) {
+                protectGcm(cipherCtx, packet, seq);
+            } else {
+                protectCounterMode(cipherCtx, *hmac, profile, packet, seq);
+            }
+            seq += 1;
+        }
+        elapsed = secondsSince(start);
+    } while (elapsed < seconds);
+
+    const auto packetsPerSecond = seq / elapsed;
+    std::printf("SRTP %-28s %10.0f packets/s %8.1f MB/s %6.2f us/packet\n",
+                profile.name,
+                packetsPerSecond,
+                packetsPerSecond * kRtpPayloadSize / 1e6,
+                1e6 / packetsPerSecond);
+
+    EVP_CIPHER_CTX_free(cipherCtx);
+}
+
+// DTLS
+
+EVP_PKEY* createKey()
+{
+    // ECDSA P-256, what the bridge uses for its certificate
+#ifdef SRTC_BENCH_OPENSSL_3
+    const auto key = EVP_EC_gen("P-256");
+    if (key == nullptr) {
+        fail("EC key");
+    }
+    return key;
+#else
+    const auto ecKey = EC_KEY_new_by_curve_name(NID_X9_62_prime256v1);
+    if (ecKey == nullptr || EC_KEY_generate_key(ecKey) != 1) {
+        fail("EC key");
+    }
+
+    const auto key = EVP_PKEY_new();
+    EVP_PKEY_assign_EC_KEY(key, ecKey);
+    return key;
+#endif
+}
+
+X509* createCertificate(EVP_PKEY* key)
+{
+    const auto cert = X509_new();
+    X509_set_version(cert, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+    X509_gmtime_adj(X509_getm_notBefore(cert), -3600);
+    X509_gmtime_adj(X509_getm_notAfter(cert), 3600);
+    X509_set_pubkey(cert, key);
+
+    const auto name = X509_get_subject_name(cert);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char*>("srtc"), -1, -1, 0);
+    X509_set_issuer_name(cert, name);
+
+    if (X509_sign(cert, key, EVP_sha256()) == 0) {
+        fail("Certificate signing");
+    }
+
+    return cert;
+}
+
+int acceptAnyCertificate(int, X509_STORE_CTX*)
+{
+    // WebRTC checks the fingerprint from the SDP instead
+    return 1;
+}
+
+SSL_CTX* createContext(const char* cipherList, const char* srtpProfile)
+{
+    const auto ctx = SSL_CTX_new(DTLS_method());
+    if (ctx == nullptr) {
+        fail("SSL_CTX_new");
+    }
+
+    const auto key = createKey();
+    const auto cert = createCertificate(key);
+    SSL_CTX_use_certificate(ctx, cert);
+    SSL_CTX_use_PrivateKey(ctx, key);
+    X509_free(cert);
+    EVP_PKEY_free(key);
+
+    SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT, acceptAnyCertificate);
+    if (SSL_CTX_set_cipher_list(ctx, cipherList) != 1) {
+        fail("Cipher list");
+    }
+    if (SSL_CTX_set_tlsext_use_srtp(ctx, srtpProfile) != 0) {
+        fail("SRTP profile");
+    }
+
+    return ctx;
+}
+
+// Moves whatever one side wrote over to the other side
+bool shuttle(BIO* from, BIO* to)
+{
+    auto moved = false;
+    char buf[4096];
+    int size;
+    while ((size = BIO_read(from, buf, sizeof(buf))) > 0) {
+        BIO_write(to, buf, size);
+        moved = true;
+    }
+    return moved;
+}
+
+double runHandshake(SSL_CTX* clientCtx, SSL_CTX* serverCtx)
+{
+    const auto client = SSL_new(clientCtx);
+    const auto server = SSL_new(serverCtx);
+
+    // Reads of an empty memory BIO mean "try again later"
+    BIO* clientRead = BIO_new(BIO_s_mem());
+    BIO* clientWrite = BIO_new(BIO_s_mem());
+    BIO* serverRead = BIO_new(BIO_s_mem());
+    BIO* serverWrite = BIO_new(BIO_s_mem());
+    for (const auto bio : { clientRead, clientWrite, serverRead, serverWrite }) {
+        BIO_set_mem_eof_return(bio, -1);
+    }
+
+    SSL_set_bio(client, clientRead, clientWrite);
+    SSL_set_bio(server, serverRead, serverWrite);
+    SSL_set_connect_state(client);
+    SSL_set_accept_state(server);
+    SSL_set_mtu(client, 1200);
+    SSL_set_mtu(server, 1200);
+
+    const auto start = Clock::now();
+
+    auto isClientDone = false;
+    auto isServerDone = false;
+    for (int round = 0; round < 100 && !(isClientDone && isServerDone); round += 1) {
+        if (!isClientDone) {
+            const auto res = SSL_do_handshake(client);
+            isClientDone = res == 1;
+            if (res != 1 && SSL_get_error(client, res) != SSL_ERROR_WANT_READ) {
+                fail("Client handshake");
+            }
+        }
+        shuttle(clientWrite, serverRead);
+
+        if (!isServerDone) {
+            const auto res = SSL_do_handshake(server);
+            isServerDone = res == 1;
+            if (res != 1 && SSL_get_error(server, res) != SSL_ERROR_WANT_READ) {
+                fail("Server handshake");
+            }
+        }
+        shuttle(serverWrite, clientRead);
+    }
+
+    const auto elapsed = secondsSince(start);
+    if (!isClientDone || !isServerDone) {
+        fail("The handshake did not complete");
+    }
+
+    SSL_free(client);
+    SSL_free(server);
+
+    return elapsed;
+}
+
+void benchDtls(const char* cipherList, const char* srtpProfile)
+{
+    const auto clientCtx = createContext(cipherList, srtpProfile);
+    const auto serverCtx = createContext(cipherList, srtpProfile);
+
+    // The first one warms up the caches
+    (void)runHandshake(clientCtx, serverCtx);
+
+    double total = 0.0;
+    double max = 0.0;
+    for (int i = 0; i < kHandshakeCount; i += 1) {
+        const auto elapsed = runHandshake(clientCtx, serverCtx);
+        total += elapsed;
+        max = std::max(max, elapsed);
+    }
+
+    std::printf("DTLS %-32s avg %7.2f ms, max %7.2f ms (both sides, %d runs)\n",
+                cipherList,
+                total / kHandshakeCount * 1000.0,
+                max * 1000.0,
+                kHandshakeCount);
+
+    SSL_CTX_free(clientCtx);
+    SSL_CTX_free(serverCtx);
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    const auto seconds = argc > 1 ? std::atof(argv[1]) : 2.0;
+
+#ifdef OPENSSL_IS_BORINGSSL
+#ifdef SRTC_BORINGSSL_FAST
+    std::printf("BoringSSL\n");
+#else
+    std::printf("BoringSSL, OPENSSL_SMALL\n");
+#endif
+#else
+    std::printf("%s\n", OpenSSL_version(OPENSSL_VERSION));
+#endif
+
+    const SrtpProfile srtpProfileList[] = {
+        { "AES_CM_128_HMAC_SHA1_80", EVP_aes_128_ctr, 10, false },
+        { "AES_CM_128_HMAC_SHA1_32", EVP_aes_128_ctr, 4, false },
+        { "AEAD_AES_128_GCM", EVP_aes_128_gcm, 0, true },
+        { "AEAD_AES_256_GCM", EVP_aes_256_gcm, 0, true },
+    };
+    for (const auto& profile : srtpProfileList) {
+        benchSrtp(profile, seconds);
+    }
+
+    const char* const cipherList[] = {
+        "ECDHE-ECDSA-AES128-GCM-SHA256",
+        "ECDHE-ECDSA-AES256-GCM-SHA384",
+        "ECDHE-ECDSA-CHACHA20-POLY1305",
+    };
+    for (const auto cipher : cipherList) {
+        benchDtls(cipher, "SRTP_AES128_CM_SHA1_80:SRTP_AEAD_AES_128_GCM");
+    }
+
+    return 0;
+}
@@ -0,0 +1,137 @@
+// Measures the software video encoder (see software_video_encoder.h) the way the bridge drives it: an RGBA frame is
+// submitted, converted to I420, scaled for each layer and encoded. Each frame is submitted once the previous one is
+// done, so the times are the per frame cost, and 1000 / avg is the frame rate the device could sustain.
+//
+// Built with -DSRTC_SOFTWARE_H264=ON -DSRTC_ENCODER_BENCH=ON, push to a device and run:
+//
+//   adb push srtc_encoder_bench /data/local/tmp && adb shell /data/local/tmp/srtc_encoder_bench [seconds]
+//
+// It has no Android dependencies, so a desktop Linux build of OpenH264 and srtc works too.
+
+#include "software_video_encoder.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+constexpr uint32_t kWidth = 1280;
+constexpr uint32_t kHeight = 720;
+
+struct Config {
+    const char* name;
+    std::vector<srtc::android::SoftwareVideoLayer> layerList;
+};
+
+// A gradient that moves, so every frame has something new to encode
+void fillFrame(std::vector<uint8_t>& frame, uint32_t index)
+{
+    for (uint32_t y = 0; y < kHeight; y += 1) {
+        auto row = frame.data() + y * kWidth * 4;
+        for (uint32_t x = 0; x < kWidth; x += 1) {
+            row[x * 4 + 0] = static_cast<uint8_t>(x + index * 3);
+            row[x * 4 + 1] = static_cast<uint8_t>(y + index * 2);
+            row[x * 4 + 2] = static_cast<uint8_t>((x ^ y) + index);
+            row[x * 4 + 3] = 0xFF;
+        }
+    }
+}
+
+void run(const Config& config, uint32_t threadCount, double seconds)
+{
+    std::atomic<uint64_t> byteCount = 0;
+
+    std::unique_ptr<srtc::android::SoftwareVideoEncoder> encoder;
+    const auto error = srtc::android::SoftwareVideoEncoder::create(
+        config.layerList,
+        threadCount,
+        [&byteCount](size_t, const uint8_t*, size_t size, bool) { byteCount += size; },
+        {},
+        encoder);
+    if (error.isError()) {
+        std::fprintf(stderr, "Error: %s\n", error.message.c_str());
+        std::exit(1);
+    }
+
+    // A few frames to draw from, generating them isn't part of the measurement
+    std::vector<std::vector<uint8_t>> frameList(8, std::vector<uint8_t>(kWidth * kHeight * 4));
+    for (uint32_t i = 0; i < frameList.size(); i += 1) {
+        fillFrame(frameList[i], i);
+    }
+
+    std::vector<double> timeList;
+    const auto start = Clock::now();
+    uint32_t index = 0;
+
+    while (std::chrono::duration<double>(Clock::now() - start).count() < seconds) {
+        const auto& frame = frameList[index % frameList.size()];
+        const auto frameStart = Clock::now();
+
+        (void)encoder->submit(frame.data(), kWidth * 4, kWidth, kHeight, index * 1000000ll / 30);
+        index += 1;
+        while (encoder->getStats().encoded_frames < index) {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+
+        timeList.push_back(std::chrono::duration<double, std::milli>(Clock::now() - frameStart).count());
+    }
+
+    encoder.reset();
+
+    std::sort(timeList.begin(), timeList.end());
+    double sum = 0;
+    for (const auto t : timeList) {
+        sum += t;
+    }
+
+    const auto avg = sum / static_cast<double>(timeList.size());
+    const auto p50 = timeList[timeList.size() / 2];
+    const auto p99 = timeList[std::min(timeList.size() - 1, timeList.size() * 99 / 100)];
+
+    std::printf("%-10s %7u %9.2f %9.2f %9.2f %9.1f %10.1f\n",
+                config.name,
+                threadCount,
+                avg,
+                p50,
+                p99,
+                1000.0 / avg,
+                static_cast<double>(byteCount.load()) / 1024 / static_cast<double>(timeList.size()));
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    const auto seconds = argc > 1 ? std::atof(argv[1]) : 5.0;
+
+    // The same layers as the app
+    const std::vector<Config> configList = {
+        { "single", { { "", kWidth, kHeight, 1500, 15 } } },
+        { "simulcast",
+          { { "low", kWidth / 4, kHeight / 4, 300, 15 },
+            { "mid", kWidth / 2, kHeight / 2, 1000, 15 },
+            { "hi", kWidth, kHeight, 1500, 15 } } },
+    };
+
+    const auto cpuCount = std::max(std::thread::hardware_concurrency(), 1u);
+
+    std::printf("%ux%u RGBA input, %.1f seconds each, times in ms per frame\n\n", kWidth, kHeight, seconds);
+    std::printf("%-10s %7s %9s %9s %9s %9s %10s\n", "config", "threads", "avg", "p50", "p99", "max fps", "KB/frame");
+
+    for (const auto& config : configList) {
+        for (uint32_t threadCount = 1; threadCount <= std::min(cpuCount, 4u); threadCount *= 2) {
+            run(config, threadCount, seconds);
+        }
+    }
+
+    return 0;
+}
@@ -86,6 +86,31 @@ std::string ClassMap::getFieldString(JNIEnv* env, jobject obj, const char* name)
     return res;
 }
 
+bool ClassMap::getFieldString(JNIEnv* env, jobject obj, const char* name, char* buf, size_t bufSize) const
+{
+    const auto iter = mFieldMap.find(name);
+    assert(iter != mFieldMap.end());
+
+    const auto value = env->GetObjectField(obj, iter->second);
+    if (value == nullptr) {
+        return false;
+    }
+
+    const auto jstr = static_cast<jstring>(value);
+    const auto size = static_cast<size_t>(env->GetStringUTFLength(jstr));
+
+    auto res = false;
+    if (size < bufSize) {
+        env->GetStringUTFRegion(jstr, 0, env->GetStringLength(jstr), buf);
+        buf[size] = 0;
+        res = true;
+    }
+
+    env->DeleteLocalRef(value);
+
+    return res;
+}
+
 jobjectArray ClassMap::getFieldObjectArray(JNIEnv* env, jobject obj, const char* name) const
 {
     const auto iter = mFieldMap.find(name);
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <unordered_map>
 
 #include <jni.h>
@@ -8,6 +9,9 @@
 namespace srtc::android
 {
 
+// Method and field names are kept as views, so they have to be string literals. This way, looking them up in the
+// publish path doesn't allocate.
+
 class ClassMap
 {
 public:
@@ -21,6 +25,8 @@ public:
     [[nodiscard]] jint getFieldInt(JNIEnv* env, jobject obj, const char* name) const;
     [[nodiscard]] jboolean getFieldBoolean(JNIEnv* env, jobject obj, const char* name) const;
     [[nodiscard]] std::string getFieldString(JNIEnv* env, jobject obj, const char* name) const;
+    // Doesn't allocate, returns false if the value is null or doesn't fit
+    [[nodiscard]] bool getFieldString(JNIEnv* env, jobject obj, const char* name, char* buf, size_t bufSize) const;
     [[nodiscard]] jobjectArray getFieldObjectArray(JNIEnv* env, jobject obj, const char* name) const;
 
     void setFieldObject(JNIEnv* env, jobject obj, const char* name, jobject value);
@@ -34,8 +40,8 @@ public:
 
 private:
     jclass mClass;
-    std::unordered_map<std::string, jmethodID> mMethodMap;
-    std::unordered_map<std::string, jfieldID> mFieldMap;
+    std::unordered_map<std::string_view, jmethodID> mMethodMap;
+    std::unordered_map<std::string_view, jfieldID> mFieldMap;
 };
 
 } // namespace srtc::android
@@ -5,13 +5,18 @@
 #include "srtc/track.h"
 #include "srtc/util.h"
 
-#include "opus.h"
-#include "opus_defines.h"
-
+#include "alloc_tracker.h"
+#include "audio_red.h"
 #include "jni_class_map.h"
 #include "jni_error.h"
 #include "jni_peer_connection.h"
 #include "jni_util.h"
+#include "media_util.h"
+#include "offer_config.h"
+#include "peer_connection_pool.h"
+#include "thread_policy.h"
+
+#include <algorithm>
 
 #include <jni.h>
 
@@ -26,12 +31,30 @@ srtc::android::ClassMap gClassSimulcastLayer;
 srtc::android::ClassMap gClassTrack;
 srtc::android::ClassMap gClassTrackCodecOptions;
 srtc::android::ClassMap gClassPeerConnection;
-srtc::android::ClassMap gClassOfferConfig;
-srtc::android::ClassMap gClassVideoCodec;
-srtc::android::ClassMap gClassVideoConfig;
-srtc::android::ClassMap gClassAudioCodec;
-srtc::android::ClassMap gClassAudioConfig;
 srtc::android::ClassMap gClassPublishConnectionStats;
+srtc::android::ClassMap gClassThreadStats;
+srtc::android::ClassMap gClassPublishError;
+
+srtc::android::PeerConnectionPool gPeerConnectionPool;
+
+std::vector<srtc::ByteBuffer> copyByteBufferList(const std::vector<srtc::ByteBuffer>& list)
+{
+    std::vector<srtc::ByteBuffer> res;
+    for (const auto& item : list) {
+        res.emplace_back(item.data(), item.size());
+    }
+    return res;
+}
+
+// The size comes from Java separately from the buffer, so it has to be checked against the buffer's capacity
+const uint8_t* getOfferConfigBuffer(JNIEnv* env, jobject config, jint configSize)
+{
+    const auto configPtr = static_cast<const uint8_t*>(env->GetDirectBufferAddress(config));
+    if (configPtr == nullptr || configSize < 0 || configSize > env->GetDirectBufferCapacity(config)) {
+        return nullptr;
+    }
+    return configPtr;
+}
 
 jobject newCodecOptions(JNIEnv* env, const std::shared_ptr<srtc::Track::CodecOptions>& codecOptions)
 {
@@ -65,7 +88,7 @@ extern "C" JNIEXPORT void JNICALL Java_org_kman_srtctest_rtc_PeerConnection_rele
 }
 
 extern "C" JNIEXPORT jstring JNICALL Java_org_kman_srtctest_rtc_PeerConnection_initPublishOfferImpl(
-    JNIEnv* env, jobject thiz, jlong handle, jobject config, jobject video, jobject audio)
+    JNIEnv* env, jobject thiz, jlong handle, jobject config, jint configSize)
 {
     const auto ptr = reinterpret_cast<srtc::android::JavaPeerConnection*>(handle);
     if (!ptr) {
@@ -74,90 +97,84 @@ extern "C" JNIEXPORT jstring JNICALL Java_org_kman_srtctest_rtc_PeerConnection_i
         return nullptr;
     }
 
-    // Publish config
-    const srtc::PubOfferConfig offerConfig = { .cname = gClassOfferConfig.getFieldString(env, config, "cname"),
-                                               .enable_bwe = true,
-                                               .enable_rfc8851 = true };
-
-    // Media lines
+    // Publish config and media lines, serialized by the Java side
+    srtc::PubOfferConfig offerConfig = {};
     srtc::PubMediaConfig mediaConfig = {};
 
-    // Video
-    if (video) {
-        srtc::PubMediaItem mediaItem = {};
-        mediaItem.media_id = "video_0";
-        mediaItem.media_type = srtc::MediaType::Video;
-
-        const auto codecListJni = gClassVideoConfig.getFieldObject(env, video, "codecList");
-        for (jsize i = 0; i < gClassJavaUtilArrayList.callIntMethod(env, codecListJni, "size"); i += 1) {
-            const auto itemJni = gClassJavaUtilArrayList.callObjectMethod(env, codecListJni, "get", i);
-            mediaItem.codec_list.push_back(srtc::PubCodec{
-                .codec = static_cast<srtc::Codec>(gClassVideoCodec.getFieldInt(env, itemJni, "codec")),
-                .profile_level_id = static_cast<uint32_t>(gClassVideoCodec.getFieldInt(env, itemJni, "profileLevelId")),
-                .minptime = 0,
-                .stereo = false });
-        }
-
-        const auto simulcastListJni = gClassVideoConfig.getFieldObject(env, video, "simulcastLayerList");
-        for (jsize i = 0; i < gClassJavaUtilArrayList.callIntMethod(env, simulcastListJni, "size"); i += 1) {
-            const auto itemJni = gClassJavaUtilArrayList.callObjectMethod(env, simulcastListJni, "get", i);
-            mediaItem.layer_list.push_back(srtc::SimulcastLayer{
-                .name = gClassSimulcastLayer.getFieldString(env, itemJni, "name"),
-                .width = static_cast<uint16_t>(gClassSimulcastLayer.getFieldInt(env, itemJni, "width")),
-                .height = static_cast<uint16_t>(gClassSimulcastLayer.getFieldInt(env, itemJni, "height")),
-                .frames_per_second =
-                    static_cast<uint16_t>(gClassSimulcastLayer.getFieldInt(env, itemJni, "framesPerSecond")),
-                .kilobits_per_second =
-                    static_cast<uint32_t>(gClassSimulcastLayer.getFieldInt(env, itemJni, "kilobitPerSecond")) });
-        }
-
-        mediaConfig.media_list.push_back(std::move(mediaItem));
+    const auto configPtr = getOfferConfigBuffer(env, config, configSize);
+    if (configPtr == nullptr) {
+        const srtc::Error error = { srtc::Error::Code::InvalidData, "The offer config buffer is invalid" };
+        srtc::android::JavaError::throwSRtcException(env, error);
+        return nullptr;
     }
 
-    // Audio
-    if (audio) {
-        srtc::PubMediaItem mediaItem = {};
-        mediaItem.media_id = "audio_0";
-        mediaItem.media_type = srtc::MediaType::Audio;
+    if (const auto configError = srtc::android::decodeOfferConfig(
+            configPtr, static_cast<size_t>(configSize), offerConfig, mediaConfig);
+        configError.isError()) {
+        srtc::android::JavaError::throwSRtcException(env, configError);
+        return nullptr;
+    }
 
-        const auto itemListJni = gClassAudioConfig.getFieldObject(env, audio, "codecList");
-        for (jsize i = 0; i < gClassJavaUtilArrayList.callIntMethod(env, itemListJni, "size"); i += 1) {
-            const auto itemJni = gClassJavaUtilArrayList.callObjectMethod(env, itemListJni, "get", i);
-            mediaItem.codec_list.push_back(srtc::PubCodec{
-                .codec = static_cast<srtc::Codec>(gClassAudioCodec.getFieldInt(env, itemJni, "codec")),
-                .profile_level_id = 0,
-                .minptime = static_cast<uint32_t>(gClassAudioCodec.getFieldInt(env, itemJni, "minptime")),
-                .stereo = static_cast<bool>(gClassAudioCodec.getFieldBoolean(env, itemJni, "stereo")),
-            });
-        }
+    // RED is negotiated by editing the offer, which srtc doesn't know about
+    const auto enableRed = srtc::android::isOfferConfigFlagSet(
+        configPtr, static_cast<size_t>(configSize), srtc::android::kOfferConfigFlagEnableRED);
 
-        mediaConfig.media_list.push_back(std::move(mediaItem));
+    // Use a connection prepared in the background if there is one
+    if (auto entry = gPeerConnectionPool.acquire(configPtr, static_cast<size_t>(configSize))) {
+        ptr->setConnection(std::move(entry->conn));
+        const auto editedOfferStr = ptr->editOffer(std::move(entry->offerStr), enableRed);
+        return env->NewStringUTF(editedOfferStr.c_str());
     }
 
     // Create the offer
     std::string outSdpOffer;
 
-    const auto [offer, offerError] = ptr->mConn->createPublishOffer(offerConfig, mediaConfig);
+    const auto conn = ptr->getConnection();
+    const auto [offer, offerError] = conn->createPublishOffer(offerConfig, mediaConfig);
     if (offerError.isError()) {
         // Throw an exception
         srtc::android::JavaError::throwSRtcException(env, offerError);
         return nullptr;
     }
 
-    const auto [offerStr, offerStrError] = offer->generate();
+    auto [offerStr, offerStrError] = offer->generate();
     if (offerStrError.isError()) {
         // Throw an exception
         srtc::android::JavaError::throwSRtcException(env, offerStrError);
         return nullptr;
     }
 
-    if (const auto setOfferError = ptr->mConn->setOffer(offer); setOfferError.isError()) {
+    if (const auto setOfferError = conn->setOffer(offer); setOfferError.isError()) {
         // Throw an exception
         srtc::android::JavaError::throwSRtcException(env, setOfferError);
         return nullptr;
     }
 
-    return env->NewStringUTF(offerStr.c_str());
+    const auto editedOfferStr = ptr->editOffer(std::move(offerStr), enableRed);
+    return env->NewStringUTF(editedOfferStr.c_str());
+}
+
+extern "C" JNIEXPORT void JNICALL Java_org_kman_srtctest_rtc_PeerConnection_reconnectImpl(JNIEnv* env,
+                                                                                          jobject thiz,
+                                                                                          jlong handle)
+{
+    const auto ptr = reinterpret_cast<srtc::android::JavaPeerConnection*>(handle);
+    if (!ptr) {
+        return;
+    }
+
+    ptr->reconnect();
+}
+
+extern "C" JNIEXPORT void JNICALL Java_org_kman_srtctest_rtc_PeerConnection_prewarmImpl(JNIEnv* env,
+                                                                                        jclass clazz,
+                                                                                        jobject config,
+                                                                                        jint configSize)
+{
+    const auto configPtr = getOfferConfigBuffer(env, config, configSize);
+    if (configPtr) {
+        gPeerConnectionPool.prewarm(configPtr, static_cast<size_t>(configSize));
+    }
 }
 
 extern "C" JNIEXPORT void JNICALL Java_org_kman_srtctest_rtc_PeerConnection_setPublishAnswerImpl(JNIEnv* env,
@@ -170,11 +187,12 @@ extern "C" JNIEXPORT void JNICALL Java_org_kman_srtctest_rtc_PeerConnection_setP
         return;
     }
 
-    const auto offer = ptr->mConn->getOffer();
-    const auto answerStr = srtc::android::fromJavaString(env, answerJ);
+    const auto conn = ptr->getConnection();
+    const auto offer = conn->getOffer();
+    const auto answerStr = ptr->editAnswer(srtc::android::fromJavaString(env, answerJ));
     const auto selector = std::make_shared<srtc::HighestTrackSelector>();
 
-    const auto [answer, answerError] = ptr->mConn->parsePublishAnswer(offer, answerStr, selector);
+    const auto [answer, answerError] = conn->parsePublishAnswer(offer, answerStr, selector);
     if (answerError.isError()) {
         srtc::android::JavaError::throwSRtcException(env, answerError);
         return;
@@ -232,7 +250,7 @@ extern "C" JNIEXPORT void JNICALL Java_org_kman_srtctest_rtc_PeerConnection_setP
     }
     gClassPeerConnection.setFieldObject(env, thiz, "mAudioTrack", audioTrackJ);
 
-    if (const auto setAnswerError = ptr->mConn->setAnswer(answer); setAnswerError.isError()) {
+    if (const auto setAnswerError = conn->setAnswer(answer); setAnswerError.isError()) {
         srtc::android::JavaError::throwSRtcException(env, setAnswerError);
         return;
     }
@@ -273,14 +291,16 @@ extern "C" JNIEXPORT void JNICALL Java_org_kman_srtctest_rtc_PeerConnection_setV
     }
 }
 
-extern "C" JNIEXPORT void JNICALL Java_org_kman_srtctest_rtc_PeerConnection_publishVideoSingleFrameImpl(JNIEnv* env,
+extern "C" JNIEXPORT jint JNICALL Java_org_kman_srtctest_rtc_PeerConnection_publishVideoSingleFrameImpl(JNIEnv* env,
                                                                                                         jobject thiz,
                                                                                                         jlong handle,
                                                                                                         jobject buf)
 {
+    const srtc::android::AllocScope allocScope(srtc::android::AllocScopeKind::VideoSingle);
+
     const auto ptr = reinterpret_cast<srtc::android::JavaPeerConnection*>(handle);
     if (!ptr) {
-        return;
+        return 0;
     }
 
     const auto bufPtr = env->GetDirectBufferAddress(buf);
@@ -288,11 +308,7 @@ extern "C" JNIEXPORT void JNICALL Java_org_kman_srtctest_rtc_PeerConnection_publ
 
     srtc::ByteBuffer bb{ static_cast<uint8_t*>(bufPtr), static_cast<size_t>(bufSize) };
 
-    const auto error = ptr->publishVideoSingleFrame(std::move(bb));
-    if (error.isError()) {
-        srtc::android::JavaError::throwSRtcException(env, error);
-        return;
-    }
+    return ptr->reportPublishError(ptr->publishVideoSingleFrame(std::move(bb)), srtc::MediaType::Video);
 }
 
 extern "C" JNIEXPORT void JNICALL Java_org_kman_srtctest_rtc_PeerConnection_setVideoSimulcastCodecSpecificDataImpl(
@@ -336,18 +352,23 @@ extern "C" JNIEXPORT void JNICALL Java_org_kman_srtctest_rtc_PeerConnection_setV
     }
 }
 
-extern "C" JNIEXPORT void JNICALL Java_org_kman_srtctest_rtc_PeerConnection_publishVideoSimulcastFrameImpl(
+extern "C" JNIEXPORT jint JNICALL Java_org_kman_srtctest_rtc_PeerConnection_publishVideoSimulcastFrameImpl(
     JNIEnv* env, jobject thiz, jlong handle, jobject layer, jobject buf)
 {
+    const srtc::android::AllocScope allocScope(srtc::android::AllocScopeKind::VideoSimulcast);
+
     const auto ptr = reinterpret_cast<srtc::android::JavaPeerConnection*>(handle);
     if (!ptr) {
-        return;
+        return 0;
     }
 
-    const auto layerName = gClassSimulcastLayer.getFieldString(env, layer, "name");
-    if (layerName.empty()) {
-        const srtc::Error error = { srtc::Error::Code::InvalidData, "The layer name is empty" };
+    // A bad layer is a configuration error, so it still throws
+    char layerName[64];
+    if (!gClassSimulcastLayer.getFieldString(env, layer, "name", layerName, sizeof(layerName)) ||
+        layerName[0] == 0) {
+        const srtc::Error error = { srtc::Error::Code::InvalidData, "The layer name is empty or too long" };
         srtc::android::JavaError::throwSRtcException(env, error);
+        return 0;
     }
 
     const auto bufPtr = env->GetDirectBufferAddress(buf);
@@ -355,29 +376,327 @@ extern "C" JNIEXPORT void JNICALL Java_org_kman_srtctest_rtc_PeerConnection_publ
 
     srtc::ByteBuffer bb{ static_cast<uint8_t*>(bufPtr), static_cast<size_t>(bufSize) };
 
-    const auto error = ptr->publishVideoSimulcastFrame(layerName, std::move(bb));
-    if (error.isError()) {
+    return ptr->reportPublishError(ptr->publishVideoSimulcastFrame(layerName, std::move(bb)), srtc::MediaType::Video);
+}
+
+extern "C" JNIEXPORT jint JNICALL Java_org_kman_srtctest_rtc_PeerConnection_publishVideoSingleFrameBorrowedImpl(
+    JNIEnv* env, jobject thiz, jlong handle, jobject buf, jlong token)
+{
+    const srtc::android::AllocScope allocScope(srtc::android::AllocScopeKind::VideoSingle);
+
+    const auto ptr = reinterpret_cast<srtc::android::JavaPeerConnection*>(handle);
+    if (!ptr) {
+        // PUBLISH_NOT_BORROWED, the token is not ours to hand back
+        return -1;
+    }
+
+    const auto bufPtr = env->GetDirectBufferAddress(buf);
+    const auto bufSize = gClassJavaIoByteBuffer.callIntMethod(env, buf, "limit");
+
+    return ptr->reportPublishError(
+        ptr->publishVideoSingleFrameBorrowed(
+            static_cast<const uint8_t*>(bufPtr), static_cast<size_t>(bufSize), static_cast<uint64_t>(token)),
+        srtc::MediaType::Video);
+}
+
+extern "C" JNIEXPORT jint JNICALL Java_org_kman_srtctest_rtc_PeerConnection_publishVideoSimulcastFrameBorrowedImpl(
+    JNIEnv* env, jobject thiz, jlong handle, jobject layer, jobject buf, jlong token)
+{
+    const srtc::android::AllocScope allocScope(srtc::android::AllocScopeKind::VideoSimulcast);
+
+    const auto ptr = reinterpret_cast<srtc::android::JavaPeerConnection*>(handle);
+    if (!ptr) {
+        // PUBLISH_NOT_BORROWED, the token is not ours to hand back
+        return -1;
+    }
+
+    char layerName[64];
+    if (!gClassSimulcastLayer.getFieldString(env, layer, "name", layerName, sizeof(layerName)) ||
+        layerName[0] == 0) {
+        const srtc::Error error = { srtc::Error::Code::InvalidData, "The layer name is empty or too long" };
         srtc::android::JavaError::throwSRtcException(env, error);
+        return 0;
+    }
+
+    const auto bufPtr = env->GetDirectBufferAddress(buf);
+    const auto bufSize = gClassJavaIoByteBuffer.callIntMethod(env, buf, "limit");
+
+    return ptr->reportPublishError(ptr->publishVideoSimulcastFrameBorrowed(layerName,
+                                                                          static_cast<const uint8_t*>(bufPtr),
+                                                                          static_cast<size_t>(bufSize),
+                                                                          static_cast<uint64_t>(token)),
+                                   srtc::MediaType::Video);
+}
+
+extern "C" JNIEXPORT jint JNICALL Java_org_kman_srtctest_rtc_PeerConnection_drainReleasedFramesImpl(JNIEnv* env,
+                                                                                                    jobject thiz,
+                                                                                                    jlong handle,
+                                                                                                    jlongArray array)
+{
+    const auto ptr = reinterpret_cast<srtc::android::JavaPeerConnection*>(handle);
+    if (!ptr) {
+        return 0;
+    }
+
+    uint64_t tokenList[64];
+    const auto maxCount = std::min(sizeof(tokenList) / sizeof(tokenList[0]),
+                                   static_cast<size_t>(env->GetArrayLength(array)));
+    const auto count = ptr->drainReleasedFrames(tokenList, maxCount);
+
+    jlong valueList[64];
+    for (size_t i = 0; i < count; i += 1) {
+        valueList[i] = static_cast<jlong>(tokenList[i]);
+    }
+    env->SetLongArrayRegion(array, 0, static_cast<jsize>(count), valueList);
+
+    return static_cast<jint>(count);
+}
+
+extern "C" JNIEXPORT void JNICALL Java_org_kman_srtctest_rtc_PeerConnection_cancelBorrowedFramesImpl(JNIEnv* env,
+                                                                                                     jobject thiz,
+                                                                                                     jlong handle,
+                                                                                                     jint owner)
+{
+    const auto ptr = reinterpret_cast<srtc::android::JavaPeerConnection*>(handle);
+    if (!ptr) {
         return;
     }
+
+    ptr->cancelBorrowedFrames(static_cast<uint32_t>(owner));
 }
 
-extern "C" JNIEXPORT void JNICALL Java_org_kman_srtctest_rtc_PeerConnection_publishAudioFrameImpl(
+extern "C" JNIEXPORT jint JNICALL Java_org_kman_srtctest_rtc_PeerConnection_publishAudioFrameImpl(
     JNIEnv* env, jobject thiz, jlong handle, jobject buf, jint size, jint sampleRate, jint channels)
+{
+    const srtc::android::AllocScope allocScope(srtc::android::AllocScopeKind::Audio);
+
+    const auto ptr = reinterpret_cast<srtc::android::JavaPeerConnection*>(handle);
+    if (!ptr) {
+        return 0;
+    }
+
+    const auto bufPtr = env->GetDirectBufferAddress(buf);
+    return ptr->reportPublishError(ptr->publishAudioFrame(bufPtr, static_cast<size_t>(size), sampleRate, channels),
+                                   srtc::MediaType::Audio);
+}
+
+extern "C" JNIEXPORT jintArray JNICALL Java_org_kman_srtctest_rtc_PeerConnection_getPublishErrorCountsImpl(
+    JNIEnv* env, jobject thiz, jlong handle)
+{
+    const auto ptr = reinterpret_cast<srtc::android::JavaPeerConnection*>(handle);
+    if (!ptr) {
+        return nullptr;
+    }
+
+    const auto countList = ptr->getPublishErrorCounts();
+
+    jint valueList[srtc::android::JavaPeerConnection::kPublishErrorCodeCount];
+    for (size_t i = 0; i < countList.size(); i += 1) {
+        valueList[i] = static_cast<jint>(countList[i]);
+    }
+
+    const auto arrayJ = env->NewIntArray(static_cast<jsize>(countList.size()));
+    env->SetIntArrayRegion(arrayJ, 0, static_cast<jsize>(countList.size()), valueList);
+    return arrayJ;
+}
+
+extern "C" JNIEXPORT jobject JNICALL Java_org_kman_srtctest_rtc_PeerConnection_getLastPublishErrorImpl(JNIEnv* env,
+                                                                                                       jobject thiz,
+                                                                                                       jlong handle)
+{
+    const auto ptr = reinterpret_cast<srtc::android::JavaPeerConnection*>(handle);
+    if (!ptr) {
+        return nullptr;
+    }
+
+    const auto error = ptr->getLastPublishError();
+    if (error.isOk()) {
+        return nullptr;
+    }
+
+    const auto messageJ = env->NewStringUTF(error.message.c_str());
+    return gClassPublishError.newObject(env, static_cast<jint>(error.code), messageJ);
+}
+
+extern "C" JNIEXPORT jboolean JNICALL Java_org_kman_srtctest_rtc_PeerConnection_checkAllocationBudgetImpl(JNIEnv* env,
+                                                                                                          jclass clazz)
+{
+    if (!srtc::android::isAllocTrackingEnabled()) {
+        return false;
+    }
+
+    if (const auto error = srtc::android::checkAllocBudget(); error.isError()) {
+        srtc::android::JavaError::throwSRtcException(env, error);
+    }
+
+    return true;
+}
+
+extern "C" JNIEXPORT jboolean JNICALL
+Java_org_kman_srtctest_rtc_PeerConnection_isSoftwareVideoEncoderAvailableImpl(JNIEnv* env, jclass clazz)
+{
+    return srtc::android::SoftwareVideoEncoder::isAvailable();
+}
+
+extern "C" JNIEXPORT void JNICALL Java_org_kman_srtctest_rtc_PeerConnection_startSoftwareVideoEncoderImpl(
+    JNIEnv* env, jobject thiz, jlong handle, jobjectArray layerArray, jint threadCount)
 {
     const auto ptr = reinterpret_cast<srtc::android::JavaPeerConnection*>(handle);
     if (!ptr) {
         return;
     }
 
+    std::vector<srtc::android::SoftwareVideoLayer> layerList;
+    for (jsize i = 0; i < env->GetArrayLength(layerArray); i += 1) {
+        const auto layer = env->GetObjectArrayElement(layerArray, i);
+        layerList.push_back({ gClassSimulcastLayer.getFieldString(env, layer, "name"),
+                              static_cast<uint32_t>(gClassSimulcastLayer.getFieldInt(env, layer, "width")),
+                              static_cast<uint32_t>(gClassSimulcastLayer.getFieldInt(env, layer, "height")),
+                              static_cast<uint32_t>(gClassSimulcastLayer.getFieldInt(env, layer, "kilobitPerSecond")),
+                              static_cast<uint32_t>(gClassSimulcastLayer.getFieldInt(env, layer, "framesPerSecond")) });
+        env->DeleteLocalRef(layer);
+    }
+
+    const auto error = ptr->startSoftwareVideoEncoder(layerList, static_cast<uint32_t>(std::max(threadCount, 1)));
+    if (error.isError()) {
+        srtc::android::JavaError::throwSRtcException(env, error);
+    }
+}
+
+extern "C" JNIEXPORT void JNICALL Java_org_kman_srtctest_rtc_PeerConnection_stopSoftwareVideoEncoderImpl(JNIEnv* env,
+                                                                                                        jobject thiz,
+                                                                                                        jlong handle)
+{
+    const auto ptr = reinterpret_cast<srtc::android::JavaPeerConnection*>(handle);
+    if (!ptr) {
+        return;
+    }
+
+    ptr->stopSoftwareVideoEncoder();
+}
+
+extern "C" JNIEXPORT jint JNICALL Java_org_kman_srtctest_rtc_PeerConnection_publishVideoRawFrameImpl(
+    JNIEnv* env, jobject thiz, jlong handle, jobject buf, jint width, jint height, jint stride)
+{
+    const auto ptr = reinterpret_cast<srtc::android::JavaPeerConnection*>(handle);
+    if (!ptr) {
+        return 0;
+    }
+
     const auto bufPtr = env->GetDirectBufferAddress(buf);
-    const auto error = ptr->publishAudioFrame(bufPtr, static_cast<size_t>(size), sampleRate, channels);
+    const auto bufSize = env->GetDirectBufferCapacity(buf);
+    if (bufPtr == nullptr || width <= 0 || height <= 0 || stride < width * 4 ||
+        bufSize < static_cast<jlong>(stride) * (height - 1) + width * 4) {
+        return ptr->recordPublishError(
+            { srtc::Error::Code::InvalidData, "The raw video frame is not a direct buffer of the right size" });
+    }
+
+    // The software encoder's frames are sent like the others, so this is where their send errors come back
+    return ptr->reportPublishError(ptr->publishVideoRawFrame(static_cast<const uint8_t*>(bufPtr),
+                                                             static_cast<size_t>(stride),
+                                                             static_cast<uint32_t>(width),
+                                                             static_cast<uint32_t>(height)),
+                                   srtc::MediaType::Video);
+}
+
+extern "C" JNIEXPORT void JNICALL Java_org_kman_srtctest_rtc_PeerConnection_requestSoftwareVideoKeyFrameImpl(
+    JNIEnv* env, jobject thiz, jlong handle)
+{
+    const auto ptr = reinterpret_cast<srtc::android::JavaPeerConnection*>(handle);
+    if (!ptr) {
+        return;
+    }
+
+    ptr->requestSoftwareVideoKeyFrame();
+}
+
+extern "C" JNIEXPORT void JNICALL Java_org_kman_srtctest_rtc_PeerConnection_setSoftwareVideoLayerSuspendedImpl(
+    JNIEnv* env, jobject thiz, jlong handle, jobject layer, jboolean suspended)
+{
+    const auto ptr = reinterpret_cast<srtc::android::JavaPeerConnection*>(handle);
+    if (!ptr) {
+        return;
+    }
+
+    const auto layerName = gClassSimulcastLayer.getFieldString(env, layer, "name");
+    ptr->setSoftwareVideoLayerSuspended(layerName, suspended);
+}
+
+extern "C" JNIEXPORT void JNICALL Java_org_kman_srtctest_rtc_PeerConnection_setTelemetryPathImpl(JNIEnv* env,
+                                                                                                 jobject thiz,
+                                                                                                 jlong handle,
+                                                                                                 jstring pathJ)
+{
+    const auto ptr = reinterpret_cast<srtc::android::JavaPeerConnection*>(handle);
+    if (!ptr) {
+        return;
+    }
+
+    ptr->setTelemetryPath(pathJ == nullptr ? std::string() : srtc::android::fromJavaString(env, pathJ));
+}
+
+extern "C" JNIEXPORT void JNICALL Java_org_kman_srtctest_rtc_PeerConnection_recordVideoEncodeTimeImpl(JNIEnv* env,
+                                                                                                      jobject thiz,
+                                                                                                      jlong handle,
+                                                                                                      jlong usec)
+{
+    const auto ptr = reinterpret_cast<srtc::android::JavaPeerConnection*>(handle);
+    if (!ptr) {
+        return;
+    }
+
+    ptr->recordVideoEncodeTime(usec);
+}
+
+extern "C" JNIEXPORT void JNICALL Java_org_kman_srtctest_rtc_PeerConnection_setThreadPolicyImpl(
+    JNIEnv* env, jobject thiz, jlong handle, jint role, jlong cpuMask, jint nice, jint rtPriority)
+{
+    const auto ptr = reinterpret_cast<srtc::android::JavaPeerConnection*>(handle);
+    if (!ptr) {
+        return;
+    }
+
+    if (role < 0 || role >= static_cast<jint>(srtc::android::kThreadRoleCount)) {
+        const srtc::Error error = { srtc::Error::Code::InvalidData, "Invalid thread role" };
+        srtc::android::JavaError::throwSRtcException(env, error);
+        return;
+    }
+
+    const srtc::android::ThreadPolicy policy = { static_cast<uint64_t>(cpuMask),
+                                                 static_cast<int>(nice),
+                                                 static_cast<int>(rtPriority) };
+    const auto error = ptr->setThreadPolicy(static_cast<srtc::android::ThreadRole>(role), policy);
     if (error.isError()) {
         srtc::android::JavaError::throwSRtcException(env, error);
         return;
     }
 }
 
+extern "C" JNIEXPORT jobject JNICALL Java_org_kman_srtctest_rtc_PeerConnection_getThreadStatsImpl(JNIEnv* env,
+                                                                                                  jobject thiz,
+                                                                                                  jlong handle)
+{
+    const auto ptr = reinterpret_cast<srtc::android::JavaPeerConnection*>(handle);
+    if (!ptr) {
+        return nullptr;
+    }
+
+    jobject listJ = gClassJavaUtilArrayList.newObject(env);
+
+    for (const auto& stats : ptr->getThreadStats()) {
+        jobject statsJ = gClassThreadStats.newObject(env,
+                                                     static_cast<jint>(stats.role),
+                                                     static_cast<jint>(stats.tid),
+                                                     static_cast<jlong>(stats.cpu_user_ms),
+                                                     static_cast<jlong>(stats.cpu_system_ms),
+                                                     static_cast<jint>(stats.last_cpu));
+        gClassJavaUtilArrayList.callBooleanMethod(env, listJ, "add", statsJ);
+        env->DeleteLocalRef(statsJ);
+    }
+
+    return listJ;
+}
+
 namespace srtc::android
 {
 
@@ -389,8 +708,6 @@ void JavaPeerConnection::initializeJNI(JNIEnv* env)
 
     gClassJavaUtilArrayList.findClass(env, "java/util/ArrayList")
         .findMethod(env, "<init>", "()V")
-        .findMethod(env, "size", "()I")
-        .findMethod(env, "get", "(I)Ljava/lang/Object;")
         .findMethod(env, "add", "(Ljava/lang/Object;)Z");
 
     // SimulcastLayer
@@ -423,61 +740,115 @@ void JavaPeerConnection::initializeJNI(JNIEnv* env)
         .findField(env, "mAudioTrack", "L" SRTC_PACKAGE_NAME "/Track;")
         .findMethod(env, "fromNativeOnConnectionState", "(I)V")
         .findMethod(env, "fromNativeOnKeyFrameRequest", "()V")
+        .findMethod(env, "fromNativeOnLayerKeyFrameRequest", "(Ljava/lang/String;)V")
+        .findMethod(env, "fromNativeOnSimulcastLayerSuspended", "(Ljava/lang/String;Z)V")
+        .findMethod(env, "fromNativeOnBorrowedFramesReleased", "()V")
         .findMethod(env,
                     "fromNativeOnPublishConnectionStats",
                     "(L" SRTC_PACKAGE_NAME "/PeerConnection$PublishConnectionStats;)V");
 
-    // OfferConfig
+    // PubConnectionStats
 
-    gClassOfferConfig.findClass(env, SRTC_PACKAGE_NAME "/PeerConnection$OfferConfig")
-        .findField(env, "cname", "Ljava/lang/String;");
+    gClassPublishConnectionStats.findClass(env, SRTC_PACKAGE_NAME "/PeerConnection$PublishConnectionStats")
+        .findMethod(env, "<init>", "(IIFFFFIIFFIIIIII)V");
 
-    // PubVideoCodecConfig
+    // PublishError
 
-    gClassVideoCodec.findClass(env, SRTC_PACKAGE_NAME "/PeerConnection$PubVideoCodec")
-        .findField(env, "codec", "I")
-        .findField(env, "profileLevelId", "I");
+    gClassPublishError.findClass(env, SRTC_PACKAGE_NAME "/PeerConnection$PublishError")
+        .findMethod(env, "<init>", "(ILjava/lang/String;)V");
 
-    // PubVideoConfig
+    // ThreadStats
 
-    gClassVideoConfig.findClass(env, SRTC_PACKAGE_NAME "/PeerConnection$PubVideoConfig")
-        .findField(env, "codecList", "Ljava/util/ArrayList;")
-        .findField(env, "simulcastLayerList", "Ljava/util/ArrayList;");
+    gClassThreadStats.findClass(env, SRTC_PACKAGE_NAME "/PeerConnection$ThreadStats")
+        .findMethod(env, "<init>", "(IIJJI)V");
 
-    // PubAudioCodecConfig
+    // Logging
 
-    gClassAudioCodec.findClass(env, SRTC_PACKAGE_NAME "/PeerConnection$PubAudioCodec")
-        .findField(env, "codec", "I")
-        .findField(env, "minptime", "I")
-        .findField(env, "stereo", "Z");
+    srtc::setLogLevel(SRTC_LOG_E);
+}
 
-    // PubAudioConfig
+JavaPeerConnection::JavaPeerConnection(jobject thiz)
+    : mThiz(thiz)
+    , mTrackSet(std::make_shared<TrackSet>())
+    , mIsReconnecting(false)
+    , mIsRedOffered(false)
+    , mRedPayloadIds()
+    , mLastPublishError(Error::OK)
+    , mPendingVideoSendError(0)
+    , mPendingAudioSendError(0)
+{
+    for (auto& count : mPublishErrorCountList) {
+        count = 0;
+    }
 
-    gClassAudioConfig.findClass(env, SRTC_PACKAGE_NAME "/PeerConnection$PubAudioConfig")
-        .findField(env, "codecList", "Ljava/util/ArrayList;");
+    // More than the encoders' output buffer count
+    mReleasedFrameList.reserve(64);
 
-    // PubConnectionStats
+    // The actual sending happens here, so this is where most publish errors come from
+    mPacer = std::make_unique<PublishPacer>(
+        [this](const std::shared_ptr<srtc::Track>& track, int64_t pts_usec, ByteBuffer&& frame) {
+            mThreadPolicy.onThread(ThreadRole::Send);
+            const auto conn = getConnection();
+            if (!conn) {
+                return Error::OK;
+            }
+            const auto error = conn->publishVideoFrame(track, pts_usec, std::move(frame));
+            if (const auto code = recordPublishError(error); code != 0) {
+                mPendingVideoSendError = code;
+            }
+            return error;
+        },
+        [this](const std::shared_ptr<srtc::Track>& track, int64_t pts_usec, ByteBuffer&& frame) {
+            mThreadPolicy.onThread(ThreadRole::Send);
+            const auto conn = getConnection();
+            if (!conn) {
+                return Error::OK;
+            }
+            const auto error = conn->publishAudioFrame(track, pts_usec, std::move(frame));
+            if (const auto code = recordPublishError(error); code != 0) {
+                mPendingAudioSendError = code;
+            }
+            return error;
+        },
+        [this](uint64_t token) { onBorrowedFrameReleased(token); },
+        [this](size_t layerIndex) { onPacerKeyFrameRequest(layerIndex); });
 
-    gClassPublishConnectionStats.findClass(env, SRTC_PACKAGE_NAME "/PeerConnection$PublishConnectionStats")
-        .findMethod(env, "<init>", "(IIFFFF)V");
+    mVideoPath = std::make_unique<VideoPublishPath>(*mPacer, mSimulcastPolicy);
+    mAudioPath = std::make_unique<AudioPublishPath>(*mPacer);
 
-    // Logging
+    setConnection(std::make_unique<PeerConnection>(Direction::Publish));
+}
 
-    srtc::setLogLevel(SRTC_LOG_E);
+std::shared_ptr<PeerConnection> JavaPeerConnection::getConnection() const
+{
+    std::lock_guard lock(mConnMutex);
+    return mConn;
 }
 
-JavaPeerConnection::JavaPeerConnection(jobject thiz)
-    : mThiz(thiz)
-    , mConn(std::make_unique<PeerConnection>(Direction::Publish))
-    , mOpusEncoder(nullptr)
-    , mOpusPts(0)
+void JavaPeerConnection::setConnection(std::unique_ptr<PeerConnection>&& conn)
 {
-    mConn->setConnectionStateListener([this](PeerConnection::ConnectionState state) {
+    // Our listeners are called on srtc's network thread
+    conn->setConnectionStateListener([this](PeerConnection::ConnectionState state) {
+        mThreadPolicy.onThread(ThreadRole::Network);
+        if (state == PeerConnection::ConnectionState::Failed || state == PeerConnection::ConnectionState::Closed) {
+            mRecorder.dumpAsync();
+        }
         const auto env = getJNIEnv();
         gClassPeerConnection.callVoidMethod(env, mThiz, "fromNativeOnConnectionState", static_cast<jint>(state));
     });
-    mConn->setPublishConnectionStatsListener([this](const PublishConnectionStats& stats) {
+    conn->setPublishConnectionStatsListener([this](const PublishConnectionStats& stats) {
+        mThreadPolicy.onThread(ThreadRole::Network);
         const auto env = getJNIEnv();
+
+        mPacer->setTargetBitrate(stats.bandwidth_suggested_kbit_per_second);
+        updateSimulcastPolicy(env, stats);
+
+        mAudioPath->updateRedDepth(stats.packets_lost_percent);
+        const auto isRedEnabled = mAudioPath->isRedEnabled();
+
+        const auto pacerStats = mPacer->getStats();
+        mRecorder.addSample(stats, pacerStats, static_cast<uint32_t>(mSimulcastPolicy.getSuspendedCount()));
+
         const auto statsJ =
             gClassPublishConnectionStats.newObject(env,
                                                    static_cast<jint>(stats.packet_count),
@@ -485,41 +856,118 @@ JavaPeerConnection::JavaPeerConnection(jobject thiz)
                                                    static_cast<jfloat>(stats.packets_lost_percent),
                                                    static_cast<jfloat>(stats.rtt_ms),
                                                    static_cast<jfloat>(stats.bandwidth_actual_kbit_per_second),
-                                                   static_cast<jfloat>(stats.bandwidth_suggested_kbit_per_second));
+                                                   static_cast<jfloat>(stats.bandwidth_suggested_kbit_per_second),
+                                                   static_cast<jint>(pacerStats.queue_frames),
+                                                   static_cast<jint>(pacerStats.queue_bytes),
+                                                   static_cast<jfloat>(pacerStats.delay_avg_ms),
+                                                   static_cast<jfloat>(pacerStats.delay_max_ms),
+                                                   static_cast<jint>(pacerStats.dropped_frames),
+                                                   static_cast<jint>(mSimulcastPolicy.getSuspendedCount()),
+                                                   static_cast<jint>(mVideoPath->getDroppedNonReferenceFrames()),
+                                                   static_cast<jint>(mAudioPath->getSuppressedFrames()),
+                                                   static_cast<jint>(mAudioPath->getSuppressedBytes()),
+                                                   static_cast<jint>(isRedEnabled ? mAudioPath->getRedDepth() : -1));
         gClassPeerConnection.callVoidMethod(env, mThiz, "fromNativeOnPublishConnectionStats", statsJ);
     });
-    mConn->setPublishKeyFrameRequestedListener([this]() {
+    conn->setPublishKeyFrameRequestedListener([this]() {
+        mThreadPolicy.onThread(ThreadRole::Network);
+        mRecorder.addKeyFrameRequest();
         const auto env = getJNIEnv();
         gClassPeerConnection.callVoidMethod(env, mThiz, "fromNativeOnKeyFrameRequest");
     });
+
+    // The pacer's thread may still be sending through the old connection, the last reference closes it
+    std::shared_ptr<PeerConnection> oldConn;
+    {
+        std::lock_guard lock(mConnMutex);
+        oldConn = std::move(mConn);
+        mConn = std::move(conn);
+    }
+    closeConnection(std::move(oldConn));
 }
 
 JavaPeerConnection::~JavaPeerConnection()
 {
     LOG(SRTC_LOG_V, "destructor %p", this);
 
-    mConn.reset();
-    free(mOpusEncoder);
+    // The encoder's thread publishes through the pacer, srtc's network thread calls our listeners, which use the
+    // pacer, and the pacer's thread sends through the connection. The pacer goes last, once nothing can call it.
+    stopSoftwareVideoEncoder();
+
+    std::shared_ptr<PeerConnection> conn;
+    {
+        std::lock_guard lock(mConnMutex);
+        conn = std::move(mConn);
+    }
+    closeConnection(std::move(conn));
+
+    mVideoPath.reset();
+    mAudioPath.reset();
+    mPacer.reset();
 
     const auto env = getJNIEnv();
     env->DeleteGlobalRef(mThiz);
 }
 
+void JavaPeerConnection::closeConnection(std::shared_ptr<PeerConnection>&& conn)
+{
+    if (conn) {
+        // So that nothing more comes from its network thread while it's shutting down
+        conn->setConnectionStateListener(nullptr);
+        conn->setPublishConnectionStatsListener(nullptr);
+        conn->setPublishKeyFrameRequestedListener(nullptr);
+        conn.reset();
+    }
+}
+
+void JavaPeerConnection::reconnect()
+{
+    LOG(SRTC_LOG_V, "reconnect %p", this);
+
+    mIsReconnecting = true;
+    mPacer->flush();
+
+    // From the transport that's going away
+    mPendingVideoSendError = 0;
+    mPendingAudioSendError = 0;
+
+    setConnection(std::make_unique<PeerConnection>(Direction::Publish));
+}
+
 Error JavaPeerConnection::setVideoSingleCodecSpecificData(std::vector<srtc::ByteBuffer>&& list)
 {
-    return mConn->setVideoCodecSpecificData(mVideoSingleTrack, std::move(list));
+    // Under the lock, so that initTracks can't apply older data after this
+    std::lock_guard lock(mConnMutex);
+
+    mVideoSingleCodecSpecificData = copyByteBufferList(list);
+    if (mIsReconnecting) {
+        return Error::OK;
+    }
+
+    return mConn->setVideoCodecSpecificData(mTrackSet->videoSingle, std::move(list));
 }
 
 Error JavaPeerConnection::publishVideoSingleFrame(ByteBuffer&& frame)
 {
-    const auto pts_usec = getStableTimeMicros();
-    return mConn->publishVideoFrame(mVideoSingleTrack, pts_usec, std::move(frame));
+    return publishVideoFrame({}, std::move(frame));
+}
+
+Error JavaPeerConnection::publishVideoSingleFrameBorrowed(const uint8_t* data, size_t size, uint64_t token)
+{
+    return publishVideoFrameBorrowed({}, data, size, token);
 }
 
 Error JavaPeerConnection::setVideoSimulcastCodecSpecificData(const std::string& layerName,
                                                              std::vector<srtc::ByteBuffer>&& list)
 {
-    for (const auto& track : mVideoSimulcastTrackList) {
+    std::lock_guard lock(mConnMutex);
+
+    mVideoSimulcastCodecSpecificData[layerName] = copyByteBufferList(list);
+    if (mIsReconnecting) {
+        return Error::OK;
+    }
+
+    for (const auto& track : mTrackSet->videoSimulcastList) {
         if (track->getSimulcastLayer()->name == layerName) {
             return mConn->setVideoCodecSpecificData(track, std::move(list));
         }
@@ -528,98 +976,531 @@ Error JavaPeerConnection::setVideoSimulcastCodecSpecificData(const std::string&
     return { srtc::Error::Code::InvalidData, "Cannot find simulcast video track for setting codec data" };
 }
 
-Error JavaPeerConnection::publishVideoSimulcastFrame(const std::string& layerName, ByteBuffer&& frame)
+Error JavaPeerConnection::publishVideoSimulcastFrame(std::string_view layerName, ByteBuffer&& frame)
 {
-    const auto pts_usec = getStableTimeMicros();
-    for (const auto& track : mVideoSimulcastTrackList) {
-        if (track->getSimulcastLayer()->name == layerName) {
-            return mConn->publishVideoFrame(track, pts_usec, std::move(frame));
-        }
-    }
+    return publishVideoFrame(layerName, std::move(frame));
+}
 
-    return { srtc::Error::Code::InvalidData, "Cannot find simulcast video track for publishing a video frame" };
+Error JavaPeerConnection::publishVideoSimulcastFrameBorrowed(std::string_view layerName,
+                                                             const uint8_t* data,
+                                                             size_t size,
+                                                             uint64_t token)
+{
+    return publishVideoFrameBorrowed(layerName, data, size, token);
 }
 
-Error JavaPeerConnection::publishAudioFrame(const void* frame, size_t size, int sampleRate, int channels)
+size_t JavaPeerConnection::drainReleasedFrames(uint64_t* list, size_t maxCount)
 {
-    // This is thread safe because we have "synchronized" on the Java side
-    if (mOpusEncoder == nullptr) {
-        const auto encoderSize = opus_encoder_get_size(channels);
-        mOpusEncoder = static_cast<OpusEncoder*>(malloc(encoderSize));
-        std::memset(mOpusEncoder, 0, encoderSize);
-
-        if (opus_encoder_init(mOpusEncoder, sampleRate, channels, OPUS_APPLICATION_VOIP) != 0) {
-            free(mOpusEncoder);
-            mOpusEncoder = nullptr;
-        } else {
-            opus_encoder_ctl(mOpusEncoder, OPUS_SET_BITRATE(96 * 1024));
-            opus_encoder_ctl(mOpusEncoder, OPUS_SET_INBAND_FEC(1));
-            opus_encoder_ctl(mOpusEncoder, OPUS_SET_PACKET_LOSS_PERC(20));
-        }
-    }
+    std::lock_guard lock(mReleasedFrameMutex);
 
-    if (mOpusEncoder != nullptr) {
-        ByteBuffer output{ 4000 };
+    const auto count = std::min(maxCount, mReleasedFrameList.size());
+    std::copy(mReleasedFrameList.begin(), mReleasedFrameList.begin() + static_cast<ptrdiff_t>(count), list);
+    mReleasedFrameList.erase(mReleasedFrameList.begin(), mReleasedFrameList.begin() + static_cast<ptrdiff_t>(count));
 
-        const auto now = srtc::getStableTimeMicros();
-        if (mOpusPts == 0 || now - mOpusPts > 100 * 1000) {
-            mOpusPts = now;
-        }
+    return count;
+}
 
-        // Number of samples
-        const auto frame_size = static_cast<int>(size / sizeof(opus_int16) / channels);
-        const auto frame_micros = static_cast<int>(frame_size * 1000l * 1000l / sampleRate);
+void JavaPeerConnection::cancelBorrowedFrames(uint32_t owner)
+{
+    const auto isOwned = [owner](uint64_t token) { return static_cast<uint32_t>(token >> 32) == owner; };
 
-        const auto pts_usec = mOpusPts;
-        mOpusPts += frame_micros;
+    mPacer->cancelBorrowed(isOwned);
 
-        const auto encodedSize = opus_encode(mOpusEncoder,
-                                             static_cast<const opus_int16*>(frame),
-                                             frame_size,
-                                             output.data(),
-                                             static_cast<opus_int32>(output.capacity()));
+    std::lock_guard lock(mReleasedFrameMutex);
+    mReleasedFrameList.erase(std::remove_if(mReleasedFrameList.begin(), mReleasedFrameList.end(), isOwned),
+                             mReleasedFrameList.end());
+}
 
-        if (encodedSize > 0) {
-            output.resize(static_cast<size_t>(encodedSize));
-            return mConn->publishAudioFrame(mAudioTrack, pts_usec, std::move(output));
-        }
+Error JavaPeerConnection::publishAudioFrame(const void* frame, size_t size, int sampleRate, int channels)
+{
+    mThreadPolicy.onThread(ThreadRole::Audio);
+
+    // This is thread safe because we have "synchronized" on the Java side
+    const auto error =
+        mAudioPath->publish(getTrackSet()->audio, frame, size, sampleRate, channels, mIsReconnecting.load());
+    mRecorder.addAudioLevel(mAudioPath->getLevelDb());
+
+    return error;
+}
+
+std::string JavaPeerConnection::editOffer(std::string&& offer, bool enableRed)
+{
+    // A new negotiation, the audio thread goes back to plain Opus until the answer says otherwise
+    mAudioPath->setRedPayloadId(-1);
+    mIsRedOffered = enableRed && addRedToOffer(offer, mRedPayloadIds);
+
+    LOG(SRTC_LOG_V, "RED offered: %d", mIsRedOffered);
+    return std::move(offer);
+}
+
+std::string JavaPeerConnection::editAnswer(std::string&& answer)
+{
+    if (mIsRedOffered && rewriteAnswerForRed(answer, mRedPayloadIds)) {
+        LOG(SRTC_LOG_V, "RED accepted, payload %d carrying Opus %d", mRedPayloadIds.red, mRedPayloadIds.opus);
+        mAudioPath->setRedPayloadId(mRedPayloadIds.opus);
     }
 
-    return Error::OK;
+    return std::move(answer);
 }
 
 void JavaPeerConnection::initTracks(const std::shared_ptr<srtc::SdpAnswer>& answer)
 {
-    mVideoSimulcastTrackList.clear();
-    mVideoSingleTrack.reset();
-    mAudioTrack.reset();
+    auto trackSet = std::make_shared<TrackSet>();
 
     for (const auto& track : answer->getTrackList()) {
         const auto type = track->getMediaType();
         if (type == srtc::MediaType::Video) {
             if (track->isSimulcast()) {
-                mVideoSimulcastTrackList.push_back(track);
+                trackSet->videoSimulcastList.push_back(track);
             } else {
-                mVideoSingleTrack = track;
+                trackSet->videoSingle = track;
             }
         } else if (type == srtc::MediaType::Audio) {
-            mAudioTrack = track;
+            trackSet->audio = track;
+        }
+    }
+
+    // The pacer treats the lowest bitrate layer as the most important one
+    std::stable_sort(trackSet->videoSimulcastList.begin(),
+                     trackSet->videoSimulcastList.end(),
+                     [](const std::shared_ptr<srtc::Track>& a, const std::shared_ptr<srtc::Track>& b) {
+                         return a->getSimulcastLayer()->kilobits_per_second <
+                                b->getSimulcastLayer()->kilobits_per_second;
+                     });
+
+    std::vector<uint32_t> layerBitrateList;
+    for (const auto& track : trackSet->videoSimulcastList) {
+        layerBitrateList.push_back(track->getSimulcastLayer()->kilobits_per_second);
+    }
+
+    std::shared_ptr<const TrackSet> oldTrackSet;
+    {
+        std::lock_guard lock(mConnMutex);
+        oldTrackSet = std::move(mTrackSet);
+        mTrackSet = trackSet;
+
+        if (mIsReconnecting) {
+            // The new tracks need the codec data we already have
+            if (trackSet->videoSingle && !mVideoSingleCodecSpecificData.empty()) {
+                (void)mConn->setVideoCodecSpecificData(trackSet->videoSingle,
+                                                       copyByteBufferList(mVideoSingleCodecSpecificData));
+            }
+            for (const auto& track : trackSet->videoSimulcastList) {
+                const auto iter = mVideoSimulcastCodecSpecificData.find(track->getSimulcastLayer()->name);
+                if (iter != mVideoSimulcastCodecSpecificData.end()) {
+                    (void)mConn->setVideoCodecSpecificData(track, copyByteBufferList(iter->second));
+                }
+            }
+        }
+    }
+
+    // The policy starts over with every layer active, so encoders paused for the old connection have to be resumed
+    std::vector<std::string> resumedLayerNameList;
+    for (size_t i = 0; i < oldTrackSet->videoSimulcastList.size(); i += 1) {
+        if (mSimulcastPolicy.isSuspended(i)) {
+            resumedLayerNameList.push_back(oldTrackSet->videoSimulcastList[i]->getSimulcastLayer()->name);
+        }
+    }
+
+    mPacer->flush();
+    for (size_t i = 0; i < layerBitrateList.size(); i += 1) {
+        mPacer->setLayerBitrate(i, layerBitrateList[i]);
+    }
+
+    mSimulcastPolicy.setLayerList(layerBitrateList);
+
+    if (!resumedLayerNameList.empty()) {
+        const auto env = getJNIEnv();
+        for (const auto& layerName : resumedLayerNameList) {
+            notifySimulcastLayerSuspended(env, layerName, false);
+        }
+    }
+
+    if (mIsReconnecting) {
+        // And a key frame before anything else
+        for (size_t i = 0; i < PublishPacer::kMaxLayerCount; i += 1) {
+            mPacer->resetLayer(i);
+        }
+
+        mIsReconnecting = false;
+    }
+}
+
+Error JavaPeerConnection::findVideoTarget(std::string_view layerName,
+                                          const uint8_t* data,
+                                          size_t size,
+                                          VideoPublishPath::Target& target)
+{
+    target = {};
+    if (mIsReconnecting) {
+        return Error::OK;
+    }
+
+    return mVideoPath->findTarget(*getTrackSet(), layerName, data, size, target);
+}
+
+Error JavaPeerConnection::publishVideoFrame(std::string_view layerName, ByteBuffer&& frame)
+{
+    if (mIsReconnecting) {
+        return Error::OK;
+    }
+
+    return mVideoPath->publish(*getTrackSet(), layerName, std::move(frame));
+}
+
+Error JavaPeerConnection::publishVideoFrameBorrowed(std::string_view layerName,
+                                                    const uint8_t* data,
+                                                    size_t size,
+                                                    uint64_t token)
+{
+    bool isKept = false;
+    auto error = Error::OK;
+    if (!mIsReconnecting) {
+        error = mVideoPath->publishBorrowed(*getTrackSet(), layerName, data, size, token, isKept);
+    }
+
+    if (!isKept) {
+        // Not kept, so the buffer can go back right away
+        onBorrowedFrameReleased(token);
+    }
+    return error;
+}
+
+void JavaPeerConnection::onBorrowedFrameReleased(uint64_t token)
+{
+    bool wasEmpty;
+    {
+        std::lock_guard lock(mReleasedFrameMutex);
+        wasEmpty = mReleasedFrameList.empty();
+        mReleasedFrameList.push_back(token);
+    }
+
+    // Java drains everything there is, so it only needs to hear about the first one
+    if (wasEmpty) {
+        const auto env = getJNIEnv();
+        gClassPeerConnection.callVoidMethod(env, mThiz, "fromNativeOnBorrowedFramesReleased");
+    }
+}
+
+void JavaPeerConnection::onPacerKeyFrameRequest(size_t layerIndex)
+{
+    const auto trackSet = getTrackSet();
+
+    std::string layerName;
+    if (!trackSet->videoSimulcastList.empty()) {
+        if (layerIndex >= trackSet->videoSimulcastList.size() || mSimulcastPolicy.isSuspended(layerIndex)) {
+            // Resuming a layer asks for a key frame anyway
+            return;
+        }
+        layerName = trackSet->videoSimulcastList[layerIndex]->getSimulcastLayer()->name;
+    } else if (!trackSet->videoSingle || layerIndex != 0) {
+        return;
+    }
+
+    {
+        std::lock_guard lock(mSoftwareVideoMutex);
+        if (mSoftwareVideoEncoder) {
+            for (size_t i = 0; i < mSoftwareVideoLayerNameList.size(); i += 1) {
+                if (mSoftwareVideoLayerNameList[i] == layerName) {
+                    mSoftwareVideoEncoder->requestKeyFrame(i);
+                }
+            }
+            return;
         }
     }
+
+    // The layer's MediaCodec encoder, a null name is the single video track
+    const auto env = getJNIEnv();
+    const auto nameJ = layerName.empty() ? nullptr : env->NewStringUTF(layerName.c_str());
+    gClassPeerConnection.callVoidMethod(env, mThiz, "fromNativeOnLayerKeyFrameRequest", nameJ);
+    if (nameJ != nullptr) {
+        env->DeleteLocalRef(nameJ);
+    }
+}
+
+int JavaPeerConnection::recordPublishError(const Error& error)
+{
+    if (error.isOk()) {
+        return 0;
+    }
+
+    const auto code = static_cast<size_t>(error.code);
+    mPublishErrorCountList[std::min(code, kPublishErrorCodeCount - 1)] += 1;
+
+    {
+        std::lock_guard lock(mLastPublishErrorMutex);
+        mLastPublishError = error;
+    }
+
+    return static_cast<int>(code);
+}
+
+std::array<uint32_t, JavaPeerConnection::kPublishErrorCodeCount> JavaPeerConnection::getPublishErrorCounts() const
+{
+    std::array<uint32_t, kPublishErrorCodeCount> countList = {};
+    for (size_t i = 0; i < kPublishErrorCodeCount; i += 1) {
+        countList[i] = mPublishErrorCountList[i].load();
+    }
+    return countList;
+}
+
+int JavaPeerConnection::reportPublishError(const Error& error, srtc::MediaType mediaType)
+{
+    if (const auto code = recordPublishError(error); code != 0) {
+        return code;
+    }
+
+    // Already counted when it happened
+    auto& pending = mediaType == srtc::MediaType::Video ? mPendingVideoSendError : mPendingAudioSendError;
+    if (pending.load(std::memory_order_relaxed) == 0) {
+        return 0;
+    }
+    return pending.exchange(0);
+}
+
+Error JavaPeerConnection::getLastPublishError() const
+{
+    std::lock_guard lock(mLastPublishErrorMutex);
+    return mLastPublishError;
+}
+
+void JavaPeerConnection::setTelemetryPath(const std::string& path)
+{
+    mRecorder.setPath(path);
+}
+
+void JavaPeerConnection::recordVideoEncodeTime(int64_t usec)
+{
+    mRecorder.addEncodeTime(usec);
+}
+
+Error JavaPeerConnection::startSoftwareVideoEncoder(const std::vector<SoftwareVideoLayer>& layerList,
+                                                    uint32_t threadCount)
+{
+    stopSoftwareVideoEncoder();
+
+    // OpenH264 is all we have, tracks with another codec can't take its frames
+    const auto trackSet = getTrackSet();
+    const auto isH264 = [](const std::shared_ptr<srtc::Track>& track) {
+        return track->getCodec() == srtc::Codec::H264;
+    };
+    if ((trackSet->videoSingle && !isH264(trackSet->videoSingle)) ||
+        !std::all_of(trackSet->videoSimulcastList.begin(), trackSet->videoSimulcastList.end(), isH264)) {
+        return { srtc::Error::Code::InvalidData, "The software video encoder needs H.264 video tracks" };
+    }
+
+    std::unique_ptr<SoftwareVideoEncoder> encoder;
+    const auto error = SoftwareVideoEncoder::create(
+        layerList,
+        threadCount,
+        [this](size_t layerIndex, const uint8_t* data, size_t size, bool isKeyFrame) {
+            onSoftwareVideoFrame(layerIndex, data, size, isKeyFrame);
+        },
+        [this] { mThreadPolicy.onThread(ThreadRole::Encode); },
+        encoder);
+    if (error.isError()) {
+        return error;
+    }
+
+    std::lock_guard lock(mSoftwareVideoMutex);
+
+    mSoftwareVideoLayerNameList.clear();
+    for (const auto& layer : layerList) {
+        mSoftwareVideoLayerNameList.push_back(layer.name);
+    }
+    mSoftwareVideoCodecDataList.assign(layerList.size(), {});
+    mSoftwareVideoEncoder = std::move(encoder);
+
+    return Error::OK;
+}
+
+void JavaPeerConnection::stopSoftwareVideoEncoder()
+{
+    std::shared_ptr<SoftwareVideoEncoder> encoder;
+    {
+        std::lock_guard lock(mSoftwareVideoMutex);
+        encoder = std::move(mSoftwareVideoEncoder);
+
+        // Frames it still makes are dropped
+        mSoftwareVideoLayerNameList.clear();
+    }
+
+    // Joins the encoder's thread, which takes the mutex to publish. If publishVideoRawFrame still has a reference,
+    // that happens when it's done.
+    encoder.reset();
+}
+
+Error JavaPeerConnection::publishVideoRawFrame(const uint8_t* rgba, size_t stride, uint32_t width, uint32_t height)
+{
+    std::shared_ptr<SoftwareVideoEncoder> encoder;
+    {
+        std::lock_guard lock(mSoftwareVideoMutex);
+        encoder = mSoftwareVideoEncoder;
+    }
+
+    if (!encoder) {
+        return { srtc::Error::Code::InvalidData, "The software video encoder is not running" };
+    }
+
+    return encoder->submit(rgba, stride, width, height, getStableTimeMicros());
+}
+
+void JavaPeerConnection::requestSoftwareVideoKeyFrame()
+{
+    std::lock_guard lock(mSoftwareVideoMutex);
+
+    if (mSoftwareVideoEncoder) {
+        mSoftwareVideoEncoder->requestKeyFrame();
+    }
+}
+
+void JavaPeerConnection::setSoftwareVideoLayerSuspended(std::string_view layerName, bool suspended)
+{
+    std::lock_guard lock(mSoftwareVideoMutex);
+
+    if (mSoftwareVideoEncoder) {
+        for (size_t i = 0; i < mSoftwareVideoLayerNameList.size(); i += 1) {
+            if (mSoftwareVideoLayerNameList[i] == layerName) {
+                mSoftwareVideoEncoder->setSuspended(i, suspended);
+            }
+        }
+    }
+}
+
+void JavaPeerConnection::onSoftwareVideoFrame(size_t layerIndex, const uint8_t* data, size_t size, bool isKeyFrame)
+{
+    static constexpr uint8_t kStartCode[] = { 0, 0, 0, 1 };
+
+    std::lock_guard lock(mSoftwareVideoMutex);
+
+    if (layerIndex >= mSoftwareVideoLayerNameList.size()) {
+        return;
+    }
+    const auto& layerName = mSoftwareVideoLayerNameList[layerIndex];
+
+    VideoPublishPath::Target target;
+    if (const auto error = findVideoTarget(layerName, data, size, target); error.isError() || !target.track) {
+        recordPublishError(error);
+        return;
+    }
+    if (target.track->getCodec() != srtc::Codec::H264) {
+        // The tracks came from an answer after the encoder was started
+        recordPublishError({ srtc::Error::Code::InvalidData, "The software video encoder needs H.264 video tracks" });
+        return;
+    }
+
+    const auto pts_usec = getStableTimeMicros();
+    if (!isKeyFrame) {
+        mPacer->enqueueVideo(target.track, target.layerIndex, pts_usec, ByteBuffer(data, size), target.isKeyFrame);
+        return;
+    }
+
+    // Key frames start with the SPS and PPS, which go to srtc as codec data, the same as MediaCodec's csd buffers
+    ByteBuffer frame(size);
+    auto& codecData = mSoftwareVideoCodecData;
+    codecData.clear();
+
+    NaluScanner scanner(data, size);
+    while (scanner.next()) {
+        if (scanner.size() == 0) {
+            continue;
+        }
+
+        const auto type = scanner.data()[0] & 0x1F;
+        if (type == 7 || type == 8) {
+            codecData.insert(codecData.end(), std::begin(kStartCode), std::end(kStartCode));
+            codecData.insert(codecData.end(), scanner.data(), scanner.data() + scanner.size());
+        } else {
+            frame.append(kStartCode, sizeof(kStartCode));
+            frame.append(scanner.data(), scanner.size());
+        }
+    }
+
+    // Usually the same as last time, then there's nothing to do
+    if (!codecData.empty() && codecData != mSoftwareVideoCodecDataList[layerIndex]) {
+        mSoftwareVideoCodecDataList[layerIndex] = codecData;
+
+        std::vector<ByteBuffer> codecDataList;
+        NaluScanner codecDataScanner(codecData.data(), codecData.size());
+        while (codecDataScanner.next()) {
+            ByteBuffer item(sizeof(kStartCode) + codecDataScanner.size());
+            item.append(kStartCode, sizeof(kStartCode));
+            item.append(codecDataScanner.data(), codecDataScanner.size());
+            codecDataList.push_back(std::move(item));
+        }
+
+        const auto error = layerName.empty()
+                               ? setVideoSingleCodecSpecificData(std::move(codecDataList))
+                               : setVideoSimulcastCodecSpecificData(layerName, std::move(codecDataList));
+        if (error.isError()) {
+            LOG(SRTC_LOG_E, "Error setting codec data for layer %zu: %s", layerIndex, error.message.c_str());
+        }
+    }
+
+    if (!frame.empty()) {
+        mPacer->enqueueVideo(target.track, target.layerIndex, pts_usec, std::move(frame), target.isKeyFrame);
+    }
+}
+
+Error JavaPeerConnection::setThreadPolicy(ThreadRole role, const ThreadPolicy& policy)
+{
+    return mThreadPolicy.setPolicy(role, policy);
+}
+
+std::vector<ThreadPolicyRegistry::ThreadStats> JavaPeerConnection::getThreadStats() const
+{
+    return mThreadPolicy.getStats();
+}
+
+void JavaPeerConnection::updateSimulcastPolicy(JNIEnv* env, const PublishConnectionStats& stats)
+{
+    const auto changeList =
+        mSimulcastPolicy.update(stats.bandwidth_suggested_kbit_per_second, srtc::getStableTimeMicros());
+    const auto trackSet = getTrackSet();
+
+    for (const auto& change : changeList) {
+        if (change.layerIndex >= trackSet->videoSimulcastList.size()) {
+            continue;
+        }
+
+        if (change.suspended) {
+            mPacer->resetLayer(change.layerIndex);
+        }
+
+        const auto& layer = trackSet->videoSimulcastList[change.layerIndex]->getSimulcastLayer();
+        notifySimulcastLayerSuspended(env, layer->name, change.suspended);
+    }
+}
+
+void JavaPeerConnection::notifySimulcastLayerSuspended(JNIEnv* env, const std::string& layerName, bool suspended)
+{
+    const auto nameJ = env->NewStringUTF(layerName.c_str());
+    gClassPeerConnection.callVoidMethod(env,
+                                        mThiz,
+                                        "fromNativeOnSimulcastLayerSuspended",
+                                        nameJ,
+                                        static_cast<jboolean>(suspended));
+    env->DeleteLocalRef(nameJ);
 }
 
 std::shared_ptr<srtc::Track> JavaPeerConnection::getVideoSingleTrack() const
 {
-    return mVideoSingleTrack;
+    return getTrackSet()->videoSingle;
 }
 
 std::vector<std::shared_ptr<srtc::Track>> JavaPeerConnection::getVideoSimulcastTrackList() const
 {
-    return mVideoSimulcastTrackList;
+    return getTrackSet()->videoSimulcastList;
 }
 
 std::shared_ptr<srtc::Track> JavaPeerConnection::getAudioTrack() const
 {
-    return mAudioTrack;
+    return getTrackSet()->audio;
+}
+
+std::shared_ptr<const JavaPeerConnection::TrackSet> JavaPeerConnection::getTrackSet() const
+{
+    std::lock_guard lock(mConnMutex);
+    return mTrackSet;
 }
 } // namespace srtc::android
@@ -3,9 +3,21 @@
 #include "srtc/peer_connection.h"
 #include <memory>
 
-#include <jni.h>
+#include "audio_red.h"
+#include "publish_pacer.h"
+#include "publish_path.h"
+#include "session_recorder.h"
+#include "simulcast_policy.h"
+#include "software_video_encoder.h"
+#include "thread_policy.h"
+
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
 
-struct OpusEncoder;
+#include <jni.h>
 
 namespace srtc
 {
@@ -28,25 +40,127 @@ public:
     [[nodiscard]] Error publishVideoSingleFrame(ByteBuffer&& frame);
     [[nodiscard]] Error setVideoSimulcastCodecSpecificData(const std::string& layerName,
                                                            std::vector<srtc::ByteBuffer>&& list);
-    [[nodiscard]] Error publishVideoSimulcastFrame(const std::string& layerName, ByteBuffer&& frame);
+    [[nodiscard]] Error publishVideoSimulcastFrame(std::string_view layerName, ByteBuffer&& frame);
     [[nodiscard]] Error publishAudioFrame(const void* frame, size_t size, int sampleRate, int channels);
 
-    std::unique_ptr<PeerConnection> mConn;
+    // Borrowed frames stay in the encoder's output buffer until their token comes back from drainReleasedFrames,
+    // including frames that get dropped. The top 32 bits of a token identify its owner.
+    [[nodiscard]] Error publishVideoSingleFrameBorrowed(const uint8_t* data, size_t size, uint64_t token);
+    [[nodiscard]] Error publishVideoSimulcastFrameBorrowed(std::string_view layerName,
+                                                           const uint8_t* data,
+                                                           size_t size,
+                                                           uint64_t token);
+    size_t drainReleasedFrames(uint64_t* list, size_t maxCount);
+
+    // The owner's buffers are about to become invalid, its queued frames are dropped without being released
+    void cancelBorrowedFrames(uint32_t owner);
+
+    // OpenH264 instead of MediaCodec (see software_video_encoder.h). An empty layer name is the single video track.
+    // The encoded frames take the same path as the ones from MediaCodec.
+    [[nodiscard]] Error startSoftwareVideoEncoder(const std::vector<SoftwareVideoLayer>& layerList,
+                                                  uint32_t threadCount);
+    void stopSoftwareVideoEncoder();
+    [[nodiscard]] Error publishVideoRawFrame(const uint8_t* rgba, size_t stride, uint32_t width, uint32_t height);
+    void requestSoftwareVideoKeyFrame();
+    void setSoftwareVideoLayerSuspended(std::string_view layerName, bool suspended);
+
+    // The connection can be replaced by reconnect, other threads work with their own reference
+    [[nodiscard]] std::shared_ptr<PeerConnection> getConnection() const;
+
+    // Replaces the connection with one prepared ahead of time
+    void setConnection(std::unique_ptr<PeerConnection>&& conn);
+
+    // Starts over with a new transport, keeping the tracks' encoder state. Frames are dropped until the new answer
+    // has been set.
+    void reconnect();
+
+    // For RED (see audio_red.h), which srtc doesn't know about
+    [[nodiscard]] std::string editOffer(std::string&& offer, bool enableRed);
+    [[nodiscard]] std::string editAnswer(std::string&& answer);
+
+    // Publish errors are returned as status codes rather than thrown, these keep track of them
+    static constexpr size_t kPublishErrorCodeCount = 32;
+
+    int recordPublishError(const Error& error);
+
+    // For the publish calls, whose own errors only cover queueing the frame. When there is none, this returns the
+    // last send error from the pacer's thread not reported yet, so it reaches the caller on its next call.
+    int reportPublishError(const Error& error, srtc::MediaType mediaType);
+    [[nodiscard]] std::array<uint32_t, kPublishErrorCodeCount> getPublishErrorCounts() const;
+    [[nodiscard]] Error getLastPublishError() const;
+
+    // Telemetry, see session_recorder.h
+    void setTelemetryPath(const std::string& path);
+    void recordVideoEncodeTime(int64_t usec);
+
+    [[nodiscard]] Error setThreadPolicy(ThreadRole role, const ThreadPolicy& policy);
+    [[nodiscard]] std::vector<ThreadPolicyRegistry::ThreadStats> getThreadStats() const;
 
     void initTracks(const std::shared_ptr<srtc::SdpAnswer>& answer);
+    void updateSimulcastPolicy(JNIEnv* env, const PublishConnectionStats& stats);
+    void notifySimulcastLayerSuspended(JNIEnv* env, const std::string& layerName, bool suspended);
 
     [[nodiscard]] std::shared_ptr<srtc::Track> getVideoSingleTrack() const;
     [[nodiscard]] std::vector<std::shared_ptr<srtc::Track>> getVideoSimulcastTrackList() const;
     [[nodiscard]] std::shared_ptr<srtc::Track> getAudioTrack() const;
 
 private:
+    using TrackSet = PublishTrackSet;
+
+    [[nodiscard]] std::shared_ptr<const TrackSet> getTrackSet() const;
+
+    [[nodiscard]] Error findVideoTarget(std::string_view layerName,
+                                        const uint8_t* data,
+                                        size_t size,
+                                        VideoPublishPath::Target& target);
+    [[nodiscard]] Error publishVideoFrame(std::string_view layerName, ByteBuffer&& frame);
+    [[nodiscard]] Error publishVideoFrameBorrowed(std::string_view layerName,
+                                                  const uint8_t* data,
+                                                  size_t size,
+                                                  uint64_t token);
+    void onBorrowedFrameReleased(uint64_t token);
+    void onPacerKeyFrameRequest(size_t layerIndex);
+    static void closeConnection(std::shared_ptr<PeerConnection>&& conn);
+    void onSoftwareVideoFrame(size_t layerIndex, const uint8_t* data, size_t size, bool isKeyFrame);
+
     jobject mThiz;
-    OpusEncoder* mOpusEncoder;
-    int64_t mOpusPts;
 
-    std::shared_ptr<srtc::Track> mVideoSingleTrack;
-    std::vector<std::shared_ptr<srtc::Track>> mVideoSimulcastTrackList;
-    std::shared_ptr<srtc::Track> mAudioTrack;
+    // Guards the connection, the tracks and the codec data
+    mutable std::mutex mConnMutex;
+    std::shared_ptr<PeerConnection> mConn;
+    std::shared_ptr<const TrackSet> mTrackSet;
+    std::atomic<bool> mIsReconnecting;
+    ThreadPolicyRegistry mThreadPolicy;
+    std::unique_ptr<PublishPacer> mPacer;
+    SimulcastPolicy mSimulcastPolicy;
+    std::unique_ptr<VideoPublishPath> mVideoPath;
+    std::unique_ptr<AudioPublishPath> mAudioPath;
+    std::mutex mReleasedFrameMutex;
+    std::vector<uint64_t> mReleasedFrameList;
+
+    // The software encoder publishes from its own thread while Java starts and stops it. Submitting a frame copies
+    // it, which is done with a reference taken under the lock rather than holding it.
+    std::mutex mSoftwareVideoMutex;
+    std::shared_ptr<SoftwareVideoEncoder> mSoftwareVideoEncoder;
+    std::vector<std::string> mSoftwareVideoLayerNameList;
+    std::vector<std::vector<uint8_t>> mSoftwareVideoCodecDataList;
+    std::vector<uint8_t> mSoftwareVideoCodecData;
+
+    // RED, applied by the audio path once the answer accepts it
+    bool mIsRedOffered;
+    RedPayloadIds mRedPayloadIds;
+
+    SessionRecorder mRecorder;
+
+    std::array<std::atomic<uint32_t>, kPublishErrorCodeCount> mPublishErrorCountList;
+    mutable std::mutex mLastPublishErrorMutex;
+    Error mLastPublishError;
+    std::atomic<int> mPendingVideoSendError;
+    std::atomic<int> mPendingAudioSendError;
+
+    // Re-applied to the new tracks after a reconnect
+    std::vector<ByteBuffer> mVideoSingleCodecSpecificData;
+    std::unordered_map<std::string, std::vector<ByteBuffer>> mVideoSimulcastCodecSpecificData;
 };
 
 } // namespace srtc::android
@@ -0,0 +1,212 @@
+#include "media_util.h"
+
+namespace
+{
+
+bool isH264KeyFrame(const uint8_t* data, size_t size)
+{
+    srtc::android::NaluScanner scanner(data, size);
+    while (scanner.next()) {
+        if (scanner.size() > 0) {
+            const auto type = scanner.data()[0] & 0x1F;
+            if (type == 5) {
+                // IDR slice
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+bool isH265KeyFrame(const uint8_t* data, size_t size)
+{
+    srtc::android::NaluScanner scanner(data, size);
+    while (scanner.next()) {
+        if (scanner.size() > 0) {
+            const auto type = (scanner.data()[0] >> 1) & 0x3F;
+            if (type >= 16 && type <= 21) {
+                // BLA, IDR, CRA
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+bool isH264NonReferenceFrame(const uint8_t* data, size_t size)
+{
+    auto sliceCount = 0;
+
+    srtc::android::NaluScanner scanner(data, size);
+    while (scanner.next()) {
+        if (scanner.size() > 0) {
+            const auto header = scanner.data()[0];
+            const auto type = header & 0x1F;
+            if (type >= 1 && type <= 5) {
+                // A slice, check nal_ref_idc
+                if ((header >> 5) & 0x03) {
+                    return false;
+                }
+                sliceCount += 1;
+            }
+        }
+    }
+
+    return sliceCount > 0;
+}
+
+bool isH265NonReferenceFrame(const uint8_t* data, size_t size)
+{
+    auto sliceCount = 0;
+
+    srtc::android::NaluScanner scanner(data, size);
+    while (scanner.next()) {
+        if (scanner.size() > 0) {
+            const auto type = (scanner.data()[0] >> 1) & 0x3F;
+            if (type <= 31) {
+                // A slice, the even types below 16 are the sub-layer non-reference ones
+                if (type >= 16 || (type & 0x01) != 0) {
+                    return false;
+                }
+                sliceCount += 1;
+            }
+        }
+    }
+
+    return sliceCount > 0;
+}
+
+bool isVP8KeyFrame(const uint8_t* data, size_t size)
+{
+    // RFC 6386 section 9.1, the frame tag's first bit is zero for key frames
+    return size > 0 && (data[0] & 0x01) == 0;
+}
+
+bool isVP9KeyFrame(const uint8_t* data, size_t size)
+{
+    if (size == 0) {
+        return false;
+    }
+
+    // VP9 bitstream spec, section 6.2, uncompressed header
+    const auto header = data[0];
+    if ((header >> 6) != 0x02) {
+        // Bad frame marker
+        return false;
+    }
+
+    const auto profile = ((header >> 5) & 0x01) | (((header >> 4) & 0x01) << 1);
+    auto bit = profile == 3 ? 2 : 3;
+
+    const auto showExistingFrame = (header >> bit) & 0x01;
+    if (showExistingFrame) {
+        return false;
+    }
+
+    bit -= 1;
+    const auto frameType = (header >> bit) & 0x01;
+    return frameType == 0;
+}
+
+} // namespace
+
+namespace srtc::android
+{
+
+NaluScanner::NaluScanner(const uint8_t* data, size_t size)
+    : mData(data)
+    , mSize(size)
+    , mNextPos(0)
+    , mNaluData(nullptr)
+    , mNaluSize(0)
+{
+    size_t startCodeSize = 0;
+    const auto pos = findStartCode(0, startCodeSize);
+    mNextPos = pos < mSize ? pos + startCodeSize : mSize;
+}
+
+bool NaluScanner::next()
+{
+    if (mNextPos >= mSize) {
+        return false;
+    }
+
+    size_t startCodeSize = 0;
+    const auto end = findStartCode(mNextPos, startCodeSize);
+
+    mNaluData = mData + mNextPos;
+    mNaluSize = end - mNextPos;
+
+    mNextPos = end < mSize ? end + startCodeSize : mSize;
+
+    return true;
+}
+
+const uint8_t* NaluScanner::data() const
+{
+    return mNaluData;
+}
+
+size_t NaluScanner::size() const
+{
+    return mNaluSize;
+}
+
+size_t NaluScanner::findStartCode(size_t from, size_t& startCodeSize) const
+{
+    for (size_t i = from; i + 2 < mSize; i += 1) {
+        if (mData[i] == 0 && mData[i + 1] == 0) {
+            if (mData[i + 2] == 1) {
+                startCodeSize = 3;
+                return i;
+            }
+            if (i + 3 < mSize && mData[i + 2] == 0 && mData[i + 3] == 1) {
+                startCodeSize = 4;
+                return i;
+            }
+        }
+    }
+
+    startCodeSize = 0;
+    return mSize;
+}
+
+bool isVideoKeyFrame(srtc::Codec codec, const uint8_t* data, size_t size)
+{
+    if (data == nullptr) {
+        return false;
+    }
+
+    switch (codec) {
+    case srtc::Codec::H264:
+        return isH264KeyFrame(data, size);
+    case srtc::Codec::H265:
+        return isH265KeyFrame(data, size);
+    case srtc::Codec::VP8:
+        return isVP8KeyFrame(data, size);
+    case srtc::Codec::VP9:
+        return isVP9KeyFrame(data, size);
+    default:
+        return false;
+    }
+}
+
+bool isVideoNonReferenceFrame(srtc::Codec codec, const uint8_t* data, size_t size)
+{
+    if (data == nullptr) {
+        return false;
+    }
+
+    switch (codec) {
+    case srtc::Codec::H264:
+        return isH264NonReferenceFrame(data, size);
+    case srtc::Codec::H265:
+        return isH265NonReferenceFrame(data, size);
+    default:
+        return false;
+    }
+}
+
+} // namespace srtc::android
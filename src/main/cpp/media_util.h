@@ -0,0 +1,39 @@
+#pragma once
+
+#include "srtc/peer_connection.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace srtc::android
+{
+
+// Iterates over NAL units in an Annex B byte stream (H.264 / H.265)
+
+class NaluScanner
+{
+public:
+    NaluScanner(const uint8_t* data, size_t size);
+
+    [[nodiscard]] bool next();
+
+    [[nodiscard]] const uint8_t* data() const;
+    [[nodiscard]] size_t size() const;
+
+private:
+    [[nodiscard]] size_t findStartCode(size_t from, size_t& startCodeSize) const;
+
+    const uint8_t* const mData;
+    const size_t mSize;
+
+    size_t mNextPos;
+    const uint8_t* mNaluData;
+    size_t mNaluSize;
+};
+
+[[nodiscard]] bool isVideoKeyFrame(srtc::Codec codec, const uint8_t* data, size_t size);
+
+// A frame no other frame depends on, only known for H.264 and H.265
+[[nodiscard]] bool isVideoNonReferenceFrame(srtc::Codec codec, const uint8_t* data, size_t size);
+
+} // namespace srtc::android
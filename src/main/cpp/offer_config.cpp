@@ -0,0 +1,167 @@
+#include "offer_config.h"
+
+#include <string>
+
+namespace
+{
+
+class Reader
+{
+public:
+    Reader(const uint8_t* data, size_t size)
+        : mData(data)
+        , mSize(size)
+        , mPos(0)
+        , mIsError(false)
+    {
+    }
+
+    [[nodiscard]] bool isError() const
+    {
+        return mIsError;
+    }
+
+    uint8_t readU8()
+    {
+        if (!ensure(1)) {
+            return 0;
+        }
+        return mData[mPos++];
+    }
+
+    uint16_t readU16()
+    {
+        if (!ensure(2)) {
+            return 0;
+        }
+        const auto value = static_cast<uint16_t>(mData[mPos] | (mData[mPos + 1] << 8));
+        mPos += 2;
+        return value;
+    }
+
+    uint32_t readU32()
+    {
+        if (!ensure(4)) {
+            return 0;
+        }
+        const auto value = static_cast<uint32_t>(mData[mPos]) | (static_cast<uint32_t>(mData[mPos + 1]) << 8) |
+                           (static_cast<uint32_t>(mData[mPos + 2]) << 16) |
+                           (static_cast<uint32_t>(mData[mPos + 3]) << 24);
+        mPos += 4;
+        return value;
+    }
+
+    std::string readString()
+    {
+        const auto length = readU16();
+        if (!ensure(length)) {
+            return {};
+        }
+        std::string value(reinterpret_cast<const char*>(mData + mPos), length);
+        mPos += length;
+        return value;
+    }
+
+private:
+    bool ensure(size_t count)
+    {
+        if (mIsError || mPos + count > mSize) {
+            mIsError = true;
+            return false;
+        }
+        return true;
+    }
+
+    const uint8_t* const mData;
+    const size_t mSize;
+    size_t mPos;
+    bool mIsError;
+};
+
+} // namespace
+
+namespace srtc::android
+{
+
+Error decodeOfferConfig(const uint8_t* data, size_t size, PubOfferConfig& offerConfig, PubMediaConfig& mediaConfig)
+{
+    if (data == nullptr) {
+        return { Error::Code::InvalidData, "The offer config buffer is not a direct buffer" };
+    }
+
+    Reader reader(data, size);
+
+    const auto version = reader.readU8();
+    if (version != kOfferConfigVersion) {
+        return { Error::Code::InvalidData, "Unsupported offer config version" };
+    }
+
+    // Publish config
+    const auto flags = reader.readU8();
+
+    offerConfig.cname = reader.readString();
+    offerConfig.enable_bwe = (flags & kOfferConfigFlagEnableBWE) != 0;
+    offerConfig.enable_rfc8851 = (flags & kOfferConfigFlagEnableRFC8851) != 0;
+
+    // Video
+    if (reader.readU8() != 0) {
+        PubMediaItem mediaItem = {};
+        mediaItem.media_id = "video_0";
+        mediaItem.media_type = MediaType::Video;
+
+        const auto codecCount = reader.readU8();
+        for (uint8_t i = 0; i < codecCount && !reader.isError(); i += 1) {
+            const auto codec = static_cast<Codec>(reader.readU32());
+            const auto profileLevelId = reader.readU32();
+            mediaItem.codec_list.push_back(
+                PubCodec{ .codec = codec, .profile_level_id = profileLevelId, .minptime = 0, .stereo = false });
+        }
+
+        const auto layerCount = reader.readU8();
+        for (uint8_t i = 0; i < layerCount && !reader.isError(); i += 1) {
+            auto name = reader.readString();
+            const auto width = reader.readU16();
+            const auto height = reader.readU16();
+            const auto framesPerSecond = reader.readU16();
+            const auto kilobitsPerSecond = reader.readU32();
+            mediaItem.layer_list.push_back(SimulcastLayer{ .name = std::move(name),
+                                                           .width = width,
+                                                           .height = height,
+                                                           .frames_per_second = framesPerSecond,
+                                                           .kilobits_per_second = kilobitsPerSecond });
+        }
+
+        mediaConfig.media_list.push_back(std::move(mediaItem));
+    }
+
+    // Audio
+    if (reader.readU8() != 0) {
+        PubMediaItem mediaItem = {};
+        mediaItem.media_id = "audio_0";
+        mediaItem.media_type = MediaType::Audio;
+
+        const auto codecCount = reader.readU8();
+        for (uint8_t i = 0; i < codecCount && !reader.isError(); i += 1) {
+            const auto codec = static_cast<Codec>(reader.readU32());
+            const auto minptime = reader.readU32();
+            const auto stereo = reader.readU8() != 0;
+            mediaItem.codec_list.push_back(
+                PubCodec{ .codec = codec, .profile_level_id = 0, .minptime = minptime, .stereo = stereo });
+        }
+
+        mediaConfig.media_list.push_back(std::move(mediaItem));
+    }
+
+    if (reader.isError()) {
+        return { Error::Code::InvalidData, "The offer config is truncated" };
+    }
+
+    return Error::OK;
+}
+
+bool isOfferConfigFlagSet(const uint8_t* data, size_t size, OfferConfigFlag flag)
+{
+    return data != nullptr && size >= 2 && data[0] == kOfferConfigVersion && (data[1] & flag) != 0;
+}
+
+} // namespace srtc::android
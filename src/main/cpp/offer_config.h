@@ -0,0 +1,39 @@
+#pragma once
+
+#include "srtc/peer_connection.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace srtc::android
+{
+
+// Decodes the publish offer configuration serialized by PeerConnection.encodeOfferConfig on the Java side.
+// Everything is little endian, strings are a 16 bit length followed by UTF-8 bytes:
+//
+// u8       version
+// u8       flags (OfferConfigFlag)
+// string   cname
+// u8       has video
+//   u8       codec count, then for each: i32 codec, i32 profile level id
+//   u8       layer count, then for each: string name, u16 width, u16 height, u16 fps, u32 kbit/s
+// u8       has audio
+//   u8       codec count, then for each: i32 codec, i32 minptime, u8 stereo
+
+constexpr uint8_t kOfferConfigVersion = 1;
+
+enum OfferConfigFlag : uint8_t {
+    kOfferConfigFlagEnableBWE = 0x01,
+    kOfferConfigFlagEnableRFC8851 = 0x02,
+    kOfferConfigFlagEnableRED = 0x04,
+};
+
+[[nodiscard]] Error decodeOfferConfig(const uint8_t* data,
+                                      size_t size,
+                                      PubOfferConfig& offerConfig,
+                                      PubMediaConfig& mediaConfig);
+
+// For the flags which srtc doesn't know about and we handle ourselves
+[[nodiscard]] bool isOfferConfigFlagSet(const uint8_t* data, size_t size, OfferConfigFlag flag);
+
+} // namespace srtc::android
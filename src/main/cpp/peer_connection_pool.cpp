@@ -0,0 +1,185 @@
+#include "srtc/logging.h"
+#include "srtc/sdp_offer.h"
+#include "srtc/util.h"
+
+#include "offer_config.h"
+#include "peer_connection_pool.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <pthread.h>
+
+#define LOG(level, ...) srtc::log(level, "PeerConnectionPool", __VA_ARGS__)
+
+namespace
+{
+
+// The user is not going to connect with more than a couple of different configs
+constexpr size_t kMaxReadyCount = 2;
+
+// Don't hand out stale offers
+constexpr int64_t kMaxAgeUsec = 5 * 60 * 1000 * 1000ll;
+
+bool isSameConfig(const std::vector<uint8_t>& config, const uint8_t* data, size_t size)
+{
+    return config.size() == size && std::memcmp(config.data(), data, size) == 0;
+}
+
+} // namespace
+
+namespace srtc::android
+{
+
+PeerConnectionPool::PeerConnectionPool()
+    : mQuit(false)
+    , mIsPreparing(false)
+{
+}
+
+PeerConnectionPool::~PeerConnectionPool()
+{
+    {
+        std::lock_guard lock(mMutex);
+        mQuit = true;
+    }
+    mCond.notify_one();
+    mPreparedCond.notify_all();
+
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+}
+
+void PeerConnectionPool::prewarm(const uint8_t* config, size_t size)
+{
+    {
+        std::lock_guard lock(mMutex);
+
+        if (mIsPreparing && isSameConfig(mPreparingConfig, config, size)) {
+            return;
+        }
+        for (const auto& entry : mReadyList) {
+            if (isSameConfig(entry->config, config, size)) {
+                return;
+            }
+        }
+        for (const auto& request : mRequestList) {
+            if (isSameConfig(request, config, size)) {
+                return;
+            }
+        }
+
+        mRequestList.emplace_back(config, config + size);
+
+        if (!mThread.joinable()) {
+            mThread = std::thread([this] { threadFunc(); });
+        }
+    }
+    mCond.notify_one();
+}
+
+std::unique_ptr<PeerConnectionPool::Entry> PeerConnectionPool::acquire(const uint8_t* config, size_t size)
+{
+    std::unique_lock lock(mMutex);
+
+    mPreparedCond.wait(lock, [this, config, size] {
+        return mQuit || !mIsPreparing || !isSameConfig(mPreparingConfig, config, size);
+    });
+
+    expireLocked(srtc::getStableTimeMicros());
+
+    for (auto iter = mReadyList.begin(); iter != mReadyList.end(); ++iter) {
+        if (isSameConfig((*iter)->config, config, size)) {
+            auto entry = std::move(*iter);
+            mReadyList.erase(iter);
+            return entry;
+        }
+    }
+
+    return nullptr;
+}
+
+void PeerConnectionPool::threadFunc()
+{
+    pthread_setname_np(pthread_self(), "srtc-prewarm");
+
+    std::unique_lock lock(mMutex);
+
+    while (!mQuit) {
+        if (mRequestList.empty()) {
+            mCond.wait(lock);
+            continue;
+        }
+
+        auto config = std::move(mRequestList.front());
+        mRequestList.pop_front();
+
+        mIsPreparing = true;
+        mPreparingConfig = config;
+
+        lock.unlock();
+        auto entry = createEntry(std::move(config));
+        lock.lock();
+
+        if (entry) {
+            mReadyList.push_back(std::move(entry));
+            while (mReadyList.size() > kMaxReadyCount) {
+                mReadyList.pop_front();
+            }
+        }
+
+        mIsPreparing = false;
+        mPreparingConfig.clear();
+        mPreparedCond.notify_all();
+    }
+}
+
+std::unique_ptr<PeerConnectionPool::Entry> PeerConnectionPool::createEntry(std::vector<uint8_t>&& config)
+{
+    const auto startUsec = srtc::getStableTimeMicros();
+
+    PubOfferConfig offerConfig = {};
+    PubMediaConfig mediaConfig = {};
+    if (const auto error = decodeOfferConfig(config.data(), config.size(), offerConfig, mediaConfig);
+        error.isError()) {
+        LOG(SRTC_LOG_E, "Error decoding offer config: %s", error.message.c_str());
+        return nullptr;
+    }
+
+    auto conn = std::make_unique<PeerConnection>(Direction::Publish);
+
+    const auto [offer, offerError] = conn->createPublishOffer(offerConfig, mediaConfig);
+    if (offerError.isError()) {
+        LOG(SRTC_LOG_E, "Error creating offer: %s", offerError.message.c_str());
+        return nullptr;
+    }
+
+    const auto [offerStr, offerStrError] = offer->generate();
+    if (offerStrError.isError()) {
+        LOG(SRTC_LOG_E, "Error generating offer: %s", offerStrError.message.c_str());
+        return nullptr;
+    }
+
+    if (const auto setOfferError = conn->setOffer(offer); setOfferError.isError()) {
+        LOG(SRTC_LOG_E, "Error setting offer: %s", setOfferError.message.c_str());
+        return nullptr;
+    }
+
+    const auto nowUsec = srtc::getStableTimeMicros();
+    LOG(SRTC_LOG_V, "Prewarmed a connection in %lld ms", static_cast<long long>((nowUsec - startUsec) / 1000));
+
+    return std::make_unique<Entry>(Entry{ std::move(config), std::move(conn), offerStr, nowUsec });
+}
+
+void PeerConnectionPool::expireLocked(int64_t now)
+{
+    mReadyList.erase(std::remove_if(mReadyList.begin(),
+                                    mReadyList.end(),
+                                    [now](const std::unique_ptr<Entry>& entry) {
+                                        return now - entry->createdUsec > kMaxAgeUsec;
+                                    }),
+                     mReadyList.end());
+}
+
+} // namespace srtc::android
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "srtc/peer_connection.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace srtc
+{
+class SdpOffer;
+} // namespace srtc
+
+namespace srtc::android
+{
+
+// Prepares publish connections in the background so that creating the offer, which includes generating the DTLS
+// certificate and key, is off the critical path when the user connects. Entries are keyed by the serialized offer
+// config (see offer_config.h) and are only handed out for an exact match.
+
+class PeerConnectionPool
+{
+public:
+    struct Entry {
+        std::vector<uint8_t> config;
+        std::unique_ptr<PeerConnection> conn;
+        std::string offerStr;
+        int64_t createdUsec;
+    };
+
+    PeerConnectionPool();
+    ~PeerConnectionPool();
+
+    void prewarm(const uint8_t* config, size_t size);
+
+    // Returns nullptr if there is no ready connection for this config. If one is being prepared, waits for it, which
+    // is never longer than creating it from scratch.
+    [[nodiscard]] std::unique_ptr<Entry> acquire(const uint8_t* config, size_t size);
+
+private:
+    void threadFunc();
+
+    [[nodiscard]] static std::unique_ptr<Entry> createEntry(std::vector<uint8_t>&& config);
+
+    void expireLocked(int64_t now);
+
+    std::mutex mMutex;
+    std::condition_variable mCond;
+    bool mQuit;
+
+    std::deque<std::vector<uint8_t>> mRequestList;
+    std::deque<std::unique_ptr<Entry>> mReadyList;
+
+    // Taken off the request list but not ready yet
+    bool mIsPreparing;
+    std::vector<uint8_t> mPreparingConfig;
+    std::condition_variable mPreparedCond;
+
+    std::thread mThread;
+};
+
+} // namespace srtc::android
@@ -0,0 +1,567 @@
+#include "srtc/logging.h"
+#include "srtc/util.h"
+
+#include "alloc_tracker.h"
+#include "publish_pacer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
+#include <pthread.h>
+
+#define LOG(level, ...) srtc::log(level, "PublishPacer", __VA_ARGS__)
+
+namespace
+{
+
+// How much unused budget can accumulate while idle
+constexpr auto kBurstMillis = 40;
+
+// How much media, at its nominal bitrate, a layer is allowed to queue
+constexpr auto kMaxQueueMillis = 500;
+
+// Large enough for a key frame at any of our resolutions
+constexpr size_t kMinLimitBytes = 256 * 1024;
+
+// How many buffers are kept for frames copied past the borrowing limit
+constexpr size_t kMaxStoragePoolSize = 8;
+
+// A key frame makes congestion worse, so don't ask for one too often
+constexpr int64_t kKeyFrameRequestIntervalUsec = 1000 * 1000;
+
+size_t bitrateToBytes(float kilobitsPerSecond, int millis)
+{
+    return static_cast<size_t>(kilobitsPerSecond * 1000.0f / 8.0f * static_cast<float>(millis) / 1000.0f);
+}
+
+} // namespace
+
+namespace srtc::android
+{
+
+PublishPacer::PublishPacer(SendFunc videoSender,
+                           SendFunc audioSender,
+                           ReleaseFunc borrowReleaser,
+                           KeyFrameFunc keyFrameRequester)
+    : mVideoSender(std::move(videoSender))
+    , mAudioSender(std::move(audioSender))
+    , mBorrowReleaser(std::move(borrowReleaser))
+    , mKeyFrameRequester(std::move(keyFrameRequester))
+    , mQuit(false)
+    , mVideoQueueBytes(0)
+    , mNextSeq(0)
+    , mIsCopyingBorrowed(false)
+    , mIsCopyingCancelled(false)
+    , mCopyingToken(0)
+    , mKeyFrameRequestMask(0)
+    , mKeyFrameRequestUsec()
+    , mTargetBitrate(0.0f)
+    , mBudgetBytes(0.0)
+    , mBudgetUpdatedUsec(0)
+    , mDroppedFrames(0)
+    , mDelayCount(0)
+    , mDelaySumUsec(0)
+    , mDelayMaxUsec(0)
+{
+    for (auto& layer : mLayerList) {
+        layer.limitBytes = kMinLimitBytes;
+    }
+
+    mReleasedTokenList.reserve(64);
+    mReleasingTokenList.reserve(64);
+    mStoragePool.reserve(kMaxStoragePoolSize);
+
+    mThread = std::thread([this] { threadFunc(); });
+}
+
+PublishPacer::~PublishPacer()
+{
+    {
+        std::lock_guard lock(mMutex);
+        mQuit = true;
+    }
+    mCond.notify_one();
+
+    mThread.join();
+}
+
+void PublishPacer::setTargetBitrate(float kilobitsPerSecond)
+{
+    std::lock_guard lock(mMutex);
+
+    const auto now = srtc::getStableTimeMicros();
+    if (mTargetBitrate > 0.0f) {
+        refillBudget(now);
+    } else {
+        mBudgetBytes = 0.0;
+        mBudgetUpdatedUsec = now;
+    }
+
+    mTargetBitrate = std::max(kilobitsPerSecond, 0.0f);
+    mCond.notify_one();
+}
+
+void PublishPacer::setLayerBitrate(size_t layerIndex, uint32_t kilobitsPerSecond)
+{
+    std::lock_guard lock(mMutex);
+
+    if (layerIndex < kMaxLayerCount) {
+        mLayerList[layerIndex].limitBytes =
+            std::max(kMinLimitBytes, bitrateToBytes(static_cast<float>(kilobitsPerSecond), kMaxQueueMillis));
+    }
+}
+
+void PublishPacer::enqueueAudio(const std::shared_ptr<srtc::Track>& track, int64_t pts_usec, ByteBuffer&& frame)
+{
+    {
+        std::lock_guard lock(mMutex);
+
+        const auto now = srtc::getStableTimeMicros();
+        mAudioQueue.push_back(Item{ track, pts_usec, now, mNextSeq++, std::move(frame), nullptr, 0, 0, {} });
+    }
+    mCond.notify_one();
+}
+
+void PublishPacer::enqueueVideo(const std::shared_ptr<srtc::Track>& track,
+                                size_t layerIndex,
+                                int64_t pts_usec,
+                                ByteBuffer&& frame,
+                                bool isKeyFrame)
+{
+    enqueueVideoItem(layerIndex, Item{ track, pts_usec, 0, 0, std::move(frame), nullptr, 0, 0, {} }, isKeyFrame);
+}
+
+void PublishPacer::enqueueVideoBorrowed(const std::shared_ptr<srtc::Track>& track,
+                                        size_t layerIndex,
+                                        int64_t pts_usec,
+                                        const uint8_t* data,
+                                        size_t size,
+                                        uint64_t token,
+                                        bool isKeyFrame)
+{
+    layerIndex = std::min(layerIndex, kMaxLayerCount - 1);
+    if (mLayerList[layerIndex].borrowedCount < kMaxBorrowedFramesPerLayer) {
+        enqueueVideoItem(layerIndex, Item{ track, pts_usec, 0, 0, {}, data, size, token, {} }, isKeyFrame);
+        return;
+    }
+
+    // The encoder could run out of output buffers, so copy this one and give it back
+    std::vector<uint8_t> storage;
+    {
+        std::lock_guard lock(mMutex);
+        if (!mStoragePool.empty()) {
+            storage = std::move(mStoragePool.back());
+            mStoragePool.pop_back();
+        }
+    }
+
+    storage.assign(data, data + size);
+    const auto storageData = storage.data();
+
+    {
+        std::lock_guard lock(mMutex);
+        mReleasedTokenList.push_back(token);
+    }
+    enqueueVideoItem(
+        layerIndex, Item{ track, pts_usec, 0, 0, {}, storageData, size, 0, std::move(storage) }, isKeyFrame);
+}
+
+void PublishPacer::enqueueVideoItem(size_t layerIndex, Item&& item, bool isKeyFrame)
+{
+    {
+        std::lock_guard lock(mMutex);
+
+        layerIndex = std::min(layerIndex, kMaxLayerCount - 1);
+        auto& layer = mLayerList[layerIndex];
+
+        if (layer.waitingForKeyFrame) {
+            if (!isKeyFrame) {
+                // The decoder would not be able to use this frame, and the previous request may have been lost
+                mDroppedFrames += 1;
+                requestKeyFrameLocked(layerIndex);
+                releaseLocked(item);
+                mCond.notify_one();
+                return;
+            }
+            layer.waitingForKeyFrame = false;
+        }
+
+        const auto size = item.size();
+        if (!layer.queue.empty() && layer.queueBytes + size > layer.limitBytes) {
+            // Over this layer's own limit, a key frame starts the layer over without asking for another one
+            shedLayer(layerIndex);
+            if (!isKeyFrame) {
+                mDroppedFrames += 1;
+                requestKeyFrameLocked(layerIndex);
+                releaseLocked(item);
+                mCond.notify_one();
+                return;
+            }
+            layer.waitingForKeyFrame = false;
+        }
+
+        item.enqueue_usec = srtc::getStableTimeMicros();
+        item.seq = mNextSeq++;
+        if (item.isBorrowed()) {
+            layer.borrowedCount += 1;
+        }
+        layer.queue.push_back(std::move(item));
+        layer.queueBytes += size;
+        mVideoQueueBytes += size;
+
+        // Over the overall limit, shed the less important layers first
+        const auto totalLimitBytes = getTotalLimitBytes();
+        for (auto i = kMaxLayerCount - 1; i > 0 && mVideoQueueBytes > totalLimitBytes; i -= 1) {
+            if (!mLayerList[i].queue.empty()) {
+                shedLayer(i);
+                requestKeyFrameLocked(i);
+            }
+        }
+    }
+    mCond.notify_one();
+}
+
+void PublishPacer::cancelBorrowed(const TokenPredicate& predicate)
+{
+    {
+        std::unique_lock lock(mMutex);
+
+        for (size_t i = 0; i < kMaxLayerCount; i += 1) {
+            auto& layer = mLayerList[i];
+            uint32_t removedCount = 0;
+            const auto removedBytes = layer.queue.removeIf([&predicate, &removedCount](const Item& item) {
+                if (item.isBorrowed() && predicate(item.token)) {
+                    removedCount += 1;
+                    return true;
+                }
+                return false;
+            });
+            if (removedBytes > 0) {
+                layer.borrowedCount -= removedCount;
+                layer.queueBytes -= removedBytes;
+                mVideoQueueBytes -= removedBytes;
+
+                // What's left may depend on what was removed
+                shedLayer(i);
+                requestKeyFrameLocked(i);
+            }
+        }
+
+        // The frame being copied is not released once the copy is done
+        if (mIsCopyingBorrowed && predicate(mCopyingToken)) {
+            mIsCopyingCancelled = true;
+            mCopyingCond.wait(lock, [this] { return !mIsCopyingBorrowed; });
+        }
+    }
+    mCond.notify_one();
+}
+
+void PublishPacer::flush()
+{
+    {
+        std::lock_guard lock(mMutex);
+
+        mAudioQueue.clear();
+        for (auto& layer : mLayerList) {
+            releaseQueueLocked(layer);
+            layer.queue.clear();
+            layer.queueBytes = 0;
+            layer.waitingForKeyFrame = false;
+        }
+        mVideoQueueBytes = 0;
+
+        mKeyFrameRequestMask = 0;
+        mKeyFrameRequestUsec.fill(0);
+    }
+    mCond.notify_one();
+}
+
+void PublishPacer::resetLayer(size_t layerIndex)
+{
+    {
+        std::lock_guard lock(mMutex);
+
+        if (layerIndex < kMaxLayerCount) {
+            shedLayer(layerIndex);
+            requestKeyFrameLocked(layerIndex);
+        }
+    }
+    mCond.notify_one();
+}
+
+float PublishPacer::getQueueMillis()
+{
+    std::lock_guard lock(mMutex);
+
+    if (mTargetBitrate <= 0.0f) {
+        return 0.0f;
+    }
+
+    return static_cast<float>(mVideoQueueBytes) * 8.0f / mTargetBitrate;
+}
+
+PublishPacer::Stats PublishPacer::getStats()
+{
+    std::lock_guard lock(mMutex);
+
+    auto queueFrames = mAudioQueue.size();
+    for (const auto& layer : mLayerList) {
+        queueFrames += layer.queue.size();
+    }
+
+    Stats stats = {};
+    stats.queue_frames = static_cast<uint32_t>(queueFrames);
+    stats.queue_bytes = static_cast<uint32_t>(mVideoQueueBytes);
+    stats.delay_avg_ms = mDelayCount == 0 ? 0.0f : static_cast<float>(mDelaySumUsec) / mDelayCount / 1000.0f;
+    stats.delay_max_ms = static_cast<float>(mDelayMaxUsec) / 1000.0f;
+    stats.dropped_frames = mDroppedFrames;
+
+    mDelayCount = 0;
+    mDelaySumUsec = 0;
+    mDelayMaxUsec = 0;
+
+    return stats;
+}
+
+void PublishPacer::threadFunc()
+{
+    pthread_setname_np(pthread_self(), "srtc-pacer");
+
+    std::unique_lock lock(mMutex);
+
+    while (!mQuit) {
+        // Hand back the borrowed frames we're done with, without holding the lock
+        if (!mReleasedTokenList.empty()) {
+            mReleasingTokenList.swap(mReleasedTokenList);
+
+            lock.unlock();
+            for (const auto token : mReleasingTokenList) {
+                mBorrowReleaser(token);
+            }
+            mReleasingTokenList.clear();
+            lock.lock();
+            continue;
+        }
+
+        if (mKeyFrameRequestMask != 0) {
+            const auto mask = mKeyFrameRequestMask;
+            mKeyFrameRequestMask = 0;
+
+            lock.unlock();
+            for (size_t i = 0; i < kMaxLayerCount; i += 1) {
+                if ((mask & (1u << i)) != 0) {
+                    mKeyFrameRequester(i);
+                }
+            }
+            lock.lock();
+            continue;
+        }
+
+        // Audio always goes first
+        if (!mAudioQueue.empty()) {
+            auto item = std::move(mAudioQueue.front());
+            mAudioQueue.pop_front();
+
+            lock.unlock();
+            if (const auto error = mAudioSender(item.track, item.pts_usec, std::move(item.frame)); error.isError()) {
+                LOG(SRTC_LOG_E, "Error publishing audio frame: %s", error.message.c_str());
+            }
+            lock.lock();
+            continue;
+        }
+
+        const auto layer = findOldestLayer();
+        if (layer == nullptr) {
+            mCond.wait(lock);
+            continue;
+        }
+
+        const auto now = srtc::getStableTimeMicros();
+        if (mTargetBitrate > 0.0f) {
+            refillBudget(now);
+            if (mBudgetBytes < 0.0) {
+                const auto bytesPerUsec = mTargetBitrate / 8000.0;
+                const auto waitUsec = static_cast<int64_t>(-mBudgetBytes / bytesPerUsec) + 1;
+                mCond.wait_for(lock, std::chrono::microseconds(waitUsec));
+                continue;
+            }
+        }
+
+        auto item = std::move(layer->queue.front());
+        layer->queue.pop_front();
+
+        const auto size = item.size();
+        const auto isBorrowed = item.isBorrowed();
+        if (isBorrowed) {
+            layer->borrowedCount -= 1;
+            mIsCopyingBorrowed = true;
+            mIsCopyingCancelled = false;
+            mCopyingToken = item.token;
+        }
+
+        layer->queueBytes -= size;
+        mVideoQueueBytes -= size;
+        if (mTargetBitrate > 0.0f) {
+            mBudgetBytes -= static_cast<double>(size);
+        }
+
+        const auto delay = now - item.enqueue_usec;
+        mDelayCount += 1;
+        mDelaySumUsec += delay;
+        mDelayMaxUsec = std::max(mDelayMaxUsec, delay);
+
+        lock.unlock();
+        if (item.borrowed_data != nullptr) {
+            // srtc keeps what it sends, so this copy can't be avoided, but it's made without the lock. Once it's done,
+            // the buffer or our storage can go back.
+            const AllocScope allocScope(AllocScopeKind::VideoSend);
+            item.frame = ByteBuffer(item.borrowed_data, item.borrowed_size);
+
+            lock.lock();
+            if (!isBorrowed || !mIsCopyingCancelled) {
+                releaseLocked(item);
+            }
+            if (isBorrowed) {
+                mIsCopyingBorrowed = false;
+                mCopyingCond.notify_all();
+            }
+            lock.unlock();
+        }
+        if (const auto error = mVideoSender(item.track, item.pts_usec, std::move(item.frame)); error.isError()) {
+            LOG(SRTC_LOG_E, "Error publishing video frame: %s", error.message.c_str());
+        }
+        lock.lock();
+    }
+}
+
+void PublishPacer::refillBudget(int64_t now)
+{
+    const auto bytesPerUsec = mTargetBitrate / 8000.0;
+    const auto burstBytes = static_cast<double>(bitrateToBytes(mTargetBitrate, kBurstMillis));
+
+    mBudgetBytes = std::min(mBudgetBytes + static_cast<double>(now - mBudgetUpdatedUsec) * bytesPerUsec, burstBytes);
+    mBudgetUpdatedUsec = now;
+}
+
+void PublishPacer::shedLayer(size_t layerIndex)
+{
+    auto& layer = mLayerList[layerIndex];
+
+    LOG(SRTC_LOG_V, "Shedding layer %zu, %zu frames, %zu bytes", layerIndex, layer.queue.size(), layer.queueBytes);
+
+    mDroppedFrames += static_cast<uint32_t>(layer.queue.size());
+    mVideoQueueBytes -= layer.queueBytes;
+
+    releaseQueueLocked(layer);
+    layer.queue.clear();
+    layer.queueBytes = 0;
+    layer.waitingForKeyFrame = true;
+}
+
+void PublishPacer::requestKeyFrameLocked(size_t layerIndex)
+{
+    const auto now = srtc::getStableTimeMicros();
+    auto& lastUsec = mKeyFrameRequestUsec[layerIndex];
+    if (lastUsec != 0 && now - lastUsec < kKeyFrameRequestIntervalUsec) {
+        return;
+    }
+
+    lastUsec = now;
+    mKeyFrameRequestMask |= 1u << layerIndex;
+}
+
+void PublishPacer::releaseLocked(Item& item)
+{
+    if (item.isBorrowed()) {
+        mReleasedTokenList.push_back(item.token);
+    } else if (item.storage.capacity() > 0 && mStoragePool.size() < kMaxStoragePoolSize) {
+        mStoragePool.push_back(std::move(item.storage));
+        item.storage.clear();
+    }
+}
+
+void PublishPacer::releaseQueueLocked(Layer& layer)
+{
+    layer.queue.forEach([this](Item& item) { releaseLocked(item); });
+    layer.borrowedCount = 0;
+}
+
+size_t PublishPacer::getTotalLimitBytes() const
+{
+    if (mTargetBitrate <= 0.0f) {
+        return std::numeric_limits<size_t>::max();
+    }
+
+    return std::max(kMinLimitBytes, bitrateToBytes(mTargetBitrate, kMaxQueueMillis));
+}
+
+void PublishPacer::ItemQueue::push_back(Item&& item)
+{
+    if (mCount == mList.size()) {
+        std::vector<Item> list(std::max<size_t>(16, mList.size() * 2));
+        for (size_t i = 0; i < mCount; i += 1) {
+            list[i] = std::move(mList[(mHead + i) % mList.size()]);
+        }
+        mList = std::move(list);
+        mHead = 0;
+    }
+
+    mList[(mHead + mCount) % mList.size()] = std::move(item);
+    mCount += 1;
+}
+
+void PublishPacer::ItemQueue::pop_front()
+{
+    // Releases the frame and the track right away
+    mList[mHead] = Item{};
+    mHead = (mHead + 1) % mList.size();
+    mCount -= 1;
+}
+
+size_t PublishPacer::ItemQueue::removeIf(const std::function<bool(const Item&)>& predicate)
+{
+    size_t removedBytes = 0;
+    size_t keepCount = 0;
+
+    for (size_t i = 0; i < mCount; i += 1) {
+        auto& item = mList[(mHead + i) % mList.size()];
+        if (predicate(item)) {
+            removedBytes += item.size();
+            item = Item{};
+        } else {
+            if (keepCount != i) {
+                mList[(mHead + keepCount) % mList.size()] = std::move(item);
+                item = Item{};
+            }
+            keepCount += 1;
+        }
+    }
+
+    mCount = keepCount;
+    return removedBytes;
+}
+
+void PublishPacer::ItemQueue::clear()
+{
+    while (mCount > 0) {
+        pop_front();
+    }
+    mHead = 0;
+}
+
+PublishPacer::Layer* PublishPacer::findOldestLayer()
+{
+    Layer* oldest = nullptr;
+    for (auto& layer : mLayerList) {
+        if (!layer.queue.empty()) {
+            if (oldest == nullptr || layer.queue.front().seq < oldest->queue.front().seq) {
+                oldest = &layer;
+            }
+        }
+    }
+
+    return oldest;
+}
+
+} // namespace srtc::android
@@ -0,0 +1,228 @@
+#pragma once
+
+#include "srtc/byte_buffer.h"
+#include "srtc/error.h"
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace srtc
+{
+class Track;
+} // namespace srtc
+
+namespace srtc::android
+{
+
+// Sits between the JNI bridge and the transport. Audio frames always go out ahead of video, video frames are
+// released at the suggested bandwidth estimate, and per-layer queue limits shed the least important layers first.
+//
+// Video frames can also be borrowed: the pacer only keeps a pointer, reads the data when the frame's turn comes, and
+// hands the token back through the release function once it's done with the memory, whether the frame was sent or
+// dropped. Release calls are made on the pacer's thread. An encoder only has a few output buffers, so past a couple of
+// queued frames per layer, a borrowed frame is copied to the pacer's own storage and its buffer goes back right away.
+//
+// A layer that had frames shed waits for a key frame, and the key frame function asks for one, at most once per
+// second for each layer. That is called on the pacer's thread too.
+
+class PublishPacer
+{
+public:
+    static constexpr size_t kMaxLayerCount = 3;
+    static constexpr uint32_t kMaxBorrowedFramesPerLayer = 2;
+
+    struct Stats {
+        uint32_t queue_frames;
+        uint32_t queue_bytes;
+        float delay_avg_ms;
+        float delay_max_ms;
+        uint32_t dropped_frames;
+    };
+
+    using SendFunc =
+        std::function<Error(const std::shared_ptr<srtc::Track>& track, int64_t pts_usec, ByteBuffer&& frame)>;
+    using ReleaseFunc = std::function<void(uint64_t token)>;
+    using KeyFrameFunc = std::function<void(size_t layerIndex)>;
+    using TokenPredicate = std::function<bool(uint64_t token)>;
+
+    PublishPacer(SendFunc videoSender,
+                 SendFunc audioSender,
+                 ReleaseFunc borrowReleaser,
+                 KeyFrameFunc keyFrameRequester);
+    ~PublishPacer();
+
+    // Zero means "no estimate yet" and disables pacing
+    void setTargetBitrate(float kilobitsPerSecond);
+
+    // The layer's bitrate determines how much of it may be queued, index zero is the most important layer
+    void setLayerBitrate(size_t layerIndex, uint32_t kilobitsPerSecond);
+
+    void enqueueAudio(const std::shared_ptr<srtc::Track>& track, int64_t pts_usec, ByteBuffer&& frame);
+    void enqueueVideo(const std::shared_ptr<srtc::Track>& track,
+                      size_t layerIndex,
+                      int64_t pts_usec,
+                      ByteBuffer&& frame,
+                      bool isKeyFrame);
+    void enqueueVideoBorrowed(const std::shared_ptr<srtc::Track>& track,
+                              size_t layerIndex,
+                              int64_t pts_usec,
+                              const uint8_t* data,
+                              size_t size,
+                              uint64_t token,
+                              bool isKeyFrame);
+
+    // Drops the matching borrowed frames without releasing them, for when their memory is about to go away. Once this
+    // returns, the pacer no longer touches that memory.
+    void cancelBorrowed(const TokenPredicate& predicate);
+
+    // Drops everything, including the key frame request history, for a new connection
+    void flush();
+
+    // Drops what is queued for the layer, which then waits for a key frame
+    void resetLayer(size_t layerIndex);
+
+    // How long it would take to send the queued video at the target bitrate
+    [[nodiscard]] float getQueueMillis();
+
+    // Delay values are for the frames sent since the previous call
+    [[nodiscard]] Stats getStats();
+
+private:
+    struct Item {
+        std::shared_ptr<srtc::Track> track;
+        int64_t pts_usec;
+        int64_t enqueue_usec;
+        uint64_t seq;
+        ByteBuffer frame;
+
+        // Set for borrowed frames, and for frames in our own storage, which have nothing to release
+        const uint8_t* borrowed_data;
+        size_t borrowed_size;
+        uint64_t token;
+        std::vector<uint8_t> storage;
+
+        [[nodiscard]] bool isBorrowed() const
+        {
+            return borrowed_data != nullptr && borrowed_data != storage.data();
+        }
+
+        [[nodiscard]] size_t size() const
+        {
+            return borrowed_data ? borrowed_size : frame.size();
+        }
+    };
+
+    // A ring buffer which keeps its storage, so queueing doesn't allocate once it has grown to the working size
+    class ItemQueue
+    {
+    public:
+        [[nodiscard]] bool empty() const
+        {
+            return mCount == 0;
+        }
+
+        [[nodiscard]] size_t size() const
+        {
+            return mCount;
+        }
+
+        [[nodiscard]] Item& front()
+        {
+            return mList[mHead];
+        }
+
+        void push_back(Item&& item);
+        void pop_front();
+        void clear();
+
+        // Returns the total size of the removed items
+        size_t removeIf(const std::function<bool(const Item&)>& predicate);
+
+        template <typename Func>
+        void forEach(Func func)
+        {
+            for (size_t i = 0; i < mCount; i += 1) {
+                func(mList[(mHead + i) % mList.size()]);
+            }
+        }
+
+    private:
+        std::vector<Item> mList;
+        size_t mHead = 0;
+        size_t mCount = 0;
+    };
+
+    struct Layer {
+        ItemQueue queue;
+        size_t queueBytes = 0;
+        size_t limitBytes = 0;
+        bool waitingForKeyFrame = false;
+
+        // Queued borrowed frames, changed under the lock
+        std::atomic<uint32_t> borrowedCount = 0;
+    };
+
+    void threadFunc();
+
+    void enqueueVideoItem(size_t layerIndex, Item&& item, bool isKeyFrame);
+    void releaseLocked(Item& item);
+    void releaseQueueLocked(Layer& layer);
+
+    void refillBudget(int64_t now);
+    // Leaves the layer waiting for a key frame, asking for one is up to the caller
+    void shedLayer(size_t layerIndex);
+    void requestKeyFrameLocked(size_t layerIndex);
+    [[nodiscard]] size_t getTotalLimitBytes() const;
+    [[nodiscard]] Layer* findOldestLayer();
+
+    const SendFunc mVideoSender;
+    const SendFunc mAudioSender;
+    const ReleaseFunc mBorrowReleaser;
+    const KeyFrameFunc mKeyFrameRequester;
+
+    std::mutex mMutex;
+    std::condition_variable mCond;
+    bool mQuit;
+
+    ItemQueue mAudioQueue;
+    std::array<Layer, kMaxLayerCount> mLayerList;
+    size_t mVideoQueueBytes;
+    uint64_t mNextSeq;
+
+    // Tokens of borrowed frames we're done with, passed to the releaser on our thread
+    std::vector<uint64_t> mReleasedTokenList;
+    std::vector<uint64_t> mReleasingTokenList;
+
+    // The borrowed frame our thread is copying without the lock, cancelBorrowed waits for it
+    bool mIsCopyingBorrowed;
+    bool mIsCopyingCancelled;
+    uint64_t mCopyingToken;
+    std::condition_variable mCopyingCond;
+
+    // For frames copied when too many are borrowed
+    std::vector<std::vector<uint8_t>> mStoragePool;
+
+    // Layers to ask for a key frame on our thread, and when each was last asked
+    uint32_t mKeyFrameRequestMask;
+    std::array<int64_t, kMaxLayerCount> mKeyFrameRequestUsec;
+
+    float mTargetBitrate;
+    double mBudgetBytes;
+    int64_t mBudgetUpdatedUsec;
+
+    uint32_t mDroppedFrames;
+    uint32_t mDelayCount;
+    int64_t mDelaySumUsec;
+    int64_t mDelayMaxUsec;
+
+    std::thread mThread;
+};
+
+} // namespace srtc::android
@@ -0,0 +1,304 @@
+#include "srtc/logging.h"
+#include "srtc/track.h"
+#include "srtc/util.h"
+
+#include "opus.h"
+#include "opus_defines.h"
+
+#include "media_util.h"
+#include "publish_path.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#define LOG(level, ...) srtc::log(level, "PublishPath", __VA_ARGS__)
+
+namespace
+{
+
+// Opus DTX packets this small carry no audio and don't need to be sent
+constexpr opus_int32 kMaxDtxPacketSize = 2;
+
+// Between speech the encoder only makes DTX and comfort noise packets, which don't need its full effort
+constexpr opus_int32 kQuietOpusComplexity = 1;
+
+} // namespace
+
+namespace srtc::android
+{
+
+VideoPublishPath::VideoPublishPath(PublishPacer& pacer, const SimulcastPolicy& simulcastPolicy)
+    : mPacer(pacer)
+    , mSimulcastPolicy(simulcastPolicy)
+    , mDroppedNonReferenceFrames(0)
+{
+}
+
+Error VideoPublishPath::findTarget(const PublishTrackSet& trackSet,
+                                   std::string_view layerName,
+                                   const uint8_t* data,
+                                   size_t size,
+                                   Target& target)
+{
+    target = {};
+
+    if (layerName.empty()) {
+        if (!trackSet.videoSingle) {
+            return { srtc::Error::Code::InvalidData, "Cannot find video track for publishing a video frame" };
+        }
+        target.track = trackSet.videoSingle;
+        target.layerIndex = 0;
+    } else {
+        const auto& trackList = trackSet.videoSimulcastList;
+        for (size_t i = 0; i < trackList.size(); i += 1) {
+            if (trackList[i]->getSimulcastLayer()->name == layerName) {
+                if (mSimulcastPolicy.isSuspended(i)) {
+                    // Java should have paused the encoder already, this covers frames still in flight
+                    return Error::OK;
+                }
+                target.track = trackList[i];
+                target.layerIndex = i;
+                break;
+            }
+        }
+        if (!target.track) {
+            return { srtc::Error::Code::InvalidData, "Cannot find simulcast video track for publishing a video frame" };
+        }
+    }
+
+    if (!checkFrame(target.track->getCodec(), data, size, target.isKeyFrame)) {
+        target.track.reset();
+    }
+    return Error::OK;
+}
+
+Error VideoPublishPath::publish(const PublishTrackSet& trackSet, std::string_view layerName, ByteBuffer&& frame)
+{
+    Target target;
+    if (const auto error = findTarget(trackSet, layerName, frame.data(), frame.size(), target);
+        error.isError() || !target.track) {
+        return error;
+    }
+
+    const auto pts_usec = getStableTimeMicros();
+    mPacer.enqueueVideo(target.track, target.layerIndex, pts_usec, std::move(frame), target.isKeyFrame);
+
+    return Error::OK;
+}
+
+Error VideoPublishPath::publishBorrowed(const PublishTrackSet& trackSet,
+                                        std::string_view layerName,
+                                        const uint8_t* data,
+                                        size_t size,
+                                        uint64_t token,
+                                        bool& isKept)
+{
+    isKept = false;
+
+    Target target;
+    if (const auto error = findTarget(trackSet, layerName, data, size, target); error.isError() || !target.track) {
+        return error;
+    }
+
+    const auto pts_usec = getStableTimeMicros();
+    mPacer.enqueueVideoBorrowed(target.track, target.layerIndex, pts_usec, data, size, token, target.isKeyFrame);
+    isKept = true;
+
+    return Error::OK;
+}
+
+void VideoPublishPath::publishBorrowed(const std::shared_ptr<srtc::Track>& track,
+                                       Codec codec,
+                                       size_t layerIndex,
+                                       const uint8_t* data,
+                                       size_t size,
+                                       uint64_t token,
+                                       bool& isKept)
+{
+    isKept = false;
+
+    bool isKeyFrame = false;
+    if (!checkFrame(codec, data, size, isKeyFrame)) {
+        return;
+    }
+
+    const auto pts_usec = getStableTimeMicros();
+    mPacer.enqueueVideoBorrowed(track, layerIndex, pts_usec, data, size, token, isKeyFrame);
+    isKept = true;
+}
+
+uint32_t VideoPublishPath::getDroppedNonReferenceFrames() const
+{
+    return mDroppedNonReferenceFrames;
+}
+
+bool VideoPublishPath::checkFrame(Codec codec, const uint8_t* data, size_t size, bool& isKeyFrame)
+{
+    if (mSimulcastPolicy.shouldDropNonReference(mPacer.getQueueMillis()) &&
+        isVideoNonReferenceFrame(codec, data, size)) {
+        mDroppedNonReferenceFrames += 1;
+        return false;
+    }
+
+    isKeyFrame = isVideoKeyFrame(codec, data, size);
+    return true;
+}
+
+AudioPublishPath::AudioPublishPath(PublishPacer& pacer)
+    : mPacer(pacer)
+    , mOpusEncoder(nullptr)
+    , mOpusPts(0)
+    , mOpusOutput()
+    , mOpusComplexity(0)
+    , mIsOpusQuiet(false)
+    , mLastAudioPacketSize(0)
+    , mSuppressedAudioFrames(0)
+    , mSuppressedAudioBytes(0)
+    , mRedOpusPayloadId(-1)
+    , mRedDepth(1)
+    , mIsOpusRedApplied(false)
+    , mRedOutput()
+{
+}
+
+AudioPublishPath::~AudioPublishPath()
+{
+    free(mOpusEncoder);
+}
+
+Error AudioPublishPath::publish(const std::shared_ptr<srtc::Track>& track,
+                                const void* frame,
+                                size_t size,
+                                int sampleRate,
+                                int channels,
+                                bool isDropping)
+{
+    if (mOpusEncoder == nullptr) {
+        const auto encoderSize = opus_encoder_get_size(channels);
+        mOpusEncoder = static_cast<OpusEncoder*>(malloc(encoderSize));
+        std::memset(mOpusEncoder, 0, encoderSize);
+
+        if (opus_encoder_init(mOpusEncoder, sampleRate, channels, OPUS_APPLICATION_VOIP) != 0) {
+            free(mOpusEncoder);
+            mOpusEncoder = nullptr;
+        } else {
+            opus_encoder_ctl(mOpusEncoder, OPUS_SET_BITRATE(96 * 1024));
+            opus_encoder_ctl(mOpusEncoder, OPUS_SET_INBAND_FEC(1));
+            opus_encoder_ctl(mOpusEncoder, OPUS_SET_PACKET_LOSS_PERC(20));
+            opus_encoder_ctl(mOpusEncoder, OPUS_SET_DTX(1));
+            opus_encoder_ctl(mOpusEncoder, OPUS_GET_COMPLEXITY(&mOpusComplexity));
+            mIsOpusQuiet = false;
+        }
+    }
+
+    if (mOpusEncoder == nullptr) {
+        return Error::OK;
+    }
+
+    // With RED, loss recovery comes from resending previous packets rather than from the encoder's in-band FEC
+    const auto redOpusPayloadId = mRedOpusPayloadId.load();
+    const auto isRedEnabled = redOpusPayloadId >= 0;
+    if (isRedEnabled != mIsOpusRedApplied) {
+        mIsOpusRedApplied = isRedEnabled;
+        opus_encoder_ctl(mOpusEncoder, OPUS_SET_INBAND_FEC(isRedEnabled ? 0 : 1));
+        opus_encoder_ctl(mOpusEncoder, OPUS_SET_PACKET_LOSS_PERC(isRedEnabled ? 0 : 20));
+        mRedEncoder.reset();
+    }
+
+    const auto now = srtc::getStableTimeMicros();
+    if (mOpusPts == 0 || now - mOpusPts > 100 * 1000) {
+        mOpusPts = now;
+    }
+
+    // Number of samples
+    const auto frame_size = static_cast<int>(size / sizeof(opus_int16) / channels);
+    const auto frame_micros = static_cast<int>(frame_size * 1000l * 1000l / sampleRate);
+
+    // The timeline advances for suppressed frames too, so the receiver sees a gap rather than a time shift
+    const auto pts_usec = mOpusPts;
+    mOpusPts += frame_micros;
+
+    // The detector's hangover covers word endings, so the encoder is only turned down once speech is really over
+    const auto samples = static_cast<const opus_int16*>(frame);
+    const auto isSpeech = mVoiceActivity.process(samples, static_cast<size_t>(frame_size * channels), frame_micros);
+    if (isSpeech == mIsOpusQuiet) {
+        mIsOpusQuiet = !isSpeech;
+        opus_encoder_ctl(mOpusEncoder, OPUS_SET_COMPLEXITY(isSpeech ? mOpusComplexity : kQuietOpusComplexity));
+        opus_encoder_ctl(mOpusEncoder, OPUS_SET_SIGNAL(isSpeech ? OPUS_SIGNAL_VOICE : OPUS_AUTO));
+    }
+
+    // Every frame still goes to the encoder, which decides on DTX itself and needs the audio to keep its state. In
+    // silence most of its packets are DTX frames, which aren't sent, and its comfort noise updates are regular packets.
+    const auto encodedSize = opus_encode(
+        mOpusEncoder, samples, frame_size, mOpusOutput.data(), static_cast<opus_int32>(mOpusOutput.size()));
+
+    if (encodedSize > 0 && encodedSize <= kMaxDtxPacketSize) {
+        // What the frame would have cost, estimated from the last packet, likely comfort noise itself
+        mSuppressedAudioFrames += 1;
+        mSuppressedAudioBytes += static_cast<uint32_t>(mLastAudioPacketSize);
+    } else if (encodedSize > 0 && isDropping) {
+        // While reconnecting, we keep encoding to preserve the encoder's state and timeline, the packet is dropped
+        mLastAudioPacketSize = static_cast<size_t>(encodedSize);
+    } else if (encodedSize > 0) {
+        mLastAudioPacketSize = static_cast<size_t>(encodedSize);
+
+        // The packet is copied at its actual size rather than holding on to a worst case buffer while it's queued
+        const uint8_t* payload = mOpusOutput.data();
+        auto payloadSize = static_cast<size_t>(encodedSize);
+        if (isRedEnabled) {
+            payloadSize = mRedEncoder.encode(static_cast<uint8_t>(redOpusPayloadId),
+                                             mOpusOutput.data(),
+                                             payloadSize,
+                                             pts_usec,
+                                             mRedDepth.load(),
+                                             mRedOutput.data(),
+                                             mRedOutput.size());
+            payload = mRedOutput.data();
+        }
+
+        if (payloadSize > 0) {
+            mPacer.enqueueAudio(track, pts_usec, ByteBuffer{ payload, payloadSize });
+        }
+    }
+
+    return Error::OK;
+}
+
+void AudioPublishPath::setRedPayloadId(int opusPayloadId)
+{
+    mRedOpusPayloadId = opusPayloadId;
+}
+
+bool AudioPublishPath::isRedEnabled() const
+{
+    return mRedOpusPayloadId >= 0;
+}
+
+void AudioPublishPath::updateRedDepth(float packetsLostPercent)
+{
+    if (isRedEnabled()) {
+        mRedDepth = static_cast<uint32_t>(RedEncoder::selectDepth(packetsLostPercent, mRedDepth.load()));
+    }
+}
+
+uint32_t AudioPublishPath::getRedDepth() const
+{
+    return mRedDepth;
+}
+
+float AudioPublishPath::getLevelDb() const
+{
+    return mVoiceActivity.getLevelDb();
+}
+
+uint32_t AudioPublishPath::getSuppressedFrames() const
+{
+    return mSuppressedAudioFrames;
+}
+
+uint32_t AudioPublishPath::getSuppressedBytes() const
+{
+    return mSuppressedAudioBytes;
+}
+
+} // namespace srtc::android
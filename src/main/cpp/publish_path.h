@@ -0,0 +1,143 @@
+#pragma once
+
+#include "srtc/byte_buffer.h"
+#include "srtc/error.h"
+#include "srtc/peer_connection.h"
+
+#include "audio_red.h"
+#include "publish_pacer.h"
+#include "simulcast_policy.h"
+#include "voice_activity.h"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+struct OpusEncoder;
+
+namespace srtc
+{
+class Track;
+} // namespace srtc
+
+namespace srtc::android
+{
+
+// The per-frame part of publishing, from the encoded video frame or the raw audio samples to the pacer. There is no
+// JNI or connection here: JavaPeerConnection calls these for every frame, and srtc_alloc_test (see alloc_test.cpp)
+// calls the same code to check it against the allocation budget.
+
+// The tracks from the answer, replaced as a whole by initTracks so other threads can keep using the ones they have
+struct PublishTrackSet {
+    std::shared_ptr<srtc::Track> videoSingle;
+    std::vector<std::shared_ptr<srtc::Track>> videoSimulcastList;
+    std::shared_ptr<srtc::Track> audio;
+};
+
+class VideoPublishPath
+{
+public:
+    // A null track means the frame should be dropped
+    struct Target {
+        std::shared_ptr<srtc::Track> track;
+        size_t layerIndex;
+        bool isKeyFrame;
+    };
+
+    VideoPublishPath(PublishPacer& pacer, const SimulcastPolicy& simulcastPolicy);
+
+    // An empty layer name is the single video track
+    [[nodiscard]] Error findTarget(const PublishTrackSet& trackSet,
+                                   std::string_view layerName,
+                                   const uint8_t* data,
+                                   size_t size,
+                                   Target& target);
+
+    [[nodiscard]] Error publish(const PublishTrackSet& trackSet, std::string_view layerName, ByteBuffer&& frame);
+
+    // When the frame is kept, its token comes back through the pacer's release function. Otherwise it's still the
+    // caller's, including on errors.
+    [[nodiscard]] Error publishBorrowed(const PublishTrackSet& trackSet,
+                                        std::string_view layerName,
+                                        const uint8_t* data,
+                                        size_t size,
+                                        uint64_t token,
+                                        bool& isKept);
+
+    // The same for a track that's already been looked up
+    void publishBorrowed(const std::shared_ptr<srtc::Track>& track,
+                         Codec codec,
+                         size_t layerIndex,
+                         const uint8_t* data,
+                         size_t size,
+                         uint64_t token,
+                         bool& isKept);
+
+    [[nodiscard]] uint32_t getDroppedNonReferenceFrames() const;
+
+private:
+    // False for a non-reference frame dropped because the pacer is backed up
+    [[nodiscard]] bool checkFrame(Codec codec, const uint8_t* data, size_t size, bool& isKeyFrame);
+
+    PublishPacer& mPacer;
+    const SimulcastPolicy& mSimulcastPolicy;
+    std::atomic<uint32_t> mDroppedNonReferenceFrames;
+};
+
+class AudioPublishPath
+{
+public:
+    explicit AudioPublishPath(PublishPacer& pacer);
+    ~AudioPublishPath();
+
+    AudioPublishPath(const AudioPublishPath&) = delete;
+    AudioPublishPath& operator=(const AudioPublishPath&) = delete;
+
+    // Interleaved 16 bit samples, only called from one thread at a time. While dropping, frames are still encoded to
+    // keep the encoder's state and timeline, and the packets are thrown away. Between speech, as voice activity
+    // detection sees it, the encoder runs at a low complexity.
+    [[nodiscard]] Error publish(const std::shared_ptr<srtc::Track>& track,
+                                const void* frame,
+                                size_t size,
+                                int sampleRate,
+                                int channels,
+                                bool isDropping);
+
+    // RED (see audio_red.h), a payload id of -1 is plain Opus. The depth follows the loss rate.
+    void setRedPayloadId(int opusPayloadId);
+    [[nodiscard]] bool isRedEnabled() const;
+    void updateRedDepth(float packetsLostPercent);
+    [[nodiscard]] uint32_t getRedDepth() const;
+
+    // Of the last frame, for the publishing thread
+    [[nodiscard]] float getLevelDb() const;
+
+    // DTX frames that weren't sent, and what they would have cost
+    [[nodiscard]] uint32_t getSuppressedFrames() const;
+    [[nodiscard]] uint32_t getSuppressedBytes() const;
+
+private:
+    PublishPacer& mPacer;
+
+    OpusEncoder* mOpusEncoder;
+    int64_t mOpusPts;
+    std::array<uint8_t, 4000> mOpusOutput;
+    int32_t mOpusComplexity;
+    bool mIsOpusQuiet;
+    VoiceActivityDetector mVoiceActivity;
+    size_t mLastAudioPacketSize;
+    std::atomic<uint32_t> mSuppressedAudioFrames;
+    std::atomic<uint32_t> mSuppressedAudioBytes;
+
+    std::atomic<int> mRedOpusPayloadId;
+    std::atomic<uint32_t> mRedDepth;
+    bool mIsOpusRedApplied;
+    RedEncoder mRedEncoder;
+    std::array<uint8_t, 6144> mRedOutput;
+};
+
+} // namespace srtc::android
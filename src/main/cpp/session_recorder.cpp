@@ -0,0 +1,314 @@
+#include "srtc/logging.h"
+#include "srtc/util.h"
+
+#include "session_recorder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include <pthread.h>
+
+#define LOG(level, ...) srtc::log(level, "SessionRecorder", __VA_ARGS__)
+
+namespace
+{
+
+using srtc::android::TelemetrySample;
+
+constexpr uint16_t kFileVersion = 1;
+
+enum ColumnType : uint8_t {
+    kColumnTypeU32 = 0,
+    kColumnTypeF32 = 1,
+};
+
+struct Column {
+    const char* name;
+    ColumnType type;
+    size_t offset;
+};
+
+#define COLUMN(name, type) { #name, type, offsetof(srtc::android::TelemetrySample, name) }
+
+const Column kColumnList[] = {
+    COLUMN(time_ms, kColumnTypeU32),
+    COLUMN(packet_count, kColumnTypeU32),
+    COLUMN(byte_count, kColumnTypeU32),
+    COLUMN(packets_lost_percent, kColumnTypeF32),
+    COLUMN(rtt_ms, kColumnTypeF32),
+    COLUMN(bandwidth_actual_kbit_per_second, kColumnTypeF32),
+    COLUMN(bandwidth_suggested_kbit_per_second, kColumnTypeF32),
+    COLUMN(pacer_queue_frames, kColumnTypeU32),
+    COLUMN(pacer_queue_bytes, kColumnTypeU32),
+    COLUMN(pacer_delay_avg_ms, kColumnTypeF32),
+    COLUMN(pacer_delay_max_ms, kColumnTypeF32),
+    COLUMN(pacer_dropped_frames, kColumnTypeU32),
+    COLUMN(suspended_layer_count, kColumnTypeU32),
+    COLUMN(encoded_frames, kColumnTypeU32),
+    COLUMN(encode_avg_ms, kColumnTypeF32),
+    COLUMN(encode_max_ms, kColumnTypeF32),
+    COLUMN(key_frame_requests, kColumnTypeU32),
+    COLUMN(audio_level_avg_db, kColumnTypeF32),
+    COLUMN(audio_level_max_db, kColumnTypeF32),
+};
+
+#undef COLUMN
+
+constexpr int32_t kNoAudioLevel = -100 * 100;
+
+// Android and the hosts we convert on are all little endian
+template <typename T>
+bool writeValue(FILE* file, T value)
+{
+    return std::fwrite(&value, sizeof(value), 1, file) == 1;
+}
+
+void writeFile(const std::string& path, int64_t startUnixMillis, const std::vector<TelemetrySample>& list)
+{
+    // Written next to the target and renamed, so a reader never sees half a file
+    const auto tempPath = path + ".tmp";
+    const auto file = std::fopen(tempPath.c_str(), "wb");
+    if (file == nullptr) {
+        LOG(SRTC_LOG_E, "Cannot create %s", tempPath.c_str());
+        return;
+    }
+
+    constexpr auto columnCount = sizeof(kColumnList) / sizeof(kColumnList[0]);
+
+    auto ok = std::fwrite("SRTL", 4, 1, file) == 1;
+    ok = ok && writeValue<uint16_t>(file, kFileVersion);
+    ok = ok && writeValue<uint16_t>(file, static_cast<uint16_t>(columnCount));
+    ok = ok && writeValue<uint32_t>(file, static_cast<uint32_t>(list.size()));
+    ok = ok && writeValue<int64_t>(file, startUnixMillis);
+
+    for (const auto& column : kColumnList) {
+        const auto nameSize = std::strlen(column.name);
+        ok = ok && writeValue<uint8_t>(file, column.type);
+        ok = ok && writeValue<uint8_t>(file, static_cast<uint8_t>(nameSize));
+        ok = ok && std::fwrite(column.name, nameSize, 1, file) == 1;
+    }
+
+    // Both column types are four bytes
+    for (const auto& column : kColumnList) {
+        for (const auto& sample : list) {
+            ok = ok && std::fwrite(reinterpret_cast<const uint8_t*>(&sample) + column.offset, 4, 1, file) == 1;
+        }
+    }
+
+    ok = std::fclose(file) == 0 && ok;
+    if (!ok || std::rename(tempPath.c_str(), path.c_str()) != 0) {
+        LOG(SRTC_LOG_E, "Error writing %s", path.c_str());
+        std::remove(tempPath.c_str());
+        return;
+    }
+
+    LOG(SRTC_LOG_V, "Wrote %zu samples to %s", list.size(), path.c_str());
+}
+
+// One thread for all recorders, started on first use and never stopped, so that handing off a dump never waits for an
+// earlier one. It's never destroyed either, which keeps it out of the way of static destructors at exit.
+class DumpWriter
+{
+public:
+    static DumpWriter& get()
+    {
+        static auto* const writer = new DumpWriter;
+        return *writer;
+    }
+
+    void post(std::string&& path, int64_t startUnixMillis, std::vector<TelemetrySample>&& list)
+    {
+        {
+            std::lock_guard lock(mMutex);
+
+            // A newer dump of the same session replaces one that's still waiting
+            const auto iter = std::find_if(
+                mDumpList.begin(), mDumpList.end(), [&path](const Dump& dump) { return dump.path == path; });
+            if (iter != mDumpList.end()) {
+                iter->list = std::move(list);
+            } else {
+                mDumpList.push_back(Dump{ std::move(path), startUnixMillis, std::move(list) });
+            }
+        }
+        mCond.notify_one();
+    }
+
+private:
+    struct Dump {
+        std::string path;
+        int64_t startUnixMillis;
+        std::vector<TelemetrySample> list;
+    };
+
+    DumpWriter()
+    {
+        std::thread([this] { threadFunc(); }).detach();
+    }
+
+    void threadFunc()
+    {
+        pthread_setname_np(pthread_self(), "srtc-telemetry");
+
+        std::unique_lock lock(mMutex);
+
+        while (true) {
+            if (mDumpList.empty()) {
+                mCond.wait(lock);
+                continue;
+            }
+
+            auto dump = std::move(mDumpList.front());
+            mDumpList.pop_front();
+
+            lock.unlock();
+            writeFile(dump.path, dump.startUnixMillis, dump.list);
+            lock.lock();
+        }
+    }
+
+    std::mutex mMutex;
+    std::condition_variable mCond;
+    std::deque<Dump> mDumpList;
+};
+
+} // namespace
+
+namespace srtc::android
+{
+
+SessionRecorder::SessionRecorder()
+    : mStartUnixMillis(std::chrono::duration_cast<std::chrono::milliseconds>(
+                           std::chrono::system_clock::now().time_since_epoch())
+                           .count())
+    , mStartUsec(getStableTimeMicros())
+    , mSampleList(kMaxSampleCount)
+    , mSampleNext(0)
+    , mSampleCount(0)
+    , mIsDumpPending(false)
+    , mEncodeSumUsec(0)
+    , mEncodeCount(0)
+    , mEncodeMaxUsec(0)
+    , mKeyFrameRequests(0)
+    , mAudioLevelSum(0)
+    , mAudioLevelCount(0)
+    , mAudioLevelMax(kNoAudioLevel)
+{
+}
+
+SessionRecorder::~SessionRecorder()
+{
+    // Whatever wasn't written yet, the writer takes a copy so this doesn't wait for the file
+    dumpAsync();
+}
+
+void SessionRecorder::setPath(const std::string& path)
+{
+    std::lock_guard lock(mPathMutex);
+    mPath = path;
+}
+
+void SessionRecorder::addEncodeTime(int64_t usec)
+{
+    const auto value = static_cast<uint32_t>(std::clamp<int64_t>(usec, 0, UINT32_MAX));
+
+    mEncodeSumUsec += value;
+    mEncodeCount += 1;
+
+    auto max = mEncodeMaxUsec.load();
+    while (value > max && !mEncodeMaxUsec.compare_exchange_weak(max, value)) {
+    }
+}
+
+void SessionRecorder::addKeyFrameRequest()
+{
+    mKeyFrameRequests += 1;
+}
+
+void SessionRecorder::addAudioLevel(float levelDb)
+{
+    const auto value = static_cast<int32_t>(levelDb * 100.0f);
+
+    mAudioLevelSum += value;
+    mAudioLevelCount += 1;
+
+    auto max = mAudioLevelMax.load();
+    while (value > max && !mAudioLevelMax.compare_exchange_weak(max, value)) {
+    }
+}
+
+void SessionRecorder::addSample(const PublishConnectionStats& stats,
+                                const PublishPacer::Stats& pacerStats,
+                                uint32_t suspendedLayerCount)
+{
+    auto& sample = mSampleList[mSampleNext];
+
+    sample.time_ms = static_cast<uint32_t>((getStableTimeMicros() - mStartUsec) / 1000);
+    sample.packet_count = stats.packet_count;
+    sample.byte_count = stats.byte_count;
+    sample.packets_lost_percent = stats.packets_lost_percent;
+    sample.rtt_ms = stats.rtt_ms;
+    sample.bandwidth_actual_kbit_per_second = stats.bandwidth_actual_kbit_per_second;
+    sample.bandwidth_suggested_kbit_per_second = stats.bandwidth_suggested_kbit_per_second;
+    sample.pacer_queue_frames = pacerStats.queue_frames;
+    sample.pacer_queue_bytes = pacerStats.queue_bytes;
+    sample.pacer_delay_avg_ms = pacerStats.delay_avg_ms;
+    sample.pacer_delay_max_ms = pacerStats.delay_max_ms;
+    sample.pacer_dropped_frames = pacerStats.dropped_frames;
+    sample.suspended_layer_count = suspendedLayerCount;
+
+    // The counters start over for the next sample
+    const auto encodeSumUsec = mEncodeSumUsec.exchange(0);
+    const auto encodeCount = mEncodeCount.exchange(0);
+    const auto encodeMaxUsec = mEncodeMaxUsec.exchange(0);
+    sample.encoded_frames = encodeCount;
+    sample.encode_avg_ms = encodeCount == 0 ? 0.0f : static_cast<float>(encodeSumUsec) / encodeCount / 1000.0f;
+    sample.encode_max_ms = static_cast<float>(encodeMaxUsec) / 1000.0f;
+
+    sample.key_frame_requests = mKeyFrameRequests.exchange(0);
+
+    const auto audioLevelSum = mAudioLevelSum.exchange(0);
+    const auto audioLevelCount = mAudioLevelCount.exchange(0);
+    const auto audioLevelMax = mAudioLevelMax.exchange(kNoAudioLevel);
+    sample.audio_level_avg_db = audioLevelCount == 0 ? kNoAudioLevel / 100.0f
+                                                     : static_cast<float>(audioLevelSum) / audioLevelCount / 100.0f;
+    sample.audio_level_max_db = static_cast<float>(audioLevelMax) / 100.0f;
+
+    mSampleNext = (mSampleNext + 1) % kMaxSampleCount;
+    mSampleCount = std::min(mSampleCount + 1, kMaxSampleCount);
+    mIsDumpPending = true;
+}
+
+void SessionRecorder::dumpAsync()
+{
+    if (!mIsDumpPending) {
+        return;
+    }
+
+    std::string path;
+    {
+        std::lock_guard lock(mPathMutex);
+        path = mPath;
+    }
+    if (path.empty()) {
+        return;
+    }
+
+    // Oldest first
+    std::vector<TelemetrySample> list;
+    list.reserve(mSampleCount);
+    for (size_t i = 0; i < mSampleCount; i += 1) {
+        list.push_back(mSampleList[(mSampleNext + kMaxSampleCount - mSampleCount + i) % kMaxSampleCount]);
+    }
+    mIsDumpPending = false;
+
+    DumpWriter::get().post(std::move(path), mStartUnixMillis, std::move(list));
+}
+
+} // namespace srtc::android
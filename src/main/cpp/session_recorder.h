@@ -0,0 +1,102 @@
+#pragma once
+
+#include "srtc/peer_connection.h"
+
+#include "publish_pacer.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace srtc::android
+{
+
+// Keeps the last kMaxSampleCount samples of a session, one per stats callback (about a second), in a fixed ring so
+// memory doesn't grow with the session. Samples are added on srtc's network thread, which is the only writer. The
+// encoder, audio and key frame request counters in between are atomics. The ring is written out when the connection
+// fails or closes, and when we're destroyed, by a writer thread shared by all recorders that nobody waits for.
+//
+// The file is columnar, everything little endian:
+//
+// char[4]  magic "SRTL"
+// u16      version
+// u16      column count
+// u32      row count
+// i64      session start, unix millis
+// for each column: u8 type (0 = u32, 1 = f32), u8 name length, name
+// for each column: row count values of its type
+//
+// tools/telemetry_to_csv.cpp converts it to CSV.
+
+struct TelemetrySample {
+    uint32_t time_ms;
+    uint32_t packet_count;
+    uint32_t byte_count;
+    float packets_lost_percent;
+    float rtt_ms;
+    float bandwidth_actual_kbit_per_second;
+    float bandwidth_suggested_kbit_per_second;
+    uint32_t pacer_queue_frames;
+    uint32_t pacer_queue_bytes;
+    float pacer_delay_avg_ms;
+    float pacer_delay_max_ms;
+    uint32_t pacer_dropped_frames;
+    uint32_t suspended_layer_count;
+    uint32_t encoded_frames;
+    float encode_avg_ms;
+    float encode_max_ms;
+    uint32_t key_frame_requests;
+    float audio_level_avg_db;
+    float audio_level_max_db;
+};
+
+class SessionRecorder
+{
+public:
+    static constexpr size_t kMaxSampleCount = 3600;
+
+    SessionRecorder();
+    ~SessionRecorder();
+
+    // Empty disables writing
+    void setPath(const std::string& path);
+
+    // Any thread
+    void addEncodeTime(int64_t usec);
+    void addKeyFrameRequest();
+    void addAudioLevel(float levelDb);
+
+    // On the network thread
+    void addSample(const PublishConnectionStats& stats,
+                   const PublishPacer::Stats& pacerStats,
+                   uint32_t suspendedLayerCount);
+    void dumpAsync();
+
+private:
+    const int64_t mStartUnixMillis;
+    const int64_t mStartUsec;
+
+    // Written on the network thread only
+    std::vector<TelemetrySample> mSampleList;
+    size_t mSampleNext;
+    size_t mSampleCount;
+    bool mIsDumpPending;
+
+    std::atomic<uint64_t> mEncodeSumUsec;
+    std::atomic<uint32_t> mEncodeCount;
+    std::atomic<uint32_t> mEncodeMaxUsec;
+    std::atomic<uint32_t> mKeyFrameRequests;
+
+    // Hundredths of a dB, to keep them integer
+    std::atomic<int64_t> mAudioLevelSum;
+    std::atomic<uint32_t> mAudioLevelCount;
+    std::atomic<int32_t> mAudioLevelMax;
+
+    std::mutex mPathMutex;
+    std::string mPath;
+};
+
+} // namespace srtc::android
@@ -0,0 +1,138 @@
+#include "srtc/logging.h"
+
+#include "simulcast_policy.h"
+
+#define LOG(level, ...) srtc::log(level, "SimulcastPolicy", __VA_ARGS__)
+
+namespace
+{
+
+// How much more than a layer's bitrate the estimate needs to be, and for how long, before the layer is resumed
+constexpr auto kResumeHeadroom = 1.25f;
+constexpr int64_t kResumeDelayUsec = 3 * 1000 * 1000;
+
+// Start dropping non-reference frames once this much video is waiting in the pacer
+constexpr auto kDropNonReferenceQueueMillis = 100.0f;
+
+} // namespace
+
+namespace srtc::android
+{
+
+SimulcastPolicy::SimulcastPolicy()
+    : mActiveCount(0)
+    , mResumeSinceUsec(0)
+    , mSuspendedMask(0)
+    , mIsUnderPressure(false)
+{
+}
+
+void SimulcastPolicy::setLayerList(const std::vector<uint32_t>& kilobitsPerSecondList)
+{
+    std::lock_guard lock(mMutex);
+
+    mLayerList = kilobitsPerSecondList;
+    mActiveCount = mLayerList.size();
+    mResumeSinceUsec = 0;
+
+    mSuspendedMask = 0;
+    mIsUnderPressure = false;
+}
+
+std::vector<SimulcastPolicy::Change> SimulcastPolicy::update(float suggestedKilobitsPerSecond, int64_t nowUsec)
+{
+    std::lock_guard lock(mMutex);
+
+    std::vector<Change> changeList;
+
+    if (mLayerList.empty() || suggestedKilobitsPerSecond <= 0.0f) {
+        // No simulcast or no estimate yet
+        return changeList;
+    }
+
+    const auto fitCount = getFittingCount(suggestedKilobitsPerSecond, 1.0f);
+    if (fitCount < mActiveCount) {
+        // Suspend right away, from the top down
+        for (auto i = mActiveCount; i > fitCount; i -= 1) {
+            changeList.push_back({ i - 1, true });
+        }
+        mActiveCount = fitCount;
+        mResumeSinceUsec = 0;
+    } else if (getFittingCount(suggestedKilobitsPerSecond, kResumeHeadroom) > mActiveCount) {
+        // Resume one layer at a time, once the estimate has been stable for a while
+        if (mResumeSinceUsec == 0) {
+            mResumeSinceUsec = nowUsec;
+        } else if (nowUsec - mResumeSinceUsec >= kResumeDelayUsec) {
+            changeList.push_back({ mActiveCount, false });
+            mActiveCount += 1;
+            mResumeSinceUsec = 0;
+        }
+    } else {
+        mResumeSinceUsec = 0;
+    }
+
+    uint32_t mask = 0;
+    uint32_t activeKilobitsPerSecond = 0;
+    for (size_t i = 0; i < mLayerList.size(); i += 1) {
+        if (i >= mActiveCount) {
+            mask |= 1u << i;
+        } else {
+            activeKilobitsPerSecond += mLayerList[i];
+        }
+    }
+
+    mSuspendedMask = mask;
+    mIsUnderPressure = suggestedKilobitsPerSecond < static_cast<float>(activeKilobitsPerSecond);
+
+    for (const auto& change : changeList) {
+        LOG(SRTC_LOG_V,
+            "Layer %zu %s, estimate %.2f kb/s",
+            change.layerIndex,
+            change.suspended ? "suspended" : "resumed",
+            suggestedKilobitsPerSecond);
+    }
+
+    return changeList;
+}
+
+bool SimulcastPolicy::isSuspended(size_t layerIndex) const
+{
+    return (mSuspendedMask.load() & (1u << layerIndex)) != 0;
+}
+
+uint32_t SimulcastPolicy::getSuspendedCount() const
+{
+    auto mask = mSuspendedMask.load();
+
+    uint32_t count = 0;
+    while (mask != 0) {
+        count += mask & 1u;
+        mask >>= 1;
+    }
+
+    return count;
+}
+
+bool SimulcastPolicy::shouldDropNonReference(float queueMillis) const
+{
+    return mIsUnderPressure || queueMillis > kDropNonReferenceQueueMillis;
+}
+
+size_t SimulcastPolicy::getFittingCount(float kilobitsPerSecond, float headroom) const
+{
+    // The lowest layer is always sent
+    size_t count = 1;
+    auto cumulative = static_cast<float>(mLayerList[0]);
+
+    for (size_t i = 1; i < mLayerList.size(); i += 1) {
+        cumulative += static_cast<float>(mLayerList[i]);
+        if (cumulative * headroom > kilobitsPerSecond) {
+            break;
+        }
+        count = i + 1;
+    }
+
+    return count;
+}
+
+} // namespace srtc::android
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace srtc::android
+{
+
+// Decides which simulcast layers to send based on the bandwidth estimate. Layers are suspended from the top down when
+// the estimate falls below their cumulative bitrate, and resumed one at a time once there is enough headroom.
+
+class SimulcastPolicy
+{
+public:
+    struct Change {
+        size_t layerIndex;
+        bool suspended;
+    };
+
+    SimulcastPolicy();
+
+    // Index zero is the most important (lowest bitrate) layer
+    void setLayerList(const std::vector<uint32_t>& kilobitsPerSecondList);
+
+    [[nodiscard]] std::vector<Change> update(float suggestedKilobitsPerSecond, int64_t nowUsec);
+
+    [[nodiscard]] bool isSuspended(size_t layerIndex) const;
+    [[nodiscard]] uint32_t getSuspendedCount() const;
+
+    // Non-reference frames can be dropped without hurting the decoder, so shed them before a queue builds
+    [[nodiscard]] bool shouldDropNonReference(float queueMillis) const;
+
+private:
+    [[nodiscard]] size_t getFittingCount(float kilobitsPerSecond, float headroom) const;
+
+    std::mutex mMutex;
+    std::vector<uint32_t> mLayerList;
+    size_t mActiveCount;
+    int64_t mResumeSinceUsec;
+
+    // Read on the publishing threads
+    std::atomic<uint32_t> mSuspendedMask;
+    std::atomic<bool> mIsUnderPressure;
+};
+
+} // namespace srtc::android
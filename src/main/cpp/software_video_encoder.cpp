@@ -0,0 +1,508 @@
+#include "srtc/logging.h"
+
+#include "software_video_encoder.h"
+
+#ifdef SRTC_SOFTWARE_H264
+#include "wels/codec_api.h"
+#endif
+
+#include <algorithm>
+#include <cstring>
+
+#define LOG(level, ...) srtc::log(level, "SoftwareVideoEncoder", __VA_ARGS__)
+
+namespace
+{
+
+struct Picture {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t strideY = 0;
+    uint32_t strideUV = 0;
+    std::vector<uint8_t> data;
+    uint8_t* y = nullptr;
+    uint8_t* u = nullptr;
+    uint8_t* v = nullptr;
+
+    void init(uint32_t w, uint32_t h)
+    {
+        width = w;
+        height = h;
+        strideY = w;
+        strideUV = w / 2;
+        data.resize(static_cast<size_t>(w) * h * 3 / 2);
+        y = data.data();
+        u = y + static_cast<size_t>(strideY) * h;
+        v = u + static_cast<size_t>(strideUV) * (h / 2);
+    }
+};
+
+// BT.601 limited range, the same as the hardware encoders get from the GL path
+void convertRgbaToI420(const uint8_t* rgba, size_t stride, Picture& dst)
+{
+    for (uint32_t y = 0; y < dst.height; y += 2) {
+        const auto src0 = rgba + y * stride;
+        const auto src1 = src0 + stride;
+        const auto dstY0 = dst.y + y * dst.strideY;
+        const auto dstY1 = dstY0 + dst.strideY;
+        const auto dstU = dst.u + (y / 2) * dst.strideUV;
+        const auto dstV = dst.v + (y / 2) * dst.strideUV;
+
+        for (uint32_t x = 0; x < dst.width; x += 2) {
+            const auto p00 = src0 + x * 4;
+            const auto p01 = p00 + 4;
+            const auto p10 = src1 + x * 4;
+            const auto p11 = p10 + 4;
+
+            dstY0[x] = static_cast<uint8_t>(((66 * p00[0] + 129 * p00[1] + 25 * p00[2] + 128) >> 8) + 16);
+            dstY0[x + 1] = static_cast<uint8_t>(((66 * p01[0] + 129 * p01[1] + 25 * p01[2] + 128) >> 8) + 16);
+            dstY1[x] = static_cast<uint8_t>(((66 * p10[0] + 129 * p10[1] + 25 * p10[2] + 128) >> 8) + 16);
+            dstY1[x + 1] = static_cast<uint8_t>(((66 * p11[0] + 129 * p11[1] + 25 * p11[2] + 128) >> 8) + 16);
+
+            const auto r = (p00[0] + p01[0] + p10[0] + p11[0] + 2) >> 2;
+            const auto g = (p00[1] + p01[1] + p10[1] + p11[1] + 2) >> 2;
+            const auto b = (p00[2] + p01[2] + p10[2] + p11[2] + 2) >> 2;
+
+            dstU[x / 2] = static_cast<uint8_t>(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+            dstV[x / 2] = static_cast<uint8_t>(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+        }
+    }
+}
+
+void scalePlane(const uint8_t* src,
+                uint32_t srcWidth,
+                uint32_t srcHeight,
+                uint32_t srcStride,
+                uint8_t* dst,
+                uint32_t dstWidth,
+                uint32_t dstHeight,
+                uint32_t dstStride)
+{
+    if (srcWidth == dstWidth && srcHeight == dstHeight) {
+        for (uint32_t y = 0; y < dstHeight; y += 1) {
+            std::memcpy(dst + y * dstStride, src + y * srcStride, dstWidth);
+        }
+        return;
+    }
+
+    if (srcWidth == dstWidth * 2 && srcHeight == dstHeight * 2) {
+        // The usual simulcast step, a 2x2 box
+        for (uint32_t y = 0; y < dstHeight; y += 1) {
+            const auto row0 = src + 2 * y * srcStride;
+            const auto row1 = row0 + srcStride;
+            const auto out = dst + y * dstStride;
+            for (uint32_t x = 0; x < dstWidth; x += 1) {
+                out[x] = static_cast<uint8_t>((row0[2 * x] + row0[2 * x + 1] + row1[2 * x] + row1[2 * x + 1] + 2) >> 2);
+            }
+        }
+        return;
+    }
+
+    // Bilinear with pixel centers lined up, 16.16 fixed point
+    const auto position = [](uint32_t i, uint32_t srcSize, uint32_t dstSize) {
+        const auto pos = (static_cast<int64_t>(2 * i + 1) * srcSize << 16) / (2 * dstSize) - 0x8000;
+        return std::clamp<int64_t>(pos, 0, static_cast<int64_t>(srcSize - 1) << 16);
+    };
+
+    for (uint32_t y = 0; y < dstHeight; y += 1) {
+        const auto posY = position(y, srcHeight, dstHeight);
+        const auto y0 = static_cast<uint32_t>(posY >> 16);
+        const auto y1 = std::min(y0 + 1, srcHeight - 1);
+        const auto wy = static_cast<uint32_t>((posY >> 8) & 0xff);
+        const auto row0 = src + y0 * srcStride;
+        const auto row1 = src + y1 * srcStride;
+        const auto out = dst + y * dstStride;
+
+        for (uint32_t x = 0; x < dstWidth; x += 1) {
+            const auto posX = position(x, srcWidth, dstWidth);
+            const auto x0 = static_cast<uint32_t>(posX >> 16);
+            const auto x1 = std::min(x0 + 1, srcWidth - 1);
+            const auto wx = static_cast<uint32_t>((posX >> 8) & 0xff);
+
+            const auto top = row0[x0] * (256 - wx) + row0[x1] * wx;
+            const auto bottom = row1[x0] * (256 - wx) + row1[x1] * wx;
+            out[x] = static_cast<uint8_t>((top * (256 - wy) + bottom * wy + 32768) >> 16);
+        }
+    }
+}
+
+void scalePicture(const Picture& src, Picture& dst)
+{
+    scalePlane(src.y, src.width, src.height, src.strideY, dst.y, dst.width, dst.height, dst.strideY);
+    scalePlane(src.u, src.width / 2, src.height / 2, src.strideUV, dst.u, dst.width / 2, dst.height / 2, dst.strideUV);
+    scalePlane(src.v, src.width / 2, src.height / 2, src.strideUV, dst.v, dst.width / 2, dst.height / 2, dst.strideUV);
+}
+
+} // namespace
+
+namespace srtc::android
+{
+
+class SoftwareVideoEncoder::Layer
+{
+public:
+    Layer(size_t index, const SoftwareVideoLayer& config);
+    ~Layer();
+
+    [[nodiscard]] Error init(uint32_t threadCount);
+    [[nodiscard]] Error encode(int64_t pts_usec, const OutputFunc& output);
+
+    const size_t mIndex; // In the caller's list
+    const SoftwareVideoLayer mConfig;
+    Picture mPicture;
+    std::atomic<bool> mIsSuspended;
+    std::atomic<bool> mIsKeyFrameRequested;
+
+private:
+    std::vector<uint8_t> mOutput;
+#ifdef SRTC_SOFTWARE_H264
+    ISVCEncoder* mEncoder;
+#endif
+};
+
+SoftwareVideoEncoder::Layer::Layer(size_t index, const SoftwareVideoLayer& config)
+    : mIndex(index)
+    , mConfig(config)
+    , mIsSuspended(false)
+    , mIsKeyFrameRequested(false)
+#ifdef SRTC_SOFTWARE_H264
+    , mEncoder(nullptr)
+#endif
+{
+    mPicture.init(config.width, config.height);
+}
+
+SoftwareVideoEncoder::Layer::~Layer()
+{
+#ifdef SRTC_SOFTWARE_H264
+    if (mEncoder) {
+        mEncoder->Uninitialize();
+        WelsDestroySVCEncoder(mEncoder);
+    }
+#endif
+}
+
+#ifdef SRTC_SOFTWARE_H264
+
+Error SoftwareVideoEncoder::Layer::init(uint32_t threadCount)
+{
+    if (WelsCreateSVCEncoder(&mEncoder) != 0 || mEncoder == nullptr) {
+        return { Error::Code::InvalidData, "Cannot create the OpenH264 encoder" };
+    }
+
+    // Small layers don't have enough macroblock rows to be worth splitting
+    const auto mbRowCount = (mConfig.height + 15) / 16;
+    const auto sliceCount = std::clamp<uint32_t>(mbRowCount / 8, 1, std::max<uint32_t>(threadCount, 1));
+
+    SEncParamExt params;
+    mEncoder->GetDefaultParams(&params);
+
+    params.iUsageType = CAMERA_VIDEO_REAL_TIME;
+    params.iPicWidth = static_cast<int>(mConfig.width);
+    params.iPicHeight = static_cast<int>(mConfig.height);
+    params.iTargetBitrate = static_cast<int>(mConfig.kilobits_per_second * 1024);
+    params.iMaxBitrate = params.iTargetBitrate * 3 / 2;
+    params.iRCMode = RC_BITRATE_MODE;
+    params.fMaxFrameRate = static_cast<float>(mConfig.frames_per_second);
+    params.iTemporalLayerNum = 1;
+    params.iSpatialLayerNum = 1;
+    params.bEnableFrameSkip = true;
+    params.bEnableDenoise = false;
+    params.bEnableSceneChangeDetect = true;
+    params.bEnableLongTermReference = false;
+    params.iNumRefFrame = 1;
+    params.iEntropyCodingModeFlag = 0;
+    params.iComplexityMode = LOW_COMPLEXITY;
+    params.eSpsPpsIdStrategy = CONSTANT_ID;
+    params.uiIntraPeriod = mConfig.frames_per_second * 2; // Same as the MediaCodec encoders
+    params.iMultipleThreadIdc = static_cast<unsigned short>(sliceCount);
+
+    auto& spatial = params.sSpatialLayers[0];
+    spatial.iVideoWidth = params.iPicWidth;
+    spatial.iVideoHeight = params.iPicHeight;
+    spatial.fFrameRate = params.fMaxFrameRate;
+    spatial.iSpatialBitrate = params.iTargetBitrate;
+    spatial.iMaxSpatialBitrate = params.iMaxBitrate;
+    spatial.uiProfileIdc = PRO_BASELINE;
+    if (sliceCount > 1) {
+        spatial.sSliceArgument.uiSliceMode = SM_FIXEDSLCNUM_SLICE;
+        spatial.sSliceArgument.uiSliceNum = sliceCount;
+    } else {
+        spatial.sSliceArgument.uiSliceMode = SM_SINGLE_SLICE;
+    }
+
+    if (mEncoder->InitializeExt(&params) != cmResultSuccess) {
+        return { Error::Code::InvalidData, "Cannot initialize the OpenH264 encoder" };
+    }
+
+    int format = videoFormatI420;
+    mEncoder->SetOption(ENCODER_OPTION_DATAFORMAT, &format);
+
+    mOutput.reserve(mPicture.data.size() / 4);
+
+    LOG(SRTC_LOG_V,
+        "Layer %zu: %ux%u, %u kbps, %u fps, %u slices",
+        mIndex,
+        mConfig.width,
+        mConfig.height,
+        mConfig.kilobits_per_second,
+        mConfig.frames_per_second,
+        sliceCount);
+
+    return Error::OK;
+}
+
+Error SoftwareVideoEncoder::Layer::encode(int64_t pts_usec, const OutputFunc& output)
+{
+    SSourcePicture source = {};
+    source.iColorFormat = videoFormatI420;
+    source.iPicWidth = static_cast<int>(mPicture.width);
+    source.iPicHeight = static_cast<int>(mPicture.height);
+    source.iStride[0] = static_cast<int>(mPicture.strideY);
+    source.iStride[1] = static_cast<int>(mPicture.strideUV);
+    source.iStride[2] = static_cast<int>(mPicture.strideUV);
+    source.pData[0] = mPicture.y;
+    source.pData[1] = mPicture.u;
+    source.pData[2] = mPicture.v;
+    source.uiTimeStamp = pts_usec / 1000;
+
+    if (mIsKeyFrameRequested.exchange(false)) {
+        mEncoder->ForceIntraFrame(true);
+    }
+
+    SFrameBSInfo info = {};
+    if (mEncoder->EncodeFrame(&source, &info) != cmResultSuccess) {
+        return { Error::Code::InvalidData, "OpenH264 could not encode a frame" };
+    }
+    if (info.eFrameType == videoFrameTypeSkip || info.eFrameType == videoFrameTypeInvalid) {
+        // Rate control decided to skip it
+        return Error::OK;
+    }
+
+    // The NAL units of each layer are contiguous, with start codes
+    mOutput.clear();
+    for (int i = 0; i < info.iLayerNum; i += 1) {
+        const auto& layer = info.sLayerInfo[i];
+        size_t size = 0;
+        for (int n = 0; n < layer.iNalCount; n += 1) {
+            size += static_cast<size_t>(layer.pNalLengthInByte[n]);
+        }
+        mOutput.insert(mOutput.end(), layer.pBsBuf, layer.pBsBuf + size);
+    }
+
+    if (!mOutput.empty()) {
+        output(mIndex, mOutput.data(), mOutput.size(), info.eFrameType == videoFrameTypeIDR);
+    }
+
+    return Error::OK;
+}
+
+#else
+
+Error SoftwareVideoEncoder::Layer::init(uint32_t threadCount)
+{
+    return { Error::Code::InvalidData, "Built without SRTC_SOFTWARE_H264" };
+}
+
+Error SoftwareVideoEncoder::Layer::encode(int64_t pts_usec, const OutputFunc& output)
+{
+    return { Error::Code::InvalidData, "Built without SRTC_SOFTWARE_H264" };
+}
+
+#endif
+
+bool SoftwareVideoEncoder::isAvailable()
+{
+#ifdef SRTC_SOFTWARE_H264
+    return true;
+#else
+    return false;
+#endif
+}
+
+Error SoftwareVideoEncoder::create(const std::vector<SoftwareVideoLayer>& layerList,
+                                   uint32_t threadCount,
+                                   const OutputFunc& output,
+                                   const ThreadFunc& onThread,
+                                   std::unique_ptr<SoftwareVideoEncoder>& encoder)
+{
+    if (!isAvailable()) {
+        return { Error::Code::InvalidData, "Built without SRTC_SOFTWARE_H264" };
+    }
+    if (layerList.empty()) {
+        return { Error::Code::InvalidData, "No layers for the software video encoder" };
+    }
+
+    std::unique_ptr<SoftwareVideoEncoder> res(new SoftwareVideoEncoder(output, onThread));
+
+    for (size_t i = 0; i < layerList.size(); i += 1) {
+        const auto& config = layerList[i];
+        if (config.width < 16 || config.height < 16 || (config.width % 2) != 0 || (config.height % 2) != 0) {
+            return { Error::Code::InvalidData, "Software video encoder layer sizes must be even, and at least 16" };
+        }
+        res->mLayerList.push_back(std::make_unique<Layer>(i, config));
+    }
+
+    // Largest first, so each layer can be scaled from the one before it
+    std::stable_sort(res->mLayerList.begin(), res->mLayerList.end(), [](const auto& a, const auto& b) {
+        return a->mConfig.width > b->mConfig.width;
+    });
+    for (size_t i = 1; i < res->mLayerList.size(); i += 1) {
+        if (res->mLayerList[i]->mConfig.height > res->mLayerList[i - 1]->mConfig.height) {
+            return { Error::Code::InvalidData, "Software video encoder layers must get smaller in both dimensions" };
+        }
+    }
+
+    for (const auto& layer : res->mLayerList) {
+        if (const auto error = layer->init(threadCount); error.isError()) {
+            return error;
+        }
+    }
+
+    res->mWidth = res->mLayerList.front()->mConfig.width;
+    res->mHeight = res->mLayerList.front()->mConfig.height;
+    res->mPendingFrame.resize(static_cast<size_t>(res->mWidth) * res->mHeight * 4);
+    res->mWorkingFrame.resize(res->mPendingFrame.size());
+
+    res->mThread = std::thread(&SoftwareVideoEncoder::threadFunc, res.get());
+
+    encoder = std::move(res);
+    return Error::OK;
+}
+
+SoftwareVideoEncoder::SoftwareVideoEncoder(const OutputFunc& output, const ThreadFunc& onThread)
+    : mOutput(output)
+    , mOnThread(onThread)
+    , mWidth(0)
+    , mHeight(0)
+    , mPendingPts(0)
+    , mWorkingPts(0)
+    , mIsPending(false)
+    , mIsQuit(false)
+    , mStats()
+{
+}
+
+SoftwareVideoEncoder::~SoftwareVideoEncoder()
+{
+    {
+        std::lock_guard lock(mMutex);
+        mIsQuit = true;
+    }
+    mCond.notify_one();
+
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+}
+
+Error SoftwareVideoEncoder::submit(const uint8_t* rgba,
+                                   size_t stride,
+                                   uint32_t width,
+                                   uint32_t height,
+                                   int64_t pts_usec)
+{
+    if (width != mWidth || height != mHeight || stride < static_cast<size_t>(width) * 4) {
+        return { Error::Code::InvalidData, "Raw video frame doesn't match the software encoder's size" };
+    }
+
+    {
+        std::lock_guard lock(mMutex);
+
+        const auto rowSize = static_cast<size_t>(width) * 4;
+        for (uint32_t y = 0; y < height; y += 1) {
+            std::memcpy(mPendingFrame.data() + y * rowSize, rgba + y * stride, rowSize);
+        }
+
+        mStats.submitted_frames += 1;
+        if (mIsPending) {
+            mStats.replaced_frames += 1;
+        }
+        mIsPending = true;
+        mPendingPts = pts_usec;
+    }
+    mCond.notify_one();
+
+    return Error::OK;
+}
+
+void SoftwareVideoEncoder::requestKeyFrame()
+{
+    for (const auto& layer : mLayerList) {
+        layer->mIsKeyFrameRequested = true;
+    }
+}
+
+void SoftwareVideoEncoder::requestKeyFrame(size_t layerIndex)
+{
+    for (const auto& layer : mLayerList) {
+        if (layer->mIndex == layerIndex) {
+            layer->mIsKeyFrameRequested = true;
+        }
+    }
+}
+
+void SoftwareVideoEncoder::setSuspended(size_t layerIndex, bool suspended)
+{
+    for (const auto& layer : mLayerList) {
+        if (layer->mIndex == layerIndex) {
+            layer->mIsSuspended = suspended;
+            if (!suspended) {
+                // The native side waits for a key frame after a layer is resumed
+                layer->mIsKeyFrameRequested = true;
+            }
+        }
+    }
+}
+
+SoftwareVideoEncoder::Stats SoftwareVideoEncoder::getStats() const
+{
+    std::lock_guard lock(mMutex);
+    return mStats;
+}
+
+void SoftwareVideoEncoder::threadFunc()
+{
+    if (mOnThread) {
+        mOnThread();
+    }
+
+    while (true) {
+        {
+            std::unique_lock lock(mMutex);
+            mCond.wait(lock, [this] { return mIsPending || mIsQuit; });
+            if (mIsQuit) {
+                break;
+            }
+
+            std::swap(mPendingFrame, mWorkingFrame);
+            mWorkingPts = mPendingPts;
+            mIsPending = false;
+        }
+
+        encodeFrame();
+    }
+}
+
+void SoftwareVideoEncoder::encodeFrame()
+{
+    // Suspended layers are still scaled, the smaller ones are scaled from them
+    convertRgbaToI420(mWorkingFrame.data(), static_cast<size_t>(mWidth) * 4, mLayerList.front()->mPicture);
+    for (size_t i = 1; i < mLayerList.size(); i += 1) {
+        scalePicture(mLayerList[i - 1]->mPicture, mLayerList[i]->mPicture);
+    }
+
+    for (const auto& layer : mLayerList) {
+        if (layer->mIsSuspended) {
+            continue;
+        }
+        if (const auto error = layer->encode(mWorkingPts, mOutput); error.isError()) {
+            LOG(SRTC_LOG_E, "Error encoding layer %zu: %s", layer->mIndex, error.message.c_str());
+        }
+    }
+
+    std::lock_guard lock(mMutex);
+    mStats.encoded_frames += 1;
+}
+
+} // namespace srtc::android
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "srtc/error.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace srtc::android
+{
+
+// H.264 encoding in software with OpenH264, for devices where the MediaCodec encoder is missing, broken or too slow.
+// Built with SRTC_SOFTWARE_H264 (see CMakeLists.txt), otherwise create() returns an error.
+//
+// Frames come in as RGBA at the size of the largest layer. They're converted to I420 once, and each smaller layer is
+// scaled from the next larger one, so simulcast costs one full size pass plus progressively smaller ones. Every layer
+// has its own encoder instance, which splits frames into slices and encodes them on its own threads.
+//
+// The work happens on our thread. submit() only copies the frame, and if the thread is still busy with the previous
+// one, the waiting frame is replaced, so a slow encoder lowers the frame rate rather than building up latency.
+
+struct SoftwareVideoLayer {
+    std::string name; // Empty when not simulcast
+    uint32_t width;
+    uint32_t height;
+    uint32_t kilobits_per_second;
+    uint32_t frames_per_second;
+};
+
+class SoftwareVideoEncoder
+{
+public:
+    struct Stats {
+        uint32_t submitted_frames;
+        uint32_t replaced_frames;
+        uint32_t encoded_frames;
+    };
+
+    // Called on our thread, once per layer that produced output. The frame is Annex B, a key frame starts with the
+    // SPS and PPS.
+    using OutputFunc = std::function<void(size_t layerIndex, const uint8_t* data, size_t size, bool isKeyFrame)>;
+
+    // Called on our thread when it starts
+    using ThreadFunc = std::function<void()>;
+
+    [[nodiscard]] static bool isAvailable();
+
+    [[nodiscard]] static Error create(const std::vector<SoftwareVideoLayer>& layerList,
+                                      uint32_t threadCount,
+                                      const OutputFunc& output,
+                                      const ThreadFunc& onThread,
+                                      std::unique_ptr<SoftwareVideoEncoder>& encoder);
+
+    ~SoftwareVideoEncoder();
+
+    [[nodiscard]] Error submit(const uint8_t* rgba, size_t stride, uint32_t width, uint32_t height, int64_t pts_usec);
+
+    // Any thread
+    void requestKeyFrame();
+    void requestKeyFrame(size_t layerIndex);
+    void setSuspended(size_t layerIndex, bool suspended);
+
+    [[nodiscard]] Stats getStats() const;
+
+private:
+    class Layer;
+
+    SoftwareVideoEncoder(const OutputFunc& output, const ThreadFunc& onThread);
+
+    void threadFunc();
+    void encodeFrame();
+
+    const OutputFunc mOutput;
+    const ThreadFunc mOnThread;
+
+    // Largest first, each is scaled from the one before it
+    std::vector<std::unique_ptr<Layer>> mLayerList;
+    uint32_t mWidth;
+    uint32_t mHeight;
+
+    // Filled by submit(), swapped with the working one by our thread
+    mutable std::mutex mMutex;
+    std::condition_variable mCond;
+    std::vector<uint8_t> mPendingFrame;
+    std::vector<uint8_t> mWorkingFrame;
+    int64_t mPendingPts;
+    int64_t mWorkingPts;
+    bool mIsPending;
+    bool mIsQuit;
+    Stats mStats;
+
+    std::thread mThread;
+};
+
+} // namespace srtc::android
@@ -0,0 +1,206 @@
+// Checks the thread policy (see thread_policy.h) against a real kernel. A busy thread is started for each role, the
+// policies pin them to different CPUs with sched_setaffinity, half of them before the thread is seen and half after.
+// While they spin, the affinity the kernel reports, the CPU they run on and the stats from /proc are compared with
+// what was asked for. The encode thread picks SCHED_BATCH for itself first, which the policy has to leave alone.
+//
+// Built with -DSRTC_THREAD_BENCH=ON, push to a device and run:
+//
+//   adb push srtc_thread_bench /data/local/tmp && adb shell /data/local/tmp/srtc_thread_bench [seconds] [rt priority]
+//
+// With an rt priority, the send thread is also put on SCHED_FIFO and then back, which usually needs root. It has no
+// Android dependencies, so a desktop Linux build works too. The exit code is 1 if a check fails.
+
+#include "thread_policy.h"
+
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include <sched.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+namespace
+{
+
+using srtc::android::ThreadPolicy;
+using srtc::android::ThreadPolicyRegistry;
+using srtc::android::ThreadRole;
+
+constexpr size_t kRoleCount = srtc::android::kThreadRoleCount;
+
+const char* const kRoleNameList[kRoleCount] = { "network", "send", "audio", "encode" };
+
+std::atomic<uint32_t> gFailCount = 0;
+
+void check(bool ok, const char* what, size_t index)
+{
+    if (!ok) {
+        std::fprintf(stderr, "FAIL: %s: %s\n", kRoleNameList[index], what);
+        gFailCount += 1;
+    }
+}
+
+struct Worker {
+    std::thread thread;
+    std::atomic<pid_t> tid = 0;
+    std::atomic<uint32_t> wrongCpuCount = 0;
+    int cpu = -1;
+};
+
+void spin(ThreadPolicyRegistry& registry, size_t index, Worker& worker, const std::atomic<bool>& stop)
+{
+    if (index == static_cast<size_t>(ThreadRole::Encode)) {
+        sched_param param = {};
+        if (sched_setscheduler(0, SCHED_BATCH, &param) != 0) {
+            std::perror("sched_setscheduler(SCHED_BATCH)");
+        }
+    }
+
+    registry.onThread(static_cast<ThreadRole>(index));
+    worker.tid = srtc::android::getCurrentThreadId();
+
+    volatile uint64_t sum = 0;
+    while (!stop) {
+        for (uint32_t i = 0; i < 100000; i += 1) {
+            sum = sum + i;
+        }
+
+        // Only checked once the policy is in, some are applied after the thread has started
+        const auto expected = worker.cpu;
+        const auto actual = sched_getcpu();
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (sched_getaffinity(0, sizeof(set), &set) == 0 && CPU_COUNT(&set) == 1 && CPU_ISSET(expected, &set) &&
+            actual != expected) {
+            worker.wrongCpuCount += 1;
+        }
+    }
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    const auto seconds = argc > 1 ? std::atof(argv[1]) : 2.0;
+    const auto rtPriority = argc > 2 ? std::atoi(argv[2]) : 0;
+
+    // The CPUs we're allowed on, the roles go round robin across them
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        std::perror("sched_getaffinity");
+        return 1;
+    }
+    std::vector<int> cpuList;
+    for (int cpu = 0; cpu < 64 && cpu < CPU_SETSIZE; cpu += 1) {
+        if (CPU_ISSET(cpu, &allowed)) {
+            cpuList.push_back(cpu);
+        }
+    }
+    if (cpuList.empty()) {
+        std::fprintf(stderr, "No usable CPUs\n");
+        return 1;
+    }
+
+    ThreadPolicyRegistry registry;
+    std::array<Worker, kRoleCount> workerList;
+    std::array<ThreadPolicy, kRoleCount> policyList = {};
+    std::atomic<bool> stop = false;
+
+    for (size_t index = 0; index < kRoleCount; index += 1) {
+        workerList[index].cpu = cpuList[index % cpuList.size()];
+        policyList[index] = { 1ull << workerList[index].cpu, static_cast<int>(index), 0 };
+    }
+
+    // The first half is waiting when their threads show up
+    for (size_t index = 0; index < kRoleCount / 2; index += 1) {
+        (void)registry.setPolicy(static_cast<ThreadRole>(index), policyList[index]);
+    }
+    for (size_t index = 0; index < kRoleCount; index += 1) {
+        auto& worker = workerList[index];
+        worker.thread = std::thread([&registry, index, &worker, &stop] { spin(registry, index, worker, stop); });
+    }
+    for (const auto& worker : workerList) {
+        while (worker.tid == 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    // And the second half is applied to the running threads
+    for (size_t index = kRoleCount / 2; index < kRoleCount; index += 1) {
+        const auto error = registry.setPolicy(static_cast<ThreadRole>(index), policyList[index]);
+        check(error.isOk(), "setPolicy on a running thread", index);
+    }
+
+    if (rtPriority > 0) {
+        const auto index = static_cast<size_t>(ThreadRole::Send);
+        const auto tid = workerList[index].tid.load();
+
+        auto policy = policyList[index];
+        policy.rt_priority = rtPriority;
+        if (const auto error = registry.setPolicy(ThreadRole::Send, policy); error.isError()) {
+            std::printf("SCHED_FIFO not applied: %s\n", error.message.c_str());
+        } else {
+            check(sched_getscheduler(tid) == SCHED_FIFO, "SCHED_FIFO applied", index);
+        }
+
+        (void)registry.setPolicy(ThreadRole::Send, policyList[index]);
+        check(sched_getscheduler(tid) == SCHED_OTHER, "back to SCHED_OTHER", index);
+    }
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+
+    std::printf(
+        "%-8s %7s %4s %4s %9s %9s %8s %6s\n", "role", "tid", "cpu", "last", "user ms", "sys ms", "nice", "wrong");
+
+    const auto statsList = registry.getStats();
+    check(statsList.size() == kRoleCount, "stats for every role", 0);
+
+    for (const auto& stats : statsList) {
+        const auto index = static_cast<size_t>(stats.role);
+        const auto& worker = workerList[index];
+
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        const auto ok = sched_getaffinity(stats.tid, sizeof(set), &set) == 0;
+        check(ok && CPU_COUNT(&set) == 1 && CPU_ISSET(worker.cpu, &set), "affinity", index);
+        check(stats.last_cpu == worker.cpu, "last cpu from /proc", index);
+        check(stats.cpu_user_ms + stats.cpu_system_ms > 0, "cpu time from /proc", index);
+        check(worker.wrongCpuCount == 0, "ran on another cpu", index);
+
+        const auto scheduler = sched_getscheduler(stats.tid);
+        check(scheduler == (stats.role == ThreadRole::Encode ? SCHED_BATCH : SCHED_OTHER), "scheduler", index);
+
+        errno = 0;
+        const auto nice = getpriority(PRIO_PROCESS, static_cast<id_t>(stats.tid));
+        check(errno == 0 && nice == policyList[index].nice, "nice", index);
+
+        std::printf("%-8s %7d %4d %4d %9lld %9lld %8d %6u\n",
+                    kRoleNameList[index],
+                    static_cast<int>(stats.tid),
+                    worker.cpu,
+                    stats.last_cpu,
+                    static_cast<long long>(stats.cpu_user_ms),
+                    static_cast<long long>(stats.cpu_system_ms),
+                    nice,
+                    worker.wrongCpuCount.load());
+    }
+
+    stop = true;
+    for (auto& worker : workerList) {
+        worker.thread.join();
+    }
+
+    if (gFailCount != 0) {
+        std::printf("%u checks failed\n", gFailCount.load());
+        return 1;
+    }
+
+    std::printf("All checks passed\n");
+    return 0;
+}
@@ -0,0 +1,202 @@
+#include "srtc/logging.h"
+
+#include "thread_policy.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define LOG(level, ...) srtc::log(level, "ThreadPolicy", __VA_ARGS__)
+
+namespace
+{
+
+srtc::Error makeSystemError(const char* what)
+{
+    return { srtc::Error::Code::InvalidData, std::string(what) + ": " + std::strerror(errno) };
+}
+
+} // namespace
+
+namespace srtc::android
+{
+
+ThreadPolicyRegistry::ThreadPolicyRegistry()
+{
+    for (auto& tid : mThreadIdList) {
+        tid = 0;
+    }
+    mRealtimeList.fill(false);
+}
+
+Error ThreadPolicyRegistry::setPolicy(ThreadRole role, const ThreadPolicy& policy)
+{
+    const auto index = static_cast<size_t>(role);
+    if (index >= kThreadRoleCount) {
+        return { Error::Code::InvalidData, "Invalid thread role" };
+    }
+
+    std::lock_guard lock(mMutex);
+
+    mPolicyList[index] = policy;
+
+    const auto tid = mThreadIdList[index].load();
+    if (tid != 0) {
+        const auto error = applyThreadPolicy(tid, policy, mRealtimeList[index]);
+        if (error.isOk()) {
+            mRealtimeList[index] = policy.rt_priority > 0;
+        }
+        return error;
+    }
+
+    return Error::OK;
+}
+
+void ThreadPolicyRegistry::onThread(ThreadRole role)
+{
+    const auto index = static_cast<size_t>(role);
+    const auto tid = getCurrentThreadId();
+
+    if (mThreadIdList[index].load(std::memory_order_relaxed) == tid) {
+        return;
+    }
+
+    std::lock_guard lock(mMutex);
+
+    mThreadIdList[index] = tid;
+    mRealtimeList[index] = false;
+
+    if (const auto& policy = mPolicyList[index]) {
+        if (const auto error = applyThreadPolicy(tid, *policy, false); error.isError()) {
+            LOG(SRTC_LOG_E, "Error applying the policy to thread %d: %s", tid, error.message.c_str());
+        } else {
+            mRealtimeList[index] = policy->rt_priority > 0;
+        }
+    }
+}
+
+std::vector<ThreadPolicyRegistry::ThreadStats> ThreadPolicyRegistry::getStats() const
+{
+    std::vector<ThreadStats> list;
+
+    for (size_t index = 0; index < kThreadRoleCount; index += 1) {
+        const auto tid = mThreadIdList[index].load();
+        if (tid == 0) {
+            continue;
+        }
+
+        ThreadStats stats = { static_cast<ThreadRole>(index), tid, 0, 0, -1 };
+        if (readThreadCpuTime(tid, stats.cpu_user_ms, stats.cpu_system_ms, stats.last_cpu)) {
+            list.push_back(stats);
+        }
+    }
+
+    return list;
+}
+
+pid_t getCurrentThreadId()
+{
+    static thread_local const auto tid = static_cast<pid_t>(syscall(SYS_gettid));
+    return tid;
+}
+
+Error applyThreadPolicy(pid_t tid, const ThreadPolicy& policy, bool wasRealtime)
+{
+    if (policy.cpu_mask != 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu = 0; cpu < 64 && cpu < CPU_SETSIZE; cpu += 1) {
+            if (policy.cpu_mask & (1ull << cpu)) {
+                CPU_SET(cpu, &set);
+            }
+        }
+        if (sched_setaffinity(tid, sizeof(set), &set) != 0) {
+            return makeSystemError("sched_setaffinity");
+        }
+    }
+
+    // On Linux these work on individual threads
+    if (policy.rt_priority > 0) {
+        sched_param param = {};
+        param.sched_priority = policy.rt_priority;
+        if (sched_setscheduler(tid, SCHED_FIFO, &param) != 0) {
+            return makeSystemError("sched_setscheduler");
+        }
+    } else {
+        // Only undo our own SCHED_FIFO, the thread's owner may have picked its scheduler for a reason
+        if (wasRealtime) {
+            sched_param param = {};
+            if (sched_setscheduler(tid, SCHED_OTHER, &param) != 0) {
+                return makeSystemError("sched_setscheduler");
+            }
+        }
+        if (setpriority(PRIO_PROCESS, static_cast<id_t>(tid), policy.nice) != 0) {
+            return makeSystemError("setpriority");
+        }
+    }
+
+    LOG(SRTC_LOG_V,
+        "Thread %d: mask 0x%llx, nice %d, rt priority %d",
+        tid,
+        static_cast<unsigned long long>(policy.cpu_mask),
+        policy.nice,
+        policy.rt_priority);
+
+    return Error::OK;
+}
+
+bool readThreadCpuTime(pid_t tid, int64_t& userMs, int64_t& systemMs, int& lastCpu)
+{
+    char path[64];
+    std::snprintf(path, sizeof(path), "/proc/self/task/%d/stat", static_cast<int>(tid));
+
+    const auto file = std::fopen(path, "r");
+    if (file == nullptr) {
+        return false;
+    }
+
+    char line[1024];
+    const auto ok = std::fgets(line, sizeof(line), file) != nullptr;
+    std::fclose(file);
+    if (!ok) {
+        return false;
+    }
+
+    // The thread name is in parentheses and can contain spaces, the fields we want come after it
+    const auto nameEnd = std::strrchr(line, ')');
+    if (nameEnd == nullptr) {
+        return false;
+    }
+
+    unsigned long long utime = 0, stime = 0;
+    int processor = -1;
+
+    // Fields 3 (state) through 39 (processor)
+    if (std::sscanf(nameEnd + 1,
+                    " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu %*d %*d %*d %*d %*d %*d %*u %*u %*d %*u"
+                    " %*u %*u %*u %*u %*u %*u %*u %*u %*u %*u %*u %*u %*d %d",
+                    &utime,
+                    &stime,
+                    &processor) != 3) {
+        return false;
+    }
+
+    static const auto ticksPerSecond = sysconf(_SC_CLK_TCK);
+    if (ticksPerSecond <= 0) {
+        return false;
+    }
+
+    userMs = static_cast<int64_t>(utime * 1000 / ticksPerSecond);
+    systemMs = static_cast<int64_t>(stime * 1000 / ticksPerSecond);
+    lastCpu = processor;
+
+    return true;
+}
+
+} // namespace srtc::android
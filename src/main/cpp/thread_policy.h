@@ -0,0 +1,75 @@
+#pragma once
+
+#include "srtc/error.h"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include <sys/types.h>
+
+namespace srtc::android
+{
+
+// CPU placement and scheduling priority for the native threads that carry media. The threads are created by srtc and
+// by the app, so they are recognized when they first call into us, and the policy for their role is applied then (and
+// again if the role moves to a different thread, e.g. the network thread after a reconnect).
+//
+// Nothing in here depends on Android, so it can be tried on a desktop Linux build.
+
+enum class ThreadRole : int {
+    Network = 0, // srtc's networking and timer thread, calls our listeners
+    Send = 1,    // The pacer's thread
+    Audio = 2,   // The app's audio recording thread, which also runs the Opus encoder
+    Encode = 3   // The software video encoder's thread, see software_video_encoder.h
+};
+
+constexpr size_t kThreadRoleCount = 4;
+
+struct ThreadPolicy {
+    uint64_t cpu_mask; // Zero leaves the affinity alone
+    int nice;
+    int rt_priority; // Non-zero selects SCHED_FIFO, which usually needs CAP_SYS_NICE
+};
+
+class ThreadPolicyRegistry
+{
+public:
+    struct ThreadStats {
+        ThreadRole role;
+        pid_t tid;
+        int64_t cpu_user_ms;
+        int64_t cpu_system_ms;
+        int last_cpu;
+    };
+
+    ThreadPolicyRegistry();
+
+    // Applies right away if a thread with this role has already been seen
+    [[nodiscard]] Error setPolicy(ThreadRole role, const ThreadPolicy& policy);
+
+    // Called on the thread itself, cheap after the first time
+    void onThread(ThreadRole role);
+
+    [[nodiscard]] std::vector<ThreadStats> getStats() const;
+
+private:
+    mutable std::mutex mMutex;
+    std::array<std::atomic<pid_t>, kThreadRoleCount> mThreadIdList;
+    std::array<std::optional<ThreadPolicy>, kThreadRoleCount> mPolicyList;
+    std::array<bool, kThreadRoleCount> mRealtimeList; // We put the role's current thread on SCHED_FIFO
+};
+
+[[nodiscard]] pid_t getCurrentThreadId();
+
+// The thread goes back to SCHED_OTHER only if wasRealtime says that an earlier policy of ours took it off
+[[nodiscard]] Error applyThreadPolicy(pid_t tid, const ThreadPolicy& policy, bool wasRealtime);
+
+// From /proc/self/task/<tid>/stat
+[[nodiscard]] bool readThreadCpuTime(pid_t tid, int64_t& userMs, int64_t& systemMs, int& lastCpu);
+
+} // namespace srtc::android
@@ -0,0 +1,92 @@
+#include "voice_activity.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+
+// Levels are in dB relative to full scale
+constexpr auto kSilenceDb = -65.0f;
+constexpr auto kInitialNoiseFloorDb = -50.0f;
+
+// How far above the noise floor speech has to be
+constexpr auto kSpeechMarginDb = 10.0f;
+
+// The floor rises slowly, per second, and falls fast, by this much of the difference per frame
+constexpr auto kNoiseFloorRiseDbPerSecond = 2.0f;
+constexpr auto kNoiseFloorFallRatio = 0.5f;
+
+// The floor doesn't rise during speech, unless it goes on for this long, which is more likely louder background noise
+constexpr int64_t kMaxFrozenUsec = 15 * 1000 * 1000;
+
+constexpr int64_t kHangoverUsec = 300 * 1000;
+
+float calculateLevelDb(const int16_t* samples, size_t sampleCount)
+{
+    if (sampleCount == 0) {
+        return kSilenceDb;
+    }
+
+    double sum = 0.0;
+    for (size_t i = 0; i < sampleCount; i += 1) {
+        const auto value = static_cast<double>(samples[i]);
+        sum += value * value;
+    }
+
+    const auto rms = std::sqrt(sum / static_cast<double>(sampleCount)) / 32768.0;
+    if (rms <= 0.0) {
+        return kSilenceDb;
+    }
+
+    return static_cast<float>(20.0 * std::log10(rms));
+}
+
+} // namespace
+
+namespace srtc::android
+{
+
+VoiceActivityDetector::VoiceActivityDetector()
+    : mNoiseFloorDb(kInitialNoiseFloorDb)
+    , mLevelDb(kSilenceDb)
+    , mHangoverUsec(kHangoverUsec)
+    , mActiveUsec(0)
+{
+}
+
+bool VoiceActivityDetector::process(const int16_t* samples, size_t sampleCount, int64_t frameMicros)
+{
+    const auto levelDb = calculateLevelDb(samples, sampleCount);
+    mLevelDb = levelDb;
+
+    // Update the floor, speech would pull it up towards its own level
+    if (levelDb < mNoiseFloorDb) {
+        mNoiseFloorDb += (levelDb - mNoiseFloorDb) * kNoiseFloorFallRatio;
+    } else if (!isActive() || mActiveUsec >= kMaxFrozenUsec) {
+        mNoiseFloorDb += kNoiseFloorRiseDbPerSecond * static_cast<float>(frameMicros) / 1000000.0f;
+    }
+    mNoiseFloorDb = std::max(mNoiseFloorDb, kSilenceDb);
+
+    const auto isSpeech = levelDb > kSilenceDb && levelDb > mNoiseFloorDb + kSpeechMarginDb;
+    if (isSpeech) {
+        mHangoverUsec = kHangoverUsec;
+    } else {
+        mHangoverUsec = std::max<int64_t>(mHangoverUsec - frameMicros, 0);
+    }
+    mActiveUsec = isActive() ? mActiveUsec + frameMicros : 0;
+
+    return isActive();
+}
+
+bool VoiceActivityDetector::isActive() const
+{
+    return mHangoverUsec > 0;
+}
+
+float VoiceActivityDetector::getLevelDb() const
+{
+    return mLevelDb;
+}
+
+} // namespace srtc::android
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace srtc::android
+{
+
+// Energy based voice activity detection on 16 bit PCM. The noise floor follows the quietest frames down quickly and
+// creeps back up slowly while there's no speech, a frame is speech when it's well above the floor, and a hangover keeps
+// word endings and short pauses from being cut off.
+
+class VoiceActivityDetector
+{
+public:
+    VoiceActivityDetector();
+
+    // Samples are interleaved, returns whether the frame should be treated as speech
+    [[nodiscard]] bool process(const int16_t* samples, size_t sampleCount, int64_t frameMicros);
+
+    [[nodiscard]] bool isActive() const;
+
+    // Of the last processed frame
+    [[nodiscard]] float getLevelDb() const;
+
+private:
+    float mNoiseFloorDb;
+    float mLevelDb;
+    int64_t mHangoverUsec;
+    int64_t mActiveUsec;
+};
+
+} // namespace srtc::android
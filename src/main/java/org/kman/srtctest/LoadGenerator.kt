@@ -0,0 +1,454 @@
+package org.kman.srtctest
+
+import android.content.Context
+import android.os.Handler
+import android.os.HandlerThread
+import android.os.Looper
+import android.os.Process
+import android.os.SystemClock
+import okhttp3.MediaType.Companion.toMediaType
+import okhttp3.Request
+import okhttp3.RequestBody.Companion.toRequestBody
+import okhttp3.Response
+import org.kman.srtctest.rtc.PeerConnection
+import org.kman.srtctest.util.MyLog
+import java.io.File
+import java.nio.ByteBuffer
+import java.nio.ByteOrder
+import java.nio.charset.StandardCharsets
+import java.text.SimpleDateFormat
+import java.util.Date
+import java.util.Locale
+import java.util.concurrent.CopyOnWriteArrayList
+import kotlin.math.PI
+import kotlin.math.sin
+
+/*
+ * Runs many publishing PeerConnections in this one process, to find where per-process scaling falls off.
+ *
+ * The connection count goes up in steps. At each step, once everything is connected, synthetic VP8 shaped video and
+ * sine wave audio (which goes through the real Opus encoder) are published for a while, then the process's RSS,
+ * thread count and CPU are sampled along with the publish call latency. Each step is a line in a CSV file.
+ *
+ * Media comes from two shared threads, one for video and one for audio, so the threads that show up per connection
+ * are srtc's and the bridge's. The receiver is any WHIP server, ideally on the same machine as the device and reached
+ * with "adb reverse", so the network is not what's being measured.
+ */
+class LoadGenerator(
+    private val params: Params,
+    private val outputFile: File,
+    private val listener: Listener
+) {
+
+    class Params(
+        val server: String,
+        val token: String,
+        val stepList: List<Int>,
+        val stepSeconds: Int,
+        val videoKilobitPerSecond: Int,
+        val videoFramesPerSecond: Int,
+        val isAudioEnabled: Boolean
+    )
+
+    interface Listener {
+        fun onLoadProgress(message: String)
+        fun onLoadCompleted()
+    }
+
+    fun start() {
+        mBaseline = readProcessStatus()
+        MyLog.i(TAG, "Baseline: rss %d kB, threads %d", mBaseline.rssKb, mBaseline.threads)
+
+        outputFile.writeText(CSV_HEADER + "\n")
+
+        mVideoThread.start()
+        mAudioThread.start()
+        mVideoHandler = Handler(mVideoThread.looper)
+        mAudioHandler = Handler(mAudioThread.looper)
+
+        startStep(0)
+    }
+
+    fun stop() {
+        if (mIsStopped) {
+            return
+        }
+        mIsStopped = true
+
+        mMainHandler.removeCallbacksAndMessages(null)
+        mVideoThread.quitSafely()
+        mAudioThread.quitSafely()
+        mVideoThread.join()
+        mAudioThread.join()
+
+        for (publisher in mPublisherList) {
+            publisher.release()
+        }
+        mPublisherList.clear()
+
+        listener.onLoadCompleted()
+    }
+
+    private fun startStep(stepIndex: Int) {
+        if (mIsStopped) {
+            return
+        }
+        if (stepIndex >= params.stepList.size) {
+            listener.onLoadProgress("Done, results in ${outputFile.path}")
+            stop()
+            return
+        }
+
+        val count = params.stepList[stepIndex]
+        listener.onLoadProgress("Step ${stepIndex + 1}: connecting $count")
+
+        while (mPublisherList.size < count) {
+            val publisher = Publisher(mPublisherList.size)
+            mPublisherList.add(publisher)
+            publisher.connect()
+        }
+
+        val connectStartMs = SystemClock.elapsedRealtime()
+        waitForConnected(stepIndex, connectStartMs)
+    }
+
+    private fun waitForConnected(stepIndex: Int, connectStartMs: Long) {
+        if (mIsStopped) {
+            return
+        }
+
+        val connectedCount = mPublisherList.count { it.isConnected }
+        val failedCount = mPublisherList.count { it.isFailed }
+        val elapsedMs = SystemClock.elapsedRealtime() - connectStartMs
+
+        if (connectedCount + failedCount < mPublisherList.size && elapsedMs < CONNECT_TIMEOUT_MS) {
+            mMainHandler.postDelayed({ waitForConnected(stepIndex, connectStartMs) }, 100)
+            return
+        }
+
+        MyLog.i(
+            TAG, "Step %d: %d connected, %d failed in %d ms",
+            stepIndex + 1, connectedCount, failedCount, elapsedMs
+        )
+        listener.onLoadProgress("Step ${stepIndex + 1}: $connectedCount connected, measuring")
+
+        // Measure from here, connection setup is not part of the steady state
+        mVideoHandler?.post { mVideoLatency.reset() }
+        mAudioHandler?.post { mAudioLatency.reset() }
+        mStepStartStatus = readProcessStatus()
+        mStepStartCpuMs = Process.getElapsedCpuTime()
+        mStepStartMs = SystemClock.elapsedRealtime()
+
+        if (!mIsMediaRunning) {
+            mIsMediaRunning = true
+            mVideoStartMs = SystemClock.uptimeMillis()
+            mAudioStartMs = mVideoStartMs
+            mVideoHandler?.post { sendVideo() }
+            if (params.isAudioEnabled) {
+                mAudioHandler?.post { sendAudio() }
+            }
+        }
+
+        mMainHandler.postDelayed({ finishStep(stepIndex) }, params.stepSeconds * 1000L)
+    }
+
+    private fun finishStep(stepIndex: Int) {
+        if (mIsStopped) {
+            return
+        }
+
+        val status = readProcessStatus()
+        val wallMs = SystemClock.elapsedRealtime() - mStepStartMs
+        val cpuMs = Process.getElapsedCpuTime() - mStepStartCpuMs
+        val cpuPercent = if (wallMs > 0) 100.0 * cpuMs / wallMs else 0.0
+
+        // The latency arrays belong to the sending threads
+        var videoLatency = LatencySummary()
+        var audioLatency = LatencySummary()
+        mVideoHandler?.blockingCall { videoLatency = mVideoLatency.summarize() }
+        mAudioHandler?.blockingCall { audioLatency = mAudioLatency.summarize() }
+
+        val count = mPublisherList.size
+        val connectedCount = mPublisherList.count { it.isConnected }
+        val pacerDelayMs = mPublisherList.filter { it.isConnected }.map { it.pacerDelayMs }.average()
+
+        val rssPerConnectionKb = (status.rssKb - mBaseline.rssKb).toDouble() / count
+        val threadsPerConnection = (status.threads - mBaseline.threads).toDouble() / count
+
+        val row = String.format(
+            Locale.US,
+            "%d,%d,%d,%.1f,%d,%.2f,%.1f,%.2f,%d,%d,%d,%d,%d,%d,%.2f",
+            count, connectedCount,
+            status.rssKb, rssPerConnectionKb,
+            status.threads, threadsPerConnection,
+            cpuPercent, cpuPercent / count,
+            videoLatency.count, videoLatency.p50Usec, videoLatency.p99Usec,
+            audioLatency.count, audioLatency.p50Usec, audioLatency.p99Usec,
+            if (pacerDelayMs.isNaN()) 0.0 else pacerDelayMs
+        )
+        outputFile.appendText(row + "\n")
+
+        MyLog.i(TAG, "Step %d: %s", stepIndex + 1, row)
+        MyLog.i(
+            TAG, "Step %d: rss %d -> %d kB, threads %d -> %d during the step",
+            stepIndex + 1, mStepStartStatus.rssKb, status.rssKb, mStepStartStatus.threads, status.threads
+        )
+
+        startStep(stepIndex + 1)
+    }
+
+    // Media
+
+    private fun sendVideo() {
+        val frameIntervalMs = 1000L / params.videoFramesPerSecond
+        val frameSize = maxOf(params.videoKilobitPerSecond * 1000 / 8 / params.videoFramesPerSecond, 16)
+        val keyFrameInterval = params.videoFramesPerSecond * KEY_FRAME_INTERVAL_SECONDS
+
+        val frameIndex = mVideoFrameIndex++
+        val isKeyFrame = frameIndex % keyFrameInterval == 0L
+
+        for (publisher in mPublisherList) {
+            if (publisher.isConnected) {
+                val frame = publisher.videoFrame
+                frame.clear()
+                frame.put(0, if (isKeyFrame) VP8_KEY_FRAME_TAG else VP8_DELTA_FRAME_TAG)
+                // Key frames are several times larger
+                frame.limit(if (isKeyFrame) minOf(frameSize * 4, frame.capacity()) else frameSize)
+
+                val ns0 = System.nanoTime()
+                publisher.peerConnection.publishVideoSingleFrame(frame)
+                mVideoLatency.add((System.nanoTime() - ns0) / 1000)
+            }
+        }
+
+        mVideoHandler?.postAtTime({ sendVideo() }, mVideoStartMs + (frameIndex + 1) * frameIntervalMs)
+    }
+
+    private fun sendAudio() {
+        val chunkIndex = mAudioChunkIndex++
+
+        for (publisher in mPublisherList) {
+            if (publisher.isConnected) {
+                val ns0 = System.nanoTime()
+                publisher.peerConnection.publishAudioFrame(
+                    mAudioChunk, mAudioChunk.limit(), AUDIO_SAMPLE_RATE, AUDIO_CHANNELS
+                )
+                mAudioLatency.add((System.nanoTime() - ns0) / 1000)
+            }
+        }
+
+        mAudioHandler?.postAtTime({ sendAudio() }, mAudioStartMs + (chunkIndex + 1) * AUDIO_CHUNK_MS)
+    }
+
+    private inner class Publisher(val index: Int) {
+        val peerConnection = PeerConnection()
+
+        @Volatile
+        var isConnected = false
+
+        @Volatile
+        var isFailed = false
+
+        @Volatile
+        var pacerDelayMs = 0f
+
+        // Larger than any frame we make, written on the video thread
+        val videoFrame: ByteBuffer = ByteBuffer.allocateDirect(
+            maxOf(params.videoKilobitPerSecond * 1000 / 8 / params.videoFramesPerSecond * 4, 1024)
+        )
+
+        fun connect() {
+            peerConnection.setConnectionStateListener { state ->
+                when (state) {
+                    PeerConnection.CONNECTION_STATE_CONNECTED -> isConnected = true
+                    PeerConnection.CONNECTION_STATE_FAILED,
+                    PeerConnection.CONNECTION_STATE_CLOSED -> {
+                        isConnected = false
+                        isFailed = true
+                    }
+                }
+            }
+            peerConnection.setPublishConnectionStatsListener { stats ->
+                pacerDelayMs = stats.pacer_delay_avg_ms
+            }
+
+            val video = PeerConnection.PubVideoConfig().apply {
+                codecList.add(PeerConnection.PubVideoCodec(PeerConnection.VIDEO_CODEC_VP8, 0))
+            }
+            val audio = if (params.isAudioEnabled) {
+                PeerConnection.PubAudioConfig().apply {
+                    codecList.add(
+                        PeerConnection.PubAudioCodec(
+                            PeerConnection.AUDIO_CODEC_OPUS, AUDIO_CHUNK_MS.toInt(), AUDIO_CHANNELS == 2
+                        )
+                    )
+                }
+            } else {
+                null
+            }
+
+            val offer = try {
+                peerConnection.initPublishOffer(PeerConnection.OfferConfig(), video, audio)
+            } catch (x: Exception) {
+                MyLog.i(TAG, "Connection %d: offer error: %s", index, x.message)
+                isFailed = true
+                return
+            }
+
+            val request = Request.Builder().apply {
+                url(params.server)
+                method("POST", offer.toRequestBody("application/sdp".toMediaType()))
+                header("Authorization", "Bearer ${params.token}")
+            }.build()
+
+            HttpClient.execute(request, object : HttpClient.Callback {
+                override fun onCompleted(response: Response?, data: ByteArray?, error: Exception?) {
+                    if (mIsStopped) {
+                        return
+                    }
+                    if (error != null || data == null) {
+                        MyLog.i(TAG, "Connection %d: WHIP error: %s", index, error?.message)
+                        isFailed = true
+                        return
+                    }
+
+                    try {
+                        peerConnection.setPublishAnswer(String(data, StandardCharsets.UTF_8))
+                    } catch (x: Exception) {
+                        MyLog.i(TAG, "Connection %d: answer error: %s", index, x.message)
+                        isFailed = true
+                    }
+                }
+            })
+        }
+
+        fun release() {
+            isConnected = false
+            peerConnection.release()
+        }
+    }
+
+    // Latency samples in microseconds, preallocated so that collecting them doesn't add garbage
+
+    private class LatencySummary(
+        val count: Int = 0,
+        val p50Usec: Long = 0,
+        val p99Usec: Long = 0
+    )
+
+    private class LatencyRecorder {
+        fun reset() {
+            mCount = 0
+        }
+
+        fun add(usec: Long) {
+            if (mCount < mSampleList.size) {
+                mSampleList[mCount++] = usec
+            }
+        }
+
+        fun summarize(): LatencySummary {
+            if (mCount == 0) {
+                return LatencySummary()
+            }
+            val sorted = mSampleList.copyOf(mCount).apply { sort() }
+            return LatencySummary(
+                mCount,
+                sorted[(mCount - 1) * 50 / 100],
+                sorted[(mCount - 1) * 99 / 100]
+            )
+        }
+
+        private val mSampleList = LongArray(MAX_LATENCY_SAMPLES)
+        private var mCount = 0
+    }
+
+    private class ProcessStatus(
+        val rssKb: Long = 0,
+        val threads: Int = 0
+    )
+
+    private fun readProcessStatus(): ProcessStatus {
+        var rssKb = 0L
+        var threads = 0
+        try {
+            File("/proc/self/status").forEachLine { line ->
+                if (line.startsWith("VmRSS:")) {
+                    rssKb = line.substring(6).trim().split(' ')[0].toLong()
+                } else if (line.startsWith("Threads:")) {
+                    threads = line.substring(8).trim().toInt()
+                }
+            }
+        } catch (x: Exception) {
+            MyLog.i(TAG, "Error reading process status: %s", x.message)
+        }
+        return ProcessStatus(rssKb, threads)
+    }
+
+    private val mMainHandler = Handler(Looper.getMainLooper())
+    private val mPublisherList = CopyOnWriteArrayList<Publisher>()
+
+    private val mVideoThread = HandlerThread("LoadVideo")
+    private val mAudioThread = HandlerThread("LoadAudio")
+    private var mVideoHandler: Handler? = null
+    private var mAudioHandler: Handler? = null
+
+    @Volatile
+    private var mIsStopped = false
+    private var mIsMediaRunning = false
+
+    private var mBaseline = ProcessStatus()
+    private var mStepStartStatus = ProcessStatus()
+    private var mStepStartCpuMs = 0L
+    private var mStepStartMs = 0L
+
+    private var mVideoStartMs = 0L
+    private var mVideoFrameIndex = 0L
+    private val mVideoLatency = LatencyRecorder()
+
+    private var mAudioStartMs = 0L
+    private var mAudioChunkIndex = 0L
+    private val mAudioLatency = LatencyRecorder()
+
+    // A 440 Hz tone, loud enough to count as speech
+    private val mAudioChunk: ByteBuffer = ByteBuffer.allocateDirect(
+        (AUDIO_SAMPLE_RATE * AUDIO_CHUNK_MS / 1000).toInt() * AUDIO_CHANNELS * 2
+    ).order(ByteOrder.nativeOrder()).apply {
+        val sampleCount = (AUDIO_SAMPLE_RATE * AUDIO_CHUNK_MS / 1000).toInt()
+        for (i in 0 until sampleCount) {
+            val value = (sin(2.0 * PI * 440.0 * i / AUDIO_SAMPLE_RATE) * 8000.0).toInt().toShort()
+            for (c in 0 until AUDIO_CHANNELS) {
+                putShort(value)
+            }
+        }
+        flip()
+    }
+
+    companion object {
+        private const val TAG = "LoadGenerator"
+
+        // In the app's external files directory, where "adb pull" can get it
+        fun makeOutputFile(context: Context): File {
+            val dir = context.getExternalFilesDir(null) ?: context.filesDir
+            val name = SimpleDateFormat("yyyyMMdd-HHmmss", Locale.US).format(Date())
+            return File(dir, "load-$name.csv")
+        }
+
+        private const val CSV_HEADER =
+            "connections,connected,rss_kb,rss_per_connection_kb,threads,threads_per_connection," +
+                "cpu_percent,cpu_percent_per_connection," +
+                "video_calls,video_p50_us,video_p99_us,audio_calls,audio_p50_us,audio_p99_us,pacer_delay_ms"
+
+        private const val CONNECT_TIMEOUT_MS = 15 * 1000L
+        private const val KEY_FRAME_INTERVAL_SECONDS = 2
+        private const val MAX_LATENCY_SAMPLES = 256 * 1024
+
+        private const val AUDIO_SAMPLE_RATE = 48000
+        private const val AUDIO_CHANNELS = 1
+        private const val AUDIO_CHUNK_MS = 20L
+
+        // RFC 6386 section 9.1, the low bit of the frame tag is zero for key frames
+        private const val VP8_KEY_FRAME_TAG: Byte = 0x10
+        private const val VP8_DELTA_FRAME_TAG: Byte = 0x11
+    }
+}
@@ -0,0 +1,92 @@
+package org.kman.srtctest
+
+import android.app.Activity
+import android.os.Bundle
+import android.widget.TextView
+import org.kman.srtctest.util.MyLog
+
+/*
+ * Runs the LoadGenerator, started from adb:
+ *
+ * adb shell am start -n org.kman.srtctest/.LoadTestActivity \
+ *     --es server http://127.0.0.1:8080/whip --es token test \
+ *     --es steps 1,2,4,8,16,32 --ei seconds 30 --ei video_kbps 1000 --ei video_fps 30 --ez audio true
+ *
+ * Results go to the log and to a CSV file in the app's external files directory. Only debug builds export this
+ * activity (see src/debug/AndroidManifest.xml), LoadGeneratorTest runs the same thing without any UI.
+ */
+class LoadTestActivity : Activity(), LoadGenerator.Listener {
+
+    override fun onCreate(savedInstanceState: Bundle?) {
+        super.onCreate(savedInstanceState)
+
+        mStatusTextView = TextView(this).apply {
+            setPadding(32, 32, 32, 32)
+        }
+        setContentView(mStatusTextView)
+
+        val server = intent.getStringExtra(EXTRA_SERVER)
+        if (server.isNullOrEmpty()) {
+            onLoadProgress(getString(R.string.error_server_missing))
+            return
+        }
+
+        val stepList = (intent.getStringExtra(EXTRA_STEPS) ?: DEFAULT_STEPS)
+            .split(',')
+            .mapNotNull { it.trim().toIntOrNull() }
+            .filter { it > 0 }
+            .sorted()
+
+        val params = LoadGenerator.Params(
+            server = server,
+            token = intent.getStringExtra(EXTRA_TOKEN) ?: "",
+            stepList = stepList,
+            stepSeconds = intent.getIntExtra(EXTRA_SECONDS, DEFAULT_SECONDS).coerceAtLeast(1),
+            videoKilobitPerSecond = intent.getIntExtra(EXTRA_VIDEO_KBPS, DEFAULT_VIDEO_KBPS).coerceAtLeast(1),
+            videoFramesPerSecond = intent.getIntExtra(EXTRA_VIDEO_FPS, DEFAULT_VIDEO_FPS).coerceIn(1, 60),
+            isAudioEnabled = intent.getBooleanExtra(EXTRA_AUDIO, true)
+        )
+
+        val outputFile = LoadGenerator.makeOutputFile(this)
+
+        MyLog.i(TAG, "Steps %s, %d s each, output %s", stepList, params.stepSeconds, outputFile)
+
+        mLoadGenerator = LoadGenerator(params, outputFile, this).apply { start() }
+    }
+
+    override fun onDestroy() {
+        super.onDestroy()
+
+        mLoadGenerator?.stop()
+        mLoadGenerator = null
+    }
+
+    override fun onLoadProgress(message: String) {
+        MyLog.i(TAG, message)
+        mStatusTextView.text = message
+    }
+
+    override fun onLoadCompleted() {
+        MyLog.i(TAG, "Completed")
+    }
+
+    private lateinit var mStatusTextView: TextView
+    private var mLoadGenerator: LoadGenerator? = null
+
+    companion object {
+        private const val TAG = "LoadTestActivity"
+
+        private const val EXTRA_SERVER = "server"
+        private const val EXTRA_TOKEN = "token"
+        private const val EXTRA_STEPS = "steps"
+        private const val EXTRA_SECONDS = "seconds"
+        private const val EXTRA_VIDEO_KBPS = "video_kbps"
+        private const val EXTRA_VIDEO_FPS = "video_fps"
+        private const val EXTRA_AUDIO = "audio"
+
+        private const val DEFAULT_STEPS = "1,2,4,8,16"
+        private const val DEFAULT_SECONDS = 20
+        private const val DEFAULT_VIDEO_KBPS = 1000
+        private const val DEFAULT_VIDEO_FPS = 30
+    }
+}
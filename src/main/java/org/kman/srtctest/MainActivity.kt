@@ -5,6 +5,7 @@ import android.app.Activity
 import android.content.Intent
 import android.content.SharedPreferences
 import android.content.pm.PackageManager
+import android.graphics.PixelFormat
 import android.graphics.SurfaceTexture
 import android.hardware.camera2.CameraCaptureSession
 import android.hardware.camera2.CameraCharacteristics
@@ -13,6 +14,7 @@ import android.hardware.camera2.CameraManager
 import android.hardware.camera2.CaptureRequest
 import android.media.AudioFormat
 import android.media.AudioRecord
+import android.media.ImageReader
 import android.media.MediaCodec
 import android.media.MediaCodecInfo
 import android.media.MediaCodecList
@@ -47,13 +49,18 @@ import org.kman.srtctest.rtc.PeerConnection
 import org.kman.srtctest.rtc.SimulcastLayer
 import org.kman.srtctest.rtc.Track
 import org.kman.srtctest.util.MyLog
+import java.io.File
 import java.nio.Buffer
 import java.nio.ByteBuffer
 import java.nio.ByteOrder
 import java.nio.ShortBuffer
 import java.nio.charset.StandardCharsets
+import java.text.SimpleDateFormat
+import java.util.Date
 import java.util.Locale
+import java.util.concurrent.ConcurrentHashMap
 import java.util.concurrent.atomic.AtomicBoolean
+import java.util.concurrent.atomic.AtomicInteger
 import kotlin.math.PI
 import kotlin.math.sqrt
 
@@ -79,6 +86,9 @@ class MainActivity : Activity(), SurfaceHolder.Callback {
         mButtonConnect.setOnClickListener {
             onClickConnect()
         }
+        mCheckIsSimulcast.setOnCheckedChangeListener { _, _ ->
+            prewarmPeerConnection()
+        }
         mSurfaceViewPreview.holder.addCallback(this)
 
         mRenderThread = RenderThread(this, object : RenderThread.ErrorCallback {
@@ -97,6 +107,8 @@ class MainActivity : Activity(), SurfaceHolder.Callback {
         mSurfaceViewPreview.holder.removeCallback(this)
         mPreviewTarget?.release()
 
+        mMainHandler.removeCallbacks(mPrewarmRunnable)
+
         // The camera needs to be released on the camera thread
         val camera = mCamera
         mCamera = null
@@ -183,8 +195,24 @@ class MainActivity : Activity(), SurfaceHolder.Callback {
     }
 
     private fun releasePeerConnection() {
+        mPeerConnection?.threadStats?.forEach { stats ->
+            MyLog.i(TAG, "Native thread: %s", stats)
+        }
+        mPeerConnection?.publishErrorCounts?.forEachIndexed { code, count ->
+            if (count != 0) {
+                MyLog.i(TAG, "Publish error %d: %d times", code, count)
+            }
+        }
         mPeerConnection?.release()
         mPeerConnection = null
+
+        try {
+            if (PeerConnection.checkAllocationBudget()) {
+                MyLog.i(TAG, "Publish allocations are within the budget")
+            }
+        } catch (x: Exception) {
+            MyLog.i(TAG, "Publish allocations: %s", x.message)
+        }
     }
 
     private fun releaseEncoders() {
@@ -202,6 +230,8 @@ class MainActivity : Activity(), SurfaceHolder.Callback {
             encoder.release()
         }
         mVideoEncoderSimulcastList.clear()
+        mSoftwareVideoEncoder?.release()
+        mSoftwareVideoEncoder = null
     }
 
     private fun hasPermissions(): Boolean {
@@ -227,6 +257,9 @@ class MainActivity : Activity(), SurfaceHolder.Callback {
 
     @SuppressLint("SetTextI18n")
     private fun setFieldsFromIntent(intent: Intent?) {
+        // adb shell am start -n org.kman.srtctest/.MainActivity --ez software_video true
+        mIsSoftwareVideoForced = intent?.getBooleanExtra(EXTRA_SOFTWARE_VIDEO, false) ?: false
+
         val data = intent?.data ?: return
 
         MyLog.i(TAG, "New intent: %s", data)
@@ -335,172 +368,249 @@ class MainActivity : Activity(), SurfaceHolder.Callback {
                 setPublishKeyFrameRequestedListener {
                     onPeerConnectionKeyFrameRequested()
                 }
+                setPublishLayerKeyFrameRequestedListener { layerName ->
+                    onPeerConnectionLayerKeyFrameRequested(layerName)
+                }
+                setPublishSimulcastLayerSuspendedListener { layerName, suspended ->
+                    onPeerConnectionSimulcastLayerSuspended(layerName, suspended)
+                }
+                setBorrowedFramesReleasedListener {
+                    mEncoderHandler.post { releaseBorrowedFrames() }
+                }
             }
 
+            // Written when the connection fails or closes, see session_recorder.h
+            val telemetryDir = getExternalFilesDir(null) ?: filesDir
+            val telemetryName = SimpleDateFormat("yyyyMMdd-HHmmss", Locale.US).format(Date())
+            mPeerConnection?.setTelemetryPath(File(telemetryDir, "telemetry-$telemetryName.srtl").path)
+
             // Create the SDP offer
             val peerConnection = requireNotNull(mPeerConnection)
 
-            val offerConfig = PeerConnection.OfferConfig()
-
-            // Video options
-            val videoConfig = PeerConnection.PubVideoConfig()
-
-            val codecList = MediaCodecList(MediaCodecList.REGULAR_CODECS)
-            val codecVP8 = findEncoder(codecList, MIME_VIDEO_VP8)
-            val codecVP9 = findEncoder(codecList, MIME_VIDEO_VP9)
-            val codecH264 = findEncoder(codecList, MIME_VIDEO_H264)
-            val codecH265 = findEncoderImpl(codecList, MIME_VIDEO_H265, false)
-            if (codecVP8 == null && codecVP9 == null && codecH264 == null && codecH265 == null) {
+            val offerParams = createOfferParams()
+            if (offerParams == null) {
                 Util.toast(this, R.string.error_no_encoder)
                 return
             }
 
-            if (codecVP8 != null) {
-                // VP8
-                videoConfig.codecList.add(
-                    PeerConnection.PubVideoCodec(PeerConnection.VIDEO_CODEC_VP8, 0),
+            val offerMs0 = SystemClock.elapsedRealtime()
+            val offer = try {
+                peerConnection.initPublishOffer(
+                    offerParams.config,
+                    offerParams.video,
+                    offerParams.audio
                 )
+            } catch (x: Exception) {
+                Util.toast(this, R.string.sdp_offer_error, x.message)
+                return
             }
+            MyLog.i(TAG, "SDP offer created in %d ms", SystemClock.elapsedRealtime() - offerMs0)
 
-            if (codecVP9 != null) {
-                // VP9
-                videoConfig.codecList.add(
-                    PeerConnection.PubVideoCodec(PeerConnection.VIDEO_CODEC_VP9, 0),
-                )
-            }
+            // Reconnecting after a failure uses the same config
+            mSession = PublishSession(server, token, offerParams)
+            mReconnectCount = 0
 
-            if (codecH264 != null) {
-                // H264
-                videoConfig.codecList.add(
-                    // Baseline
-                    PeerConnection.PubVideoCodec(PeerConnection.VIDEO_CODEC_H264, 0x42001f),
-                )
+            // Get a connection ready for next time, with a new cname
+            mOfferConfig = newOfferConfig()
+            prewarmPeerConnection()
 
-                val capsH264 = codecH264.getCapabilitiesForType(MIME_VIDEO_H264)
-                if (isProfileSupported(
-                        capsH264,
-                        MediaCodecInfo.CodecProfileLevel.AVCProfileConstrainedBaseline
-                    )
-                ) {
-                    // Baseline constrained
-                    videoConfig.codecList.add(
-                        PeerConnection.PubVideoCodec(PeerConnection.VIDEO_CODEC_H264, 0x42e01f)
-                    )
+            showConnectUI(false)
+
+            sendPublishOffer(server, token, offer)
+        }
+    }
+
+    private fun sendPublishOffer(server: String, token: String, offer: String) {
+        MyLog.i(TAG, "SDP offer:\n%s", offer)
+
+        val request = Request.Builder().apply {
+            url(server)
+            method("POST", offer.toRequestBody("application/sdp".toMediaType()))
+            header("Authorization", "Bearer $token")
+        }.build()
+
+        val ms0 = SystemClock.elapsedRealtime()
+        HttpClient.execute(request, object : HttpClient.Callback {
+            override fun onCompleted(response: Response?, data: ByteArray?, error: Exception?) {
+                if (error != null) {
+                    Util.toast(this@MainActivity, R.string.sdp_offer_error, error.message)
+                    if (mIsReconnecting) {
+                        mIsReconnecting = false
+                        disconnect()
+                    }
+                    showConnectUI(true)
+                    return
                 }
-                if (isProfileSupported(capsH264, MediaCodecInfo.CodecProfileLevel.AVCProfileMain)) {
-                    // Main
-                    videoConfig.codecList.add(
-                        PeerConnection.PubVideoCodec(PeerConnection.VIDEO_CODEC_H264, 0x4d001f)
+
+                if (data != null) {
+                    val ms1 = SystemClock.elapsedRealtime()
+                    Util.toast(
+                        this@MainActivity,
+                        R.string.sdp_offer_received_sdp_answer,
+                        ms1 - ms0
                     )
+
+                    val answer = String(data, StandardCharsets.UTF_8)
+                    MyLog.i(TAG, "SDP answer:\n%s", answer)
+
+                    mSetAnswerTimeMillis = SystemClock.elapsedRealtime()
+
+                    try {
+                        mPeerConnection?.setPublishAnswer(answer)
+                    } catch (x: Exception) {
+                        Util.toast(
+                            this@MainActivity,
+                            R.string.error_remote_description,
+                            x.message
+                        )
+                        if (mIsReconnecting) {
+                            mIsReconnecting = false
+                            disconnect()
+                        }
+                        showConnectUI(true)
+                        return
+                    }
                 }
             }
+        })
+    }
 
-            if (codecH265 != null) {
-                // VP8
-                videoConfig.codecList.add(
-                    PeerConnection.PubVideoCodec(PeerConnection.VIDEO_CODEC_H265, 0),
-                )
-            }
+    private class PublishSession(
+        val server: String,
+        val token: String,
+        val offerParams: OfferParams
+    )
+
+    private class OfferParams(
+        val config: PeerConnection.OfferConfig,
+        val video: PeerConnection.PubVideoConfig,
+        val audio: PeerConnection.PubAudioConfig
+    )
+
+    private fun createOfferParams(): OfferParams? {
+        val offerConfig = mOfferConfig
+
+        // Video options
+        val videoConfig = PeerConnection.PubVideoConfig()
+
+        val codecList = MediaCodecList(MediaCodecList.REGULAR_CODECS)
+        val codecVP8 = findEncoder(codecList, MIME_VIDEO_VP8)
+        val codecVP9 = findEncoder(codecList, MIME_VIDEO_VP9)
+        val codecH264 = findEncoder(codecList, MIME_VIDEO_H264)
+        val codecH265 = findEncoderImpl(codecList, MIME_VIDEO_H265, false)
+        val isSoftwareH264 = isSoftwareVideoEncoderNeeded(codecList)
+        if (codecVP8 == null && codecVP9 == null && codecH264 == null && codecH265 == null && !isSoftwareH264) {
+            return null
+        }
 
-            // Simulcast
-            if (mCheckIsSimulcast.isChecked) {
-                var size = Size(PUBLISH_VIDEO_WIDTH, PUBLISH_VIDEO_HEIGHT)
-                if (mCameraOrientation == 90 || mCameraOrientation == 270) {
-                    size = Size(size.height, size.width)
-                }
+        if (isSoftwareH264) {
+            // OpenH264, first so it's preferred over the MediaCodec encoders
+            videoConfig.codecList.add(
+                // Baseline constrained
+                PeerConnection.PubVideoCodec(PeerConnection.VIDEO_CODEC_H264, 0x42e01f)
+            )
+        }
 
-                val sizeLow = Size(size.width / 4, size.height / 4)
-                val sizeMid = Size(size.width / 2, size.height / 2)
-                val sizeHigh = Size(size.width, size.height)
+        if (codecVP8 != null) {
+            // VP8
+            videoConfig.codecList.add(
+                PeerConnection.PubVideoCodec(PeerConnection.VIDEO_CODEC_VP8, 0),
+            )
+        }
 
-                videoConfig.simulcastLayerList.add(
-                    SimulcastLayer(
-                        "low", sizeLow.width, sizeLow.height,
-                        ENCODE_FRAMES_PER_SECOND, BITRATE_LOW
-                    )
+        if (codecVP9 != null) {
+            // VP9
+            videoConfig.codecList.add(
+                PeerConnection.PubVideoCodec(PeerConnection.VIDEO_CODEC_VP9, 0),
+            )
+        }
+
+        if (codecH264 != null && !isSoftwareH264) {
+            // H264
+            videoConfig.codecList.add(
+                // Baseline
+                PeerConnection.PubVideoCodec(PeerConnection.VIDEO_CODEC_H264, 0x42001f),
+            )
+
+            val capsH264 = codecH264.getCapabilitiesForType(MIME_VIDEO_H264)
+            if (isProfileSupported(
+                    capsH264,
+                    MediaCodecInfo.CodecProfileLevel.AVCProfileConstrainedBaseline
                 )
-                videoConfig.simulcastLayerList.add(
-                    SimulcastLayer(
-                        "mid", sizeMid.width, sizeMid.height,
-                        ENCODE_FRAMES_PER_SECOND, BITRATE_MID
-                    )
+            ) {
+                // Baseline constrained
+                videoConfig.codecList.add(
+                    PeerConnection.PubVideoCodec(PeerConnection.VIDEO_CODEC_H264, 0x42e01f)
                 )
-                videoConfig.simulcastLayerList.add(
-                    SimulcastLayer(
-                        "hi", sizeHigh.width, sizeHigh.height,
-                        ENCODE_FRAMES_PER_SECOND, BITRATE_HIGH
-                    )
+            }
+            if (isProfileSupported(capsH264, MediaCodecInfo.CodecProfileLevel.AVCProfileMain)) {
+                // Main
+                videoConfig.codecList.add(
+                    PeerConnection.PubVideoCodec(PeerConnection.VIDEO_CODEC_H264, 0x4d001f)
                 )
             }
+        }
 
-            // Audio config
-            val audioConfig = PeerConnection.PubAudioConfig()
-            audioConfig.codecList.add(
-                PeerConnection.PubAudioCodec(
-                    PeerConnection.AUDIO_CODEC_OPUS,
-                    RECORDER_CHUNK_MS,
-                    RECORDER_CHANNELS == 2
-                )
+        if (codecH265 != null) {
+            // VP8
+            videoConfig.codecList.add(
+                PeerConnection.PubVideoCodec(PeerConnection.VIDEO_CODEC_H265, 0),
             )
+        }
 
-            val offer = try {
-                peerConnection.initPublishOffer(
-                    offerConfig,
-                    videoConfig,
-                    audioConfig
-                )
-            } catch (x: Exception) {
-                Util.toast(this, R.string.sdp_offer_error, x.message)
-                return
+        // Simulcast
+        if (mCheckIsSimulcast.isChecked) {
+            var size = Size(PUBLISH_VIDEO_WIDTH, PUBLISH_VIDEO_HEIGHT)
+            if (mCameraOrientation == 90 || mCameraOrientation == 270) {
+                size = Size(size.height, size.width)
             }
 
-            showConnectUI(false)
-
-            MyLog.i(TAG, "SDP offer:\n%s", offer)
-
-            val request = Request.Builder().apply {
-                url(server)
-                method("POST", offer.toRequestBody("application/sdp".toMediaType()))
-                header("Authorization", "Bearer $token")
-            }.build()
+            val sizeLow = Size(size.width / 4, size.height / 4)
+            val sizeMid = Size(size.width / 2, size.height / 2)
+            val sizeHigh = Size(size.width, size.height)
 
-            val ms0 = SystemClock.elapsedRealtime()
-            HttpClient.execute(request, object : HttpClient.Callback {
-                override fun onCompleted(response: Response?, data: ByteArray?, error: Exception?) {
-                    if (error != null) {
-                        Util.toast(this@MainActivity, R.string.sdp_offer_error, error.message)
-                        showConnectUI(true)
-                        return
-                    }
+            videoConfig.simulcastLayerList.add(
+                SimulcastLayer(
+                    "low", sizeLow.width, sizeLow.height,
+                    ENCODE_FRAMES_PER_SECOND, BITRATE_LOW
+                )
+            )
+            videoConfig.simulcastLayerList.add(
+                SimulcastLayer(
+                    "mid", sizeMid.width, sizeMid.height,
+                    ENCODE_FRAMES_PER_SECOND, BITRATE_MID
+                )
+            )
+            videoConfig.simulcastLayerList.add(
+                SimulcastLayer(
+                    "hi", sizeHigh.width, sizeHigh.height,
+                    ENCODE_FRAMES_PER_SECOND, BITRATE_HIGH
+                )
+            )
+        }
 
-                    if (data != null) {
-                        val ms1 = SystemClock.elapsedRealtime()
-                        Util.toast(
-                            this@MainActivity,
-                            R.string.sdp_offer_received_sdp_answer,
-                            ms1 - ms0
-                        )
+        // Audio config
+        val audioConfig = PeerConnection.PubAudioConfig()
+        audioConfig.codecList.add(
+            PeerConnection.PubAudioCodec(
+                PeerConnection.AUDIO_CODEC_OPUS,
+                RECORDER_CHUNK_MS,
+                RECORDER_CHANNELS == 2
+            )
+        )
 
-                        val answer = String(data, StandardCharsets.UTF_8)
-                        MyLog.i(TAG, "SDP answer:\n%s", answer)
+        return OfferParams(offerConfig, videoConfig, audioConfig)
+    }
 
-                        mSetAnswerTimeMillis = SystemClock.elapsedRealtime()
+    // The demo tries RED, the server can still leave it out of the answer
+    private fun newOfferConfig() = PeerConnection.OfferConfig().apply {
+        enableRED = true
+    }
 
-                        try {
-                            mPeerConnection?.setPublishAnswer(answer)
-                        } catch (x: Exception) {
-                            Util.toast(
-                                this@MainActivity,
-                                R.string.error_remote_description,
-                                x.message
-                            )
-                            showConnectUI(true)
-                            return
-                        }
-                    }
-                }
-            })
-        }
+    private fun prewarmPeerConnection() {
+        // Creating the params scans the codec list on the main thread, so only do it once the UI settles down
+        mMainHandler.removeCallbacks(mPrewarmRunnable)
+        mMainHandler.postDelayed(mPrewarmRunnable, PREWARM_DELAY_MS)
     }
 
     private fun onConnectionCompleted() {
@@ -512,7 +622,25 @@ class MainActivity : Activity(), SurfaceHolder.Callback {
         MyLog.i(TAG, "Video simulcast track list: %s", videoSimulcastTrackList)
         MyLog.i(TAG, "Audio track: %s", audioTrack)
 
-        if (videoSingleTrack != null) {
+        val videoTrackList = videoSimulcastTrackList?.takeIf { it.isNotEmpty() } ?: listOfNotNull(videoSingleTrack)
+        if (videoTrackList.firstOrNull()?.codec == PeerConnection.VIDEO_CODEC_H264 &&
+            isSoftwareVideoEncoderNeeded(MediaCodecList(MediaCodecList.REGULAR_CODECS))
+        ) {
+            if (mSoftwareVideoEncoder == null) {
+                var size = Size(PUBLISH_VIDEO_WIDTH, PUBLISH_VIDEO_HEIGHT)
+                if (mCameraOrientation == 90 || mCameraOrientation == 270) {
+                    size = Size(size.height, size.width)
+                }
+
+                val encoder = SoftwareEncoderWrapper(
+                    this, videoTrackList, size,
+                    mRenderThread, mEncoderHandler
+                )
+                if (encoder.start()) {
+                    mSoftwareVideoEncoder = encoder
+                }
+            }
+        } else if (videoSingleTrack != null) {
             var size = Size(PUBLISH_VIDEO_WIDTH, PUBLISH_VIDEO_HEIGHT)
             if (mCameraOrientation == 90 || mCameraOrientation == 270) {
                 size = Size(size.height, size.width)
@@ -528,17 +656,19 @@ class MainActivity : Activity(), SurfaceHolder.Callback {
                 mVideoEncoderSingle?.start()
             }
         } else if (!videoSimulcastTrackList.isNullOrEmpty()) {
-            for (track in videoSimulcastTrackList) {
-                val layer = requireNotNull(track.simulcastLayer)
-                val size = Size(layer.width, layer.height)
-                val encoder = EncoderWrapper(
-                    this, track, size,
-                    layer.kilobitPerSecond,
-                    layer.framesPerSecond,
-                    mRenderThread, mEncoderHandler
-                )
-                if (encoder.start()) {
-                    mVideoEncoderSimulcastList.add(encoder)
+            if (mVideoEncoderSimulcastList.isEmpty()) {
+                for (track in videoSimulcastTrackList) {
+                    val layer = requireNotNull(track.simulcastLayer)
+                    val size = Size(layer.width, layer.height)
+                    val encoder = EncoderWrapper(
+                        this, track, size,
+                        layer.kilobitPerSecond,
+                        layer.framesPerSecond,
+                        mRenderThread, mEncoderHandler
+                    )
+                    if (encoder.start()) {
+                        mVideoEncoderSimulcastList.add(encoder)
+                    }
                 }
             }
         } else {
@@ -546,13 +676,67 @@ class MainActivity : Activity(), SurfaceHolder.Callback {
             Util.toast(this, R.string.error_no_video_tracks)
         }
 
-        if (audioTrack != null) {
+        if (audioTrack != null && mAudioRecord == null) {
             initAudioRecording(audioTrack.codecOptions)
         }
+
+        if (mIsReconnecting) {
+            // The encoders kept running, the new connection needs a key frame to start
+            mIsReconnecting = false
+            mReconnectCount = 0
+            onPeerConnectionKeyFrameRequested(force = true)
+        } else {
+            // Have a connection with the same config ready in case this one fails
+            val session = mSession
+            if (session != null) {
+                val params = session.offerParams
+                PeerConnection.prewarm(params.config, params.video, params.audio)
+            }
+        }
+    }
+
+    private fun reconnect(): Boolean {
+        val peerConnection = mPeerConnection ?: return false
+        val session = mSession ?: return false
+
+        // Only once the media is flowing, and not forever
+        if (mVideoEncoderSingle == null && mVideoEncoderSimulcastList.isEmpty() && mSoftwareVideoEncoder == null) {
+            return false
+        }
+        if (mReconnectCount >= MAX_RECONNECT_COUNT) {
+            return false
+        }
+        mReconnectCount += 1
+
+        MyLog.i(TAG, "Reconnecting, attempt %d", mReconnectCount)
+
+        peerConnection.reconnect()
+
+        val params = session.offerParams
+        val offer = try {
+            peerConnection.initPublishOffer(params.config, params.video, params.audio)
+        } catch (x: Exception) {
+            MyLog.i(TAG, "Error creating the offer for reconnecting: %s", x.message)
+            return false
+        }
+
+        mIsReconnecting = true
+        sendPublishOffer(session.server, session.token, offer)
+        return true
     }
 
     private fun onPeerConnectionConnectState(state: Int) {
         if (state == PeerConnection.CONNECTION_STATE_FAILED) {
+            // Keep the camera, the encoders and the audio going, and get a new transport
+            if (reconnect()) {
+                mStatusTextView.text = getString(
+                    R.string.pc_connection_state,
+                    getString(R.string.pc_state_reconnecting)
+                )
+                return
+            }
+
+            mIsReconnecting = false
             releasePeerConnection()
             releaseEncoders()
 
@@ -593,19 +777,44 @@ class MainActivity : Activity(), SurfaceHolder.Callback {
             R.string.pc_connection_stats,
             stats.bandwidth_actual_kbit_per_second,
             stats.bandwidth_suggested_kbit_per_second,
-            stats.rtt_ms
+            stats.rtt_ms,
+            stats.pacer_delay_max_ms
         )
         mStatusTextView.text = message
     }
 
-    private fun onPeerConnectionKeyFrameRequested() {
-        mVideoEncoderSingle?.requestKeyFrame()
+    private fun onPeerConnectionKeyFrameRequested(force: Boolean = false) {
+        mVideoEncoderSingle?.requestKeyFrame(force)
+        mSoftwareVideoEncoder?.requestKeyFrame(force)
 
         for (encoder in mVideoEncoderSimulcastList) {
-            encoder.requestKeyFrame()
+            encoder.requestKeyFrame(force)
+        }
+    }
+
+    private fun onPeerConnectionLayerKeyFrameRequested(layerName: String?) {
+        if (layerName == null) {
+            mVideoEncoderSingle?.requestKeyFrame(force = true)
+        } else {
+            for (encoder in mVideoEncoderSimulcastList) {
+                if (encoder.track.simulcastLayer?.name == layerName) {
+                    encoder.requestKeyFrame(force = true)
+                }
+            }
         }
     }
 
+    private fun onPeerConnectionSimulcastLayerSuspended(layerName: String, suspended: Boolean) {
+        MyLog.i(TAG, "Simulcast layer %s suspended: %b", layerName, suspended)
+
+        for (encoder in mVideoEncoderSimulcastList) {
+            if (encoder.track.simulcastLayer?.name == layerName) {
+                encoder.setSuspended(suspended)
+            }
+        }
+        mSoftwareVideoEncoder?.setSuspended(layerName, suspended)
+    }
+
     private fun initCameraCapture() {
         if (!mIsInitCameraDone) {
             mIsInitCameraDone = true
@@ -703,6 +912,9 @@ class MainActivity : Activity(), SurfaceHolder.Callback {
 
             mCameraOrientation = chars.get(CameraCharacteristics.SENSOR_ORIENTATION) ?: 0
 
+            // The simulcast layer sizes depend on the camera's orientation
+            prewarmPeerConnection()
+
             mCameraTexture?.release()
             mCameraTexture = mRenderThread.createCameraTexture(
                 chosenSize.width,
@@ -831,6 +1043,14 @@ class MainActivity : Activity(), SurfaceHolder.Callback {
         return null
     }
 
+    // OpenH264 when asked for, or when there is no hardware H.264 encoder
+    private fun isSoftwareVideoEncoderNeeded(codecList: MediaCodecList): Boolean {
+        if (!PeerConnection.isSoftwareVideoEncoderAvailable()) {
+            return false
+        }
+        return mIsSoftwareVideoForced || findEncoderImpl(codecList, MIME_VIDEO_H264, false) == null
+    }
+
     private fun isProfileSupported(
         caps: MediaCodecInfo.CodecCapabilities,
         profileId: Int
@@ -880,6 +1100,7 @@ class MainActivity : Activity(), SurfaceHolder.Callback {
 
         var lastTime = SystemClock.elapsedRealtime()
         var lastFrameCount = 0
+        var lastStatus = PeerConnection.PUBLISH_OK
 
         while (!mIsAudioRecordQuit.get()) {
             val r = record.read(byteBuffer, byteBuffer.capacity(), AudioRecord.READ_BLOCKING)
@@ -889,19 +1110,25 @@ class MainActivity : Activity(), SurfaceHolder.Callback {
                     showAudioRms(rms)
                 }
 
-                try {
-                    mPeerConnection?.publishAudioFrame(
-                        byteBuffer, r,
-                        RECORDER_SAMPLE_RATE,
-                        if (stereo) 2 else 1
-                    )
-                } catch (x: Exception) {
-                    mMainHandler.post {
-                        Util.toast(
-                            this@MainActivity,
-                            R.string.error_publishing_audio_frame,
-                            x.message
-                        )
+                val peerConnection = mPeerConnection
+                val status = peerConnection?.publishAudioFrame(
+                    byteBuffer, r,
+                    RECORDER_SAMPLE_RATE,
+                    if (stereo) 2 else 1
+                ) ?: PeerConnection.PUBLISH_OK
+
+                // Only tell the user when something changes, not for every frame
+                if (status != lastStatus) {
+                    lastStatus = status
+                    if (status != PeerConnection.PUBLISH_OK) {
+                        val message = peerConnection?.lastPublishError?.message
+                        mMainHandler.post {
+                            Util.toast(
+                                this@MainActivity,
+                                R.string.error_publishing_audio_frame,
+                                message
+                            )
+                        }
                     }
                 }
 
@@ -945,17 +1172,43 @@ class MainActivity : Activity(), SurfaceHolder.Callback {
         }
     }
 
-    private fun publishVideoFrame(track: Track, frame: ByteBuffer) {
+    // Returns null if the frame was not borrowed and can be released right away
+    private fun publishVideoFrameBorrowed(track: Track, frame: ByteBuffer, token: Long): Int? {
+        val peerConnection = mPeerConnection ?: return null
         val layer = track.simulcastLayer
-        if (layer == null) {
-            mPeerConnection?.publishVideoSingleFrame(frame)
+        val status = if (layer == null) {
+            peerConnection.publishVideoSingleFrameBorrowed(frame, token)
         } else {
-            mPeerConnection?.publishVideoSimulcastFrame(layer, frame)
+            peerConnection.publishVideoSimulcastFrameBorrowed(layer, frame, token)
+        }
+        return if (status == PeerConnection.PUBLISH_NOT_BORROWED) null else status
+    }
+
+    // On the encoder thread
+    private fun releaseBorrowedFrames() {
+        val peerConnection = mPeerConnection ?: return
+        while (true) {
+            val count = peerConnection.drainReleasedFrames(mReleasedFrameTokens)
+            if (count == 0) {
+                break
+            }
+            for (i in 0 until count) {
+                val token = mReleasedFrameTokens[i]
+                val owner = (token ushr 32).toInt()
+                val index = (token and 0xffffffffL).toInt()
+                mEncoderById[owner]?.releaseOutputBuffer(index)
+            }
         }
     }
 
     private val mMainHandler = Handler(Looper.getMainLooper())
 
+    private val mPrewarmRunnable = Runnable {
+        // The config has to be the same as the one used to connect, including the cname
+        val offerParams = createOfferParams() ?: return@Runnable
+        PeerConnection.prewarm(offerParams.config, offerParams.video, offerParams.audio)
+    }
+
     private val mCameraThread = HandlerThread("Camera").apply { start() }
     private val mCameraHandler = Handler(mCameraThread.looper)
 
@@ -980,6 +1233,10 @@ class MainActivity : Activity(), SurfaceHolder.Callback {
     private var mIsConnectUIVisible = true
 
     private var mSetAnswerTimeMillis = 0L
+    private var mOfferConfig = newOfferConfig()
+    private var mSession: PublishSession? = null
+    private var mIsReconnecting = false
+    private var mReconnectCount = 0
     private var mPeerConnection: PeerConnection? = null
 
     private var mIsInitCameraDone = false
@@ -989,6 +1246,12 @@ class MainActivity : Activity(), SurfaceHolder.Callback {
 
     private var mVideoEncoderSingle: EncoderWrapper? = null
     private val mVideoEncoderSimulcastList = ArrayList<EncoderWrapper>()
+    private var mSoftwareVideoEncoder: SoftwareEncoderWrapper? = null
+    private var mIsSoftwareVideoForced = false
+
+    // For routing released frames back to their encoders
+    private val mEncoderById = ConcurrentHashMap<Int, EncoderWrapper>()
+    private val mReleasedFrameTokens = LongArray(64)
 
     private var mCameraTexture: RenderThread.CameraTexture? = null
     private var mPreviewTarget: RenderThread.RenderTarget? = null
@@ -997,6 +1260,115 @@ class MainActivity : Activity(), SurfaceHolder.Callback {
     private var mAudioRecord: AudioRecord? = null
     private var mAudioThread: Thread? = null
 
+    // OpenH264 in native code, fed with RGBA frames rendered the same way as for the MediaCodec encoders. The smaller
+    // simulcast layers are scaled natively from the largest one.
+    private class SoftwareEncoderWrapper(
+        val activity: MainActivity,
+        val trackList: List<Track>,
+        val singleSize: Size,
+        val renderThread: RenderThread,
+        val handler: Handler,
+    ) {
+
+        var created: Long = 0L
+        var imageReader: ImageReader? = null
+        var renderTarget: RenderThread.RenderTarget? = null
+        var lastPublishStatus = PeerConnection.PUBLISH_OK
+
+        fun start(): Boolean {
+            val peerConnection = activity.mPeerConnection ?: return false
+
+            val layerList = trackList.map { track ->
+                track.simulcastLayer ?: SimulcastLayer(
+                    "", singleSize.width, singleSize.height,
+                    ENCODE_FRAMES_PER_SECOND, BITRATE_HIGH
+                )
+            }
+            val largest = layerList.maxBy { it.width }
+
+            try {
+                peerConnection.startSoftwareVideoEncoder(layerList, SOFTWARE_ENCODER_THREAD_COUNT)
+            } catch (x: Exception) {
+                MyLog.i(TAG, "Error starting the software encoder: %s", x.message)
+                Util.toast(activity, R.string.error_starting_encoder)
+                return false
+            }
+
+            activity.showCodec("H264 (OpenH264)")
+            created = SystemClock.elapsedRealtime()
+
+            val reader = ImageReader.newInstance(largest.width, largest.height, PixelFormat.RGBA_8888, 2)
+            reader.setOnImageAvailableListener({ onImageAvailable(it) }, handler)
+            imageReader = reader
+
+            renderTarget =
+                renderThread.createTarget(reader.surface, "encoder-software", largest.width, largest.height)
+
+            return true
+        }
+
+        fun requestKeyFrame(force: Boolean = false) {
+            val now = SystemClock.elapsedRealtime()
+            if (!force && now - created > 5 * 1000L) {
+                // Same as the MediaCodec encoders, only needed when we connect, or when forced
+                return
+            }
+
+            activity.mPeerConnection?.requestSoftwareVideoKeyFrame()
+        }
+
+        fun setSuspended(layerName: String, suspended: Boolean) {
+            val layer = trackList.firstNotNullOfOrNull { track ->
+                track.simulcastLayer?.takeIf { it.name == layerName }
+            } ?: return
+            activity.mPeerConnection?.setSoftwareVideoLayerSuspended(layer, suspended)
+        }
+
+        fun release() {
+            renderTarget?.release()
+            renderTarget = null
+
+            val reader = imageReader
+            imageReader = null
+            if (reader != null) {
+                handler.blockingCall {
+                    reader.close()
+                }
+            }
+
+            activity.mPeerConnection?.stopSoftwareVideoEncoder()
+        }
+
+        // On the encoder thread
+        private fun onImageAvailable(reader: ImageReader) {
+            val image = try {
+                reader.acquireLatestImage()
+            } catch (x: IllegalStateException) {
+                null
+            } ?: return
+
+            try {
+                val plane = image.planes[0]
+                val peerConnection = activity.mPeerConnection
+                val status = peerConnection?.publishVideoRawFrame(
+                    plane.buffer, image.width, image.height, plane.rowStride
+                ) ?: PeerConnection.PUBLISH_OK
+
+                if (status != lastPublishStatus) {
+                    lastPublishStatus = status
+                    if (status != PeerConnection.PUBLISH_OK) {
+                        val message = peerConnection?.lastPublishError?.message
+                        activity.mMainHandler.post {
+                            Util.toast(activity, R.string.error_publishing_video_frame, message)
+                        }
+                    }
+                }
+            } finally {
+                image.close()
+            }
+        }
+    }
+
     private class EncoderWrapper(
         val activity: MainActivity,
         val track: Track,
@@ -1007,6 +1379,7 @@ class MainActivity : Activity(), SurfaceHolder.Callback {
         val handler: Handler,
     ) {
 
+        val id = nextEncoderId.getAndIncrement()
         var encoder: MediaCodec? = null
         var created: Long = 0L
         var renderTarget: RenderThread.RenderTarget? = null
@@ -1082,6 +1455,7 @@ class MainActivity : Activity(), SurfaceHolder.Callback {
 
                     encoder?.start()
                     created = SystemClock.elapsedRealtime()
+                    activity.mEncoderById[id] = this
 
                     val name = "encoder-" + (track.simulcastLayer?.name ?: "default")
                     renderTarget =
@@ -1102,10 +1476,10 @@ class MainActivity : Activity(), SurfaceHolder.Callback {
             return true
         }
 
-        fun requestKeyFrame() {
+        fun requestKeyFrame(force: Boolean = false) {
             val now = SystemClock.elapsedRealtime()
-            if (now - created > 5 * 1000L) {
-                // We only need to generate additional key frames whne we connect
+            if (!force && now - created > 5 * 1000L) {
+                // We only need to generate additional key frames whne we connect, or after a reconnect
                 return
             }
 
@@ -1116,11 +1490,36 @@ class MainActivity : Activity(), SurfaceHolder.Callback {
             e.setParameters(params)
         }
 
+        fun setSuspended(suspended: Boolean) {
+            // Saves the encoding work as well as the bandwidth
+            val e = encoder ?: return
+            val params = Bundle().apply {
+                putInt(MediaCodec.PARAMETER_KEY_SUSPEND, if (suspended) 1 else 0)
+                if (!suspended) {
+                    // The native side waits for a key frame after a layer is resumed
+                    putInt(MediaCodec.PARAMETER_KEY_REQUEST_SYNC_FRAME, 0)
+                }
+            }
+            e.setParameters(params)
+        }
+
+        fun releaseOutputBuffer(index: Int) {
+            val e = encoder ?: return
+            try {
+                e.releaseOutputBuffer(index, false)
+            } catch (x: IllegalStateException) {
+                MyLog.i(TAG, "Error releasing output buffer %d: %s", index, x.message)
+            }
+        }
+
         fun release() {
             val e = encoder
             encoder = null
+            activity.mEncoderById.remove(id)
 
             if (e != null) {
+                // The native side must stop reading our output buffers before they go away
+                activity.mPeerConnection?.cancelBorrowedFrames(id)
                 handler.blockingCall {
                     e.stop()
                     e.release()
@@ -1133,6 +1532,7 @@ class MainActivity : Activity(), SurfaceHolder.Callback {
 
         private val callback = object : MediaCodec.Callback() {
             var savedCsdList: List<ByteBuffer>? = null
+            var lastPublishStatus = PeerConnection.PUBLISH_OK
 
             override fun onInputBufferAvailable(codec: MediaCodec, index: Int) {
             }
@@ -1149,13 +1549,33 @@ class MainActivity : Activity(), SurfaceHolder.Callback {
                     }
                 }
 
+                // The input surface is stamped from the camera's monotonic clock, anything outside of a second is
+                // a device that uses another time base
+                val encodeTimeUs = System.nanoTime() / 1000 - info.presentationTimeUs
+                if (encodeTimeUs in 0..1000000) {
+                    activity.mPeerConnection?.recordVideoEncodeTime(encodeTimeUs)
+                }
+
                 val buffer = codec.getOutputBuffer(index) ?: return
+                var isBorrowed = false
                 try {
-                    activity.publishVideoFrame(track, buffer)
+                    // The buffer goes back to the codec once the native side is done with it
+                    val token = (id.toLong() shl 32) or index.toLong()
+                    val status = activity.publishVideoFrameBorrowed(track, buffer, token)
+                    isBorrowed = status != null
+                    if (status != null && status != lastPublishStatus) {
+                        lastPublishStatus = status
+                        if (status != PeerConnection.PUBLISH_OK) {
+                            val error = activity.mPeerConnection?.lastPublishError
+                            reportErrorToast(R.string.error_publishing_video_frame, error?.message)
+                        }
+                    }
                 } catch (x: Exception) {
                     reportErrorToast(R.string.error_publishing_video_frame, x.message)
                 } finally {
-                    codec.releaseOutputBuffer(index, false)
+                    if (!isBorrowed) {
+                        codec.releaseOutputBuffer(index, false)
+                    }
                 }
             }
 
@@ -1231,6 +1651,12 @@ class MainActivity : Activity(), SurfaceHolder.Callback {
         private const val PREF_KEY_SERVER = "whip_server"
         private const val PREF_KEY_TOKEN = "whip_token"
 
+        private const val MAX_RECONNECT_COUNT = 3
+
+        private const val PREWARM_DELAY_MS = 500L
+
+        private val nextEncoderId = AtomicInteger(1)
+
         private const val PERM_CAMERA = android.Manifest.permission.CAMERA
         private const val PERM_RECORD_AUDIO = android.Manifest.permission.RECORD_AUDIO
 
@@ -1253,6 +1679,9 @@ class MainActivity : Activity(), SurfaceHolder.Callback {
 
         private const val ENCODE_FRAMES_PER_SECOND = 15
 
+        private const val EXTRA_SOFTWARE_VIDEO = "software_video"
+        private const val SOFTWARE_ENCODER_THREAD_COUNT = 4
+
         private const val BITRATE_LOW = 300
         private const val BITRATE_MID = 1000
         private const val BITRATE_HIGH = 1500
@@ -9,6 +9,8 @@ import androidx.annotation.Nullable;
 import org.kman.srtctest.util.MyLog;
 
 import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.nio.charset.StandardCharsets;
 import java.util.ArrayList;
 import java.util.Collections;
 import java.util.List;
@@ -45,6 +47,11 @@ public class PeerConnection {
     public static class OfferConfig {
         @NonNull
         public String cname = UUID.randomUUID().toString();
+        public boolean enableBWE = true;
+        public boolean enableRFC8851 = true;
+        // Redundant audio (RFC 2198) instead of Opus in-band FEC, if the server accepts it. Off by default, since each
+        // packet also carries the previous ones, which at least doubles the audio bitrate.
+        public boolean enableRED = false;
     }
 
     public static class PubVideoCodec {
@@ -87,8 +94,37 @@ public class PeerConnection {
             throw new IllegalArgumentException("A maximum of 3 simulcast layers is supported");
         }
 
+        // Passed to native code in one go, see offer_config.h for the format
+        final ByteBuffer buf = encodeOfferConfig(config, video, audio);
+
+        synchronized (mHandleLock) {
+            return initPublishOfferImpl(mHandle, buf, buf.limit());
+        }
+    }
+
+    /*
+     * Prepares a connection for this exact configuration in the background, including the offer's DTLS certificate,
+     * so that a later initPublishOffer with the same (equal) config can skip that work.
+     */
+    public static void prewarm(@NonNull OfferConfig config,
+                               @Nullable PubVideoConfig video,
+                               @Nullable PubAudioConfig audio) {
+        if (video != null && video.simulcastLayerList.size() > 3) {
+            throw new IllegalArgumentException("A maximum of 3 simulcast layers is supported");
+        }
+
+        final ByteBuffer buf = encodeOfferConfig(config, video, audio);
+        prewarmImpl(buf, buf.limit());
+    }
+
+    /*
+     * Replaces the transport after a failure while keeping the native encoder state and codec specific data.
+     * Frames published before the new answer is set are dropped. Call initPublishOffer and setPublishAnswer next,
+     * video resumes from the next key frame.
+     */
+    public void reconnect() {
         synchronized (mHandleLock) {
-            return initPublishOfferImpl(mHandle, config, video, audio);
+            reconnectImpl(mHandle);
         }
     }
 
@@ -149,11 +185,32 @@ public class PeerConnection {
         }
     }
 
-    public void publishVideoSingleFrame(@NonNull ByteBuffer buf) throws SRtcException {
+    /*
+     * The publish methods return PUBLISH_OK or an error code (same as SRtcException.getCode) instead of throwing, as
+     * they're called for every frame. See getPublishErrorCounts and getLastPublishError for details.
+     *
+     * Frames are sent later, on a native thread, so the code a call returns only covers what can be checked while the
+     * frame is queued. An error from sending is returned once, by the next publish call for the same media (video or
+     * audio) that has no error of its own. Send errors from before a reconnect are not returned.
+     */
+    public static final int PUBLISH_OK = 0;
+
+    public static class PublishError {
+        PublishError(int code, @NonNull String message) {
+            this.code = code;
+            this.message = message;
+        }
+
+        public final int code;
+        @NonNull
+        public final String message;
+    }
+
+    public int publishVideoSingleFrame(@NonNull ByteBuffer buf) {
         assert buf.isDirect();
 
         synchronized (mHandleLock) {
-            publishVideoSingleFrameImpl(mHandle, buf);
+            return publishVideoSingleFrameImpl(mHandle, buf);
         }
     }
 
@@ -168,24 +225,99 @@ public class PeerConnection {
         }
     }
 
-    public void publishVideoSimulcastFrame(@NonNull SimulcastLayer layer,
-                                           @NonNull ByteBuffer buf) throws SRtcException {
+    // Still throws if the layer is invalid
+    public int publishVideoSimulcastFrame(@NonNull SimulcastLayer layer,
+                                          @NonNull ByteBuffer buf) throws SRtcException {
         assert buf.isDirect();
 
         synchronized (mHandleLock) {
-            publishVideoSimulcastFrameImpl(mHandle, layer, buf);
+            return publishVideoSimulcastFrameImpl(mHandle, layer, buf);
         }
     }
 
+    /*
+     * Borrowed frames: the buffer is not copied here and has to stay valid until its token is handed back by
+     * drainReleasedFrames, which happens for every frame, sent or dropped. The top 32 bits of the token identify
+     * the buffer's owner, see cancelBorrowedFrames.
+     *
+     * Once the connection has been released, these return PUBLISH_NOT_BORROWED, and the token will not come back:
+     * the caller still owns the buffer.
+     */
+    public static final int PUBLISH_NOT_BORROWED = -1;
+
+    public int publishVideoSingleFrameBorrowed(@NonNull ByteBuffer buf, long token) {
+        assert buf.isDirect();
+
+        synchronized (mHandleLock) {
+            if (mHandle == 0) {
+                return PUBLISH_NOT_BORROWED;
+            }
+            return publishVideoSingleFrameBorrowedImpl(mHandle, buf, token);
+        }
+    }
+
+    public int publishVideoSimulcastFrameBorrowed(@NonNull SimulcastLayer layer,
+                                                  @NonNull ByteBuffer buf,
+                                                  long token) throws SRtcException {
+        assert buf.isDirect();
+
+        synchronized (mHandleLock) {
+            if (mHandle == 0) {
+                return PUBLISH_NOT_BORROWED;
+            }
+            return publishVideoSimulcastFrameBorrowedImpl(mHandle, layer, buf, token);
+        }
+    }
+
+    // Returns the number of tokens stored into the array
+    public int drainReleasedFrames(@NonNull long[] tokens) {
+        synchronized (mHandleLock) {
+            return drainReleasedFramesImpl(mHandle, tokens);
+        }
+    }
+
+    // Call before the owner's buffers become invalid. A token or two released just before may still come out of
+    // drainReleasedFrames afterwards.
+    public void cancelBorrowedFrames(int owner) {
+        synchronized (mHandleLock) {
+            cancelBorrowedFramesImpl(mHandle, owner);
+        }
+    }
+
+    // Called on a native thread, keep it short
+    public interface BorrowedFramesReleasedListener {
+        void onBorrowedFramesReleased();
+    }
+
+    public void setBorrowedFramesReleasedListener(BorrowedFramesReleasedListener listener) {
+        synchronized (mListenerLock) {
+            mBorrowedFramesReleasedListener = listener;
+        }
+    }
 
-    public void publishAudioFrame(@NonNull ByteBuffer buf,
-                                  int size,
-                                  int sampleRate,
-                                  int channels) throws SRtcException {
+    public int publishAudioFrame(@NonNull ByteBuffer buf,
+                                 int size,
+                                 int sampleRate,
+                                 int channels) {
         assert buf.isDirect();
 
         synchronized (mHandleLock) {
-            publishAudioFrameImpl(mHandle, buf, size, sampleRate, channels);
+            return publishAudioFrameImpl(mHandle, buf, size, sampleRate, channels);
+        }
+    }
+
+    // Indexed by error code, includes errors from sending which happens asynchronously
+    @Nullable
+    public int[] getPublishErrorCounts() {
+        synchronized (mHandleLock) {
+            return getPublishErrorCountsImpl(mHandle);
+        }
+    }
+
+    @Nullable
+    public PublishError getLastPublishError() {
+        synchronized (mHandleLock) {
+            return getLastPublishErrorImpl(mHandle);
         }
     }
 
@@ -193,13 +325,28 @@ public class PeerConnection {
 
     public static class PublishConnectionStats {
         PublishConnectionStats(int packet_count, int byte_count, float packets_lost_percent,
-                               float rtt_ms, float bandwidth_actual_kbit_per_second, float bandwidth_suggested_kbit_per_second) {
+                               float rtt_ms, float bandwidth_actual_kbit_per_second, float bandwidth_suggested_kbit_per_second,
+                               int pacer_queue_frames, int pacer_queue_bytes,
+                               float pacer_delay_avg_ms, float pacer_delay_max_ms, int pacer_dropped_frames,
+                               int suspended_layer_count, int dropped_non_reference_frames,
+                               int audio_suppressed_frames, int audio_suppressed_bytes,
+                               int audio_red_depth) {
             this.packet_count = packet_count;
             this.byte_count = byte_count;
             this.packets_lost_percent = packets_lost_percent;
             this.rtt_ms = rtt_ms;
             this.bandwidth_actual_kbit_per_second = bandwidth_actual_kbit_per_second;
             this.bandwidth_suggested_kbit_per_second = bandwidth_suggested_kbit_per_second;
+            this.pacer_queue_frames = pacer_queue_frames;
+            this.pacer_queue_bytes = pacer_queue_bytes;
+            this.pacer_delay_avg_ms = pacer_delay_avg_ms;
+            this.pacer_delay_max_ms = pacer_delay_max_ms;
+            this.pacer_dropped_frames = pacer_dropped_frames;
+            this.suspended_layer_count = suspended_layer_count;
+            this.dropped_non_reference_frames = dropped_non_reference_frames;
+            this.audio_suppressed_frames = audio_suppressed_frames;
+            this.audio_suppressed_bytes = audio_suppressed_bytes;
+            this.audio_red_depth = audio_red_depth;
         }
 
 
@@ -209,6 +356,24 @@ public class PeerConnection {
         public final float rtt_ms;
         public final float bandwidth_actual_kbit_per_second;
         public final float bandwidth_suggested_kbit_per_second;
+
+        // Send pacer, the delay values are since the previous stats
+        public final int pacer_queue_frames;
+        public final int pacer_queue_bytes;
+        public final float pacer_delay_avg_ms;
+        public final float pacer_delay_max_ms;
+        public final int pacer_dropped_frames;
+
+        // Bandwidth policy
+        public final int suspended_layer_count;
+        public final int dropped_non_reference_frames;
+
+        // Audio frames not sent during silence, and their (partly estimated) payload size
+        public final int audio_suppressed_frames;
+        public final int audio_suppressed_bytes;
+
+        // Previous packets carried in each RED packet, -1 when RED is not in use
+        public final int audio_red_depth;
     }
 
     public interface PublishConnectionStatsListener {
@@ -231,6 +396,156 @@ public class PeerConnection {
         }
     }
 
+    /*
+     * Native code dropped frames of a layer (null is the single video track) and can't send more of it until the
+     * next key frame. Unlike the server's requests, these should always be honored.
+     */
+    public interface PublishLayerKeyFrameRequestedListener {
+        void onPublishLayerKeyFrameRequested(@Nullable String layerName);
+    }
+
+    public void setPublishLayerKeyFrameRequestedListener(PublishLayerKeyFrameRequestedListener listener) {
+        synchronized (mListenerLock) {
+            mPublishLayerKeyFrameRequestedListener = listener;
+        }
+    }
+
+    public interface PublishSimulcastLayerSuspendedListener {
+        void onPublishSimulcastLayerSuspended(@NonNull String layerName, boolean suspended);
+    }
+
+    public void setPublishSimulcastLayerSuspendedListener(PublishSimulcastLayerSuspendedListener listener) {
+        synchronized (mListenerLock) {
+            mPublishSimulcastLayerSuspendedListener = listener;
+        }
+    }
+
+    // Software video encoder
+
+    /*
+     * OpenH264 in native code instead of MediaCodec, for devices where the hardware encoder is missing, broken or too
+     * slow. Only there when the native library was built with SRTC_SOFTWARE_H264.
+     *
+     * Start it once the tracks are known, with one layer per simulcast track, or a single layer with an empty name for
+     * the single video track. Raw frames are RGBA at the size of the largest layer. The smaller layers are scaled from
+     * it natively, and the encoded frames are published on the encoder's own thread. The video tracks have to be H.264,
+     * starting throws otherwise, and frames for other codecs are dropped as publish errors.
+     */
+    public static boolean isSoftwareVideoEncoderAvailable() {
+        return isSoftwareVideoEncoderAvailableImpl();
+    }
+
+    public void startSoftwareVideoEncoder(@NonNull List<SimulcastLayer> layerList, int threadCount)
+            throws SRtcException {
+        synchronized (mHandleLock) {
+            startSoftwareVideoEncoderImpl(mHandle, layerList.toArray(new SimulcastLayer[0]), threadCount);
+        }
+    }
+
+    public void stopSoftwareVideoEncoder() {
+        synchronized (mHandleLock) {
+            stopSoftwareVideoEncoderImpl(mHandle);
+        }
+    }
+
+    // Copied before returning. If the encoder is still busy with the previous frame, that one is replaced.
+    public int publishVideoRawFrame(@NonNull ByteBuffer rgba, int width, int height, int stride) {
+        assert rgba.isDirect();
+
+        synchronized (mHandleLock) {
+            return publishVideoRawFrameImpl(mHandle, rgba, width, height, stride);
+        }
+    }
+
+    public void requestSoftwareVideoKeyFrame() {
+        synchronized (mHandleLock) {
+            requestSoftwareVideoKeyFrameImpl(mHandle);
+        }
+    }
+
+    public void setSoftwareVideoLayerSuspended(@NonNull SimulcastLayer layer, boolean suspended) {
+        synchronized (mHandleLock) {
+            setSoftwareVideoLayerSuspendedImpl(mHandle, layer, suspended);
+        }
+    }
+
+    // Allocation tracking
+
+    /*
+     * Checks the publish path against its steady state allocation budget (see alloc_tracker.h). Returns false when the
+     * native library was built without SRTC_ALLOC_TRACKING, throws if any publish call went over the budget.
+     */
+    public static boolean checkAllocationBudget() throws SRtcException {
+        return checkAllocationBudgetImpl();
+    }
+
+    // Thread placement
+
+    public static final int THREAD_ROLE_NETWORK = 0;
+    public static final int THREAD_ROLE_SEND = 1;
+    public static final int THREAD_ROLE_AUDIO = 2;
+    public static final int THREAD_ROLE_ENCODE = 3;
+
+    /*
+     * Sets CPU affinity (a bit mask, zero to leave it alone), niceness and real-time (SCHED_FIFO) priority for a native
+     * thread role. Applied right away if the thread is already running, otherwise as soon as it calls into native code.
+     * A non-zero rtPriority usually needs privileges the app doesn't have.
+     */
+    public void setThreadPolicy(int role, long cpuMask, int nice, int rtPriority) throws SRtcException {
+        synchronized (mHandleLock) {
+            setThreadPolicyImpl(mHandle, role, cpuMask, nice, rtPriority);
+        }
+    }
+
+    public static class ThreadStats {
+        ThreadStats(int role, int tid, long cpu_user_ms, long cpu_system_ms, int last_cpu) {
+            this.role = role;
+            this.tid = tid;
+            this.cpu_user_ms = cpu_user_ms;
+            this.cpu_system_ms = cpu_system_ms;
+            this.last_cpu = last_cpu;
+        }
+
+        @NonNull
+        @Override
+        public String toString() {
+            return "ThreadStats{role=" + role + ", tid=" + tid + ", user=" + cpu_user_ms + " ms, system="
+                    + cpu_system_ms + " ms, cpu=" + last_cpu + "}";
+        }
+
+        public final int role;
+        public final int tid;
+
+        // Totals since the thread started, from /proc/self/task
+        public final long cpu_user_ms;
+        public final long cpu_system_ms;
+        public final int last_cpu;
+    }
+
+    @Nullable
+    public List<ThreadStats> getThreadStats() {
+        synchronized (mHandleLock) {
+            return getThreadStatsImpl(mHandle);
+        }
+    }
+
+    /*
+     * Where the session's telemetry (one sample per stats update, up to an hour) is written when the connection fails
+     * or closes, and when this object is released. Null disables it. See session_recorder.h for the format.
+     */
+    public void setTelemetryPath(@Nullable String path) {
+        synchronized (mHandleLock) {
+            setTelemetryPathImpl(mHandle, path);
+        }
+    }
+
+    // Time from the encoder's input to its output, for telemetry
+    public void recordVideoEncodeTime(long usec) {
+        synchronized (mHandleLock) {
+            recordVideoEncodeTimeImpl(mHandle, usec);
+        }
+    }
+
     // Implementation
 
     static {
@@ -239,14 +554,131 @@ public class PeerConnection {
 
     private static final String TAG = "PeerConnection";
 
+    private static final int OFFER_CONFIG_VERSION = 1;
+    private static final int OFFER_CONFIG_FLAG_ENABLE_BWE = 0x01;
+    private static final int OFFER_CONFIG_FLAG_ENABLE_RFC8851 = 0x02;
+    private static final int OFFER_CONFIG_FLAG_ENABLE_RED = 0x04;
+
+    @NonNull
+    private static ByteBuffer encodeOfferConfig(@NonNull OfferConfig config,
+                                                @Nullable PubVideoConfig video,
+                                                @Nullable PubAudioConfig audio) {
+        final byte[] cname = config.cname.getBytes(StandardCharsets.UTF_8);
+
+        int size = 2 + 2 + cname.length + 1 + 1;
+        if (video != null) {
+            size += 1 + video.codecList.size() * 8;
+            size += 1;
+            for (SimulcastLayer layer : video.simulcastLayerList) {
+                size += 2 + layer.name.getBytes(StandardCharsets.UTF_8).length + 10;
+            }
+        }
+        if (audio != null) {
+            size += 1 + audio.codecList.size() * 9;
+        }
+
+        final ByteBuffer buf = ByteBuffer.allocateDirect(size).order(ByteOrder.LITTLE_ENDIAN);
+
+        int flags = 0;
+        if (config.enableBWE) {
+            flags |= OFFER_CONFIG_FLAG_ENABLE_BWE;
+        }
+        if (config.enableRFC8851) {
+            flags |= OFFER_CONFIG_FLAG_ENABLE_RFC8851;
+        }
+        if (config.enableRED) {
+            flags |= OFFER_CONFIG_FLAG_ENABLE_RED;
+        }
+
+        buf.put((byte) OFFER_CONFIG_VERSION);
+        buf.put((byte) flags);
+        putString(buf, cname);
+
+        buf.put((byte) (video != null ? 1 : 0));
+        if (video != null) {
+            buf.put((byte) video.codecList.size());
+            for (PubVideoCodec codec : video.codecList) {
+                buf.putInt(codec.codec);
+                buf.putInt(codec.profileLevelId);
+            }
+
+            buf.put((byte) video.simulcastLayerList.size());
+            for (SimulcastLayer layer : video.simulcastLayerList) {
+                putString(buf, layer.name.getBytes(StandardCharsets.UTF_8));
+                buf.putShort((short) layer.width);
+                buf.putShort((short) layer.height);
+                buf.putShort((short) layer.framesPerSecond);
+                buf.putInt(layer.kilobitPerSecond);
+            }
+        }
+
+        buf.put((byte) (audio != null ? 1 : 0));
+        if (audio != null) {
+            buf.put((byte) audio.codecList.size());
+            for (PubAudioCodec codec : audio.codecList) {
+                buf.putInt(codec.codec);
+                buf.putInt(codec.minptime);
+                buf.put((byte) (codec.stereo ? 1 : 0));
+            }
+        }
+
+        buf.flip();
+        return buf;
+    }
+
+    private static void putString(@NonNull ByteBuffer buf, @NonNull byte[] value) {
+        buf.putShort((short) value.length);
+        buf.put(value);
+    }
+
     private native long createImpl();
 
     private native void releaseImpl(long handle);
 
     private native String initPublishOfferImpl(long handle,
-                                               @NonNull OfferConfig config,
-                                               @Nullable PubVideoConfig video,
-                                               @Nullable PubAudioConfig audio) throws SRtcException;
+                                               @NonNull ByteBuffer config,
+                                               int configSize) throws SRtcException;
+
+    private native void reconnectImpl(long handle);
+
+    private static native boolean checkAllocationBudgetImpl() throws SRtcException;
+
+    private native void setThreadPolicyImpl(long handle,
+                                            int role,
+                                            long cpuMask,
+                                            int nice,
+                                            int rtPriority) throws SRtcException;
+
+    private native List<ThreadStats> getThreadStatsImpl(long handle);
+
+    private static native boolean isSoftwareVideoEncoderAvailableImpl();
+
+    private native void startSoftwareVideoEncoderImpl(long handle,
+                                                      @NonNull SimulcastLayer[] layerList,
+                                                      int threadCount) throws SRtcException;
+
+    private native void stopSoftwareVideoEncoderImpl(long handle);
+
+    private native int publishVideoRawFrameImpl(long handle,
+                                                @NonNull ByteBuffer rgba,
+                                                int width,
+                                                int height,
+                                                int stride);
+
+    private native void requestSoftwareVideoKeyFrameImpl(long handle);
+
+    private native void setSoftwareVideoLayerSuspendedImpl(long handle,
+                                                           @NonNull SimulcastLayer layer,
+                                                           boolean suspended);
+
+    private native void setTelemetryPathImpl(long handle,
+                                             @Nullable String path);
+
+    private native void recordVideoEncodeTimeImpl(long handle,
+                                                  long usec);
+
+    private static native void prewarmImpl(@NonNull ByteBuffer config,
+                                           int configSize);
 
     private native void setPublishAnswerImpl(long handle,
                                              @NonNull String answer) throws SRtcException;
@@ -254,22 +686,41 @@ public class PeerConnection {
     private native void setVideoSingleCodecSpecificDataImpl(long handle,
                                                             @NonNull ByteBuffer[] array);
 
-    private native void publishVideoSingleFrameImpl(long handle,
-                                                    @NonNull ByteBuffer buf) throws SRtcException;
+    private native int publishVideoSingleFrameImpl(long handle,
+                                                   @NonNull ByteBuffer buf);
 
     private native void setVideoSimulcastCodecSpecificDataImpl(long handle,
                                                                @NonNull SimulcastLayer layer,
                                                                @NonNull ByteBuffer[] array);
 
-    private native void publishVideoSimulcastFrameImpl(long handle,
-                                                       @NonNull SimulcastLayer layer,
-                                                       @NonNull ByteBuffer buf) throws SRtcException;
+    private native int publishVideoSimulcastFrameImpl(long handle,
+                                                      @NonNull SimulcastLayer layer,
+                                                      @NonNull ByteBuffer buf) throws SRtcException;
+
+    private native int publishAudioFrameImpl(long handle,
+                                             @NonNull ByteBuffer buf,
+                                             int size,
+                                             int sampleRate,
+                                             int channels);
 
-    private native void publishAudioFrameImpl(long handle,
-                                              @NonNull ByteBuffer buf,
-                                              int size,
-                                              int sampleRate,
-                                              int channels) throws SRtcException;
+    private native int publishVideoSingleFrameBorrowedImpl(long handle,
+                                                           @NonNull ByteBuffer buf,
+                                                           long token);
+
+    private native int publishVideoSimulcastFrameBorrowedImpl(long handle,
+                                                              @NonNull SimulcastLayer layer,
+                                                              @NonNull ByteBuffer buf,
+                                                              long token) throws SRtcException;
+
+    private native int drainReleasedFramesImpl(long handle,
+                                               @NonNull long[] tokens);
+
+    private native void cancelBorrowedFramesImpl(long handle,
+                                                 int owner);
+
+    private native int[] getPublishErrorCountsImpl(long handle);
+
+    private native PublishError getLastPublishErrorImpl(long handle);
 
     void fromNativeOnConnectionState(int state) {
         mMainHandler.post(() -> {
@@ -290,6 +741,35 @@ public class PeerConnection {
             }
         });
     }
+
+    void fromNativeOnLayerKeyFrameRequest(String layerName) {
+        mMainHandler.post(() -> {
+            synchronized (mListenerLock) {
+                if (mPublishLayerKeyFrameRequestedListener != null) {
+                    mPublishLayerKeyFrameRequestedListener.onPublishLayerKeyFrameRequested(layerName);
+                }
+            }
+        });
+    }
+
+    void fromNativeOnSimulcastLayerSuspended(String layerName, boolean suspended) {
+        mMainHandler.post(() -> {
+            synchronized (mListenerLock) {
+                if (mPublishSimulcastLayerSuspendedListener != null) {
+                    mPublishSimulcastLayerSuspendedListener.onPublishSimulcastLayerSuspended(layerName, suspended);
+                }
+            }
+        });
+    }
+
+    void fromNativeOnBorrowedFramesReleased() {
+        synchronized (mListenerLock) {
+            if (mBorrowedFramesReleasedListener != null) {
+                mBorrowedFramesReleasedListener.onBorrowedFramesReleased();
+            }
+        }
+    }
+
     void fromNativeOnPublishConnectionStats(PublishConnectionStats stats) {
         mMainHandler.post(() -> {
             synchronized (mListenerLock) {
@@ -313,4 +793,7 @@ public class PeerConnection {
     private ConnectionStateListener mConnectionStateListener;
     private PublishConnectionStatsListener mPublishConnectionStatsListener;
     private PublishKeyFrameRequestedListener mPublishKeyFrameRequestedListener;
+    private PublishLayerKeyFrameRequestedListener mPublishLayerKeyFrameRequestedListener;
+    private PublishSimulcastLayerSuspendedListener mPublishSimulcastLayerSuspendedListener;
+    private BorrowedFramesReleasedListener mBorrowedFramesReleasedListener;
 }
@@ -0,0 +1,153 @@
+// Converts a session telemetry file (see src/main/cpp/session_recorder.h) to CSV on stdout.
+//
+// Build: c++ -std=c++17 -O2 -o telemetry_to_csv tools/telemetry_to_csv.cpp
+// Use:   adb pull /sdcard/Android/data/org.kman.srtctest/files/telemetry-<date>.srtl
+//        ./telemetry_to_csv telemetry-<date>.srtl > telemetry.csv
+
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+struct Column {
+    uint8_t type;
+    std::string name;
+};
+
+class Reader
+{
+public:
+    explicit Reader(const std::vector<uint8_t>& data)
+        : mData(data)
+        , mPos(0)
+    {
+    }
+
+    // The file is little endian, and so is everything we run on
+    template <typename T>
+    bool read(T& value)
+    {
+        if (mPos + sizeof(T) > mData.size()) {
+            return false;
+        }
+        std::memcpy(&value, mData.data() + mPos, sizeof(T));
+        mPos += sizeof(T);
+        return true;
+    }
+
+    bool read(std::string& value, size_t size)
+    {
+        if (mPos + size > mData.size()) {
+            return false;
+        }
+        value.assign(reinterpret_cast<const char*>(mData.data()) + mPos, size);
+        mPos += size;
+        return true;
+    }
+
+    [[nodiscard]] size_t remaining() const
+    {
+        return mData.size() - mPos;
+    }
+
+    [[nodiscard]] const uint8_t* current() const
+    {
+        return mData.data() + mPos;
+    }
+
+private:
+    const std::vector<uint8_t>& mData;
+    size_t mPos;
+};
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    if (argc != 2) {
+        std::fprintf(stderr, "Usage: %s file.srtl > file.csv\n", argv[0]);
+        return 1;
+    }
+
+    std::ifstream file(argv[1], std::ios::binary);
+    if (!file) {
+        std::fprintf(stderr, "Cannot open %s\n", argv[1]);
+        return 1;
+    }
+    const std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    Reader reader(data);
+
+    std::string magic;
+    uint16_t version = 0;
+    uint16_t columnCount = 0;
+    uint32_t rowCount = 0;
+    int64_t startUnixMillis = 0;
+    if (!reader.read(magic, 4) || magic != "SRTL" || !reader.read(version) || !reader.read(columnCount) ||
+        !reader.read(rowCount) || !reader.read(startUnixMillis)) {
+        std::fprintf(stderr, "Not a telemetry file\n");
+        return 1;
+    }
+    if (version != 1) {
+        std::fprintf(stderr, "Unsupported version %u\n", version);
+        return 1;
+    }
+
+    std::vector<Column> columnList(columnCount);
+    for (auto& column : columnList) {
+        uint8_t nameSize = 0;
+        if (!reader.read(column.type) || !reader.read(nameSize) || !reader.read(column.name, nameSize)) {
+            std::fprintf(stderr, "Truncated column list\n");
+            return 1;
+        }
+        if (column.type > 1) {
+            std::fprintf(stderr, "Unknown type %u for column %s\n", column.type, column.name.c_str());
+            return 1;
+        }
+    }
+
+    // Both column types are four bytes
+    if (reader.remaining() < size_t(columnCount) * rowCount * 4) {
+        std::fprintf(stderr, "Truncated data\n");
+        return 1;
+    }
+    const auto values = reader.current();
+
+    std::printf("unix_ms");
+    for (const auto& column : columnList) {
+        std::printf(",%s", column.name.c_str());
+    }
+    std::printf("\n");
+
+    // The first column is time_ms, relative to the session start
+    for (uint32_t row = 0; row < rowCount; row += 1) {
+        for (size_t col = 0; col < columnList.size(); col += 1) {
+            uint32_t bits = 0;
+            std::memcpy(&bits, values + (col * rowCount + row) * 4, 4);
+
+            if (col == 0) {
+                std::printf("%" PRId64 ",", startUnixMillis + bits);
+            } else {
+                std::printf(",");
+            }
+
+            if (columnList[col].type == 0) {
+                std::printf("%" PRIu32, bits);
+            } else {
+                float value = 0;
+                std::memcpy(&value, &bits, 4);
+                std::printf("%.2f", value);
+            }
+        }
+        std::printf("\n");
+    }
+
+    return 0;
+}